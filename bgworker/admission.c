@@ -0,0 +1,132 @@
+/* ------------------------------------------------------------------------
+ * admission.c
+ *  	Decides whether a deferrable job should be held because the cluster
+ * 		is busy. The signals are local and cheap: the backend status array
+ * 		for the active and connected client backends, the proc array for
+ * 		the connections per database and role, and the redo pointer of
+ * 		the checkpoint in progress against the one of the last completed
+ * 		checkpoint in pg_control. They are sampled at most once per launcher
+ * 		pass, and only if a deferrable job is about to start.
+ *
+ * Copyright (c) 2014, Zalando SE.
+ * Portions Copyright (C) 2013-2014, PostgreSQL Global Development Group
+ * ------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "access/xlog.h"
+#include "catalog/pg_control.h"
+#include "miscadmin.h"
+#include "pgstat.h"
+#include "storage/fd.h"
+#include "storage/procarray.h"
+
+/* Our own include files */
+#include "admission.h"
+
+typedef struct ClusterSample
+{
+	bool 		sampled;
+	int 		active; 		/* client backends running a query */
+	int 		connected; 		/* client backends */
+	bool 		checkpoint; 	/* a checkpoint is in progress */
+} ClusterSample;
+
+static ClusterSample 	sample;
+
+
+/* Take a new sample the next time a deferrable job is about to start */
+void
+admission_reset(void)
+{
+	sample.sampled = false;
+}
+
+/*
+ * A checkpoint sets the redo pointer in shared memory when it starts, and the
+ * one in pg_control when it has finished. The control file may be read while
+ * it is being written, a torn read only causes a wrong guess for one pass.
+ */
+static bool
+checkpoint_in_progress(void)
+{
+	ControlFileData control;
+	bool 			result = false;
+	int 			fd;
+
+	fd = OpenTransientFile(XLOG_CONTROL_FILE, O_RDONLY | PG_BINARY, 0);
+	if (fd < 0)
+		return false;
+	if (read(fd, &control, sizeof(ControlFileData)) == sizeof(ControlFileData))
+		result = GetRedoRecPtr() > control.checkPointCopy.redo;
+	CloseTransientFile(fd);
+
+	return result;
+}
+
+/*
+ * Count the client backends from the backend status array. Background workers,
+ * including our own workers, have no client address.
+ */
+static void
+admission_sample(bool checkpoint)
+{
+	SockAddr 	zero_clientaddr;
+	int 		nbackends;
+	int 		i;
+
+	memset(&zero_clientaddr, 0, sizeof(zero_clientaddr));
+	sample.active = 0;
+	sample.connected = 0;
+
+	nbackends = pgstat_fetch_stat_numbackends();
+	for (i = 1; i <= nbackends; i++)
+	{
+		PgBackendStatus *beentry = pgstat_fetch_stat_beentry(i);
+
+		if (beentry == NULL || beentry->st_procpid == MyProcPid)
+			continue;
+		if (memcmp(&beentry->st_clientaddr, &zero_clientaddr, sizeof(zero_clientaddr)) == 0)
+			continue;
+		sample.connected++;
+		if (beentry->st_state == STATE_RUNNING)
+			sample.active++;
+	}
+	/* The next sample must read the backend status array again */
+	pgstat_clear_snapshot();
+
+	sample.checkpoint = checkpoint && checkpoint_in_progress();
+	sample.sampled = true;
+}
+
+/*
+ * Whether the given deferrable job should be held, given the limits. Returns
+ * the reason, or NULL if the job may start. The connection limits of the
+ * database and role are the ones loaded with the job, a worker exceeding them
+ * would fail to connect.
+ */
+const char *
+admission_hold(const JobCacheEntry *entry, const AdmissionLimits *limits)
+{
+	if (!sample.sampled)
+		admission_sample(limits->during_checkpoint);
+
+	if (limits->during_checkpoint && sample.checkpoint)
+		return "a checkpoint is in progress";
+	if (limits->max_active > 0 && sample.active >= limits->max_active)
+		return "too many backends are active";
+	if (limits->connection_reserve > 0 &&
+		MaxConnections - sample.connected <= limits->connection_reserve)
+		return "too few connections are left";
+	if (entry->datconnlimit >= 0 &&
+		entry->datconnlimit - CountDBBackends(entry->datoid) <= limits->connection_reserve)
+		return "too few connections to the database are left";
+	if (entry->rolconnlimit >= 0 &&
+		entry->rolconnlimit - CountUserBackends(entry->roloid) <= limits->connection_reserve)
+		return "too few connections for the role are left";
+	return NULL;
+}
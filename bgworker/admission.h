@@ -0,0 +1,32 @@
+/* ------------------------------------------------------------------------
+ * admission.h
+ *  	Load-aware admission of deferrable jobs, based on cheap samples
+ * 		of the state of the cluster.
+ *
+ * Copyright (c) 2014, Zalando SE.
+ * Portions Copyright (C) 2013-2014, PostgreSQL Global Development Group
+ * ------------------------------------------------------------------------
+ */
+
+#ifndef _ADMISSION_H
+#define _ADMISSION_H
+
+#include "postgres.h"
+
+#include "jobcache.h"
+
+/* How often the launcher looks again at the cluster while deferrable jobs are held, in ms */
+#define ADMISSION_RECHECK_INTERVAL 	1000
+
+/* The thresholds over which deferrable jobs are held, 0 or false disables a check */
+typedef struct AdmissionLimits
+{
+	int 		max_active; 		/* active client backends */
+	int 		connection_reserve; /* connections which must be left free */
+	bool 		during_checkpoint; 	/* hold the jobs while a checkpoint is in progress */
+} AdmissionLimits;
+
+void admission_reset(void);
+const char *admission_hold(const JobCacheEntry *entry, const AdmissionLimits *limits);
+
+#endif /* _ADMISSION_H */
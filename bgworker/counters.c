@@ -0,0 +1,247 @@
+/* ------------------------------------------------------------------------
+ * counters.c
+ *  	Keeps the success and failure counters of the jobs in a shared memory
+ * 		hash, instead of updating the job row after every run. The launcher
+ * 		adds the outcomes it collects and writes the accumulated counters
+ * 		to the job table every counter_flush_interval. The live values are
+ * 		available through the job_counters view.
+ *
+ * Copyright (c) 2014, Zalando SE.
+ * Portions Copyright (C) 2013-2014, PostgreSQL Global Development Group
+ * ------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+
+#include "access/htup_details.h"
+#include "catalog/pg_type.h"
+#include "executor/spi.h"
+#include "fmgr.h"
+#include "funcapi.h"
+#include "lib/stringinfo.h"
+#include "miscadmin.h"
+#include "storage/shmem.h"
+#include "utils/array.h"
+#include "utils/builtins.h"
+#include "utils/lsyscache.h"
+#include "utils/tuplestore.h"
+
+/* Our own include files */
+#include "counters.h"
+#include "shared.h"
+
+#define JOB_COUNTERS_COLUMNS 	4
+
+PG_FUNCTION_INFO_V1(job_pending_counters);
+
+Datum job_pending_counters(PG_FUNCTION_ARGS);
+
+HTAB *job_counters = NULL;
+
+
+Size
+job_counters_shmem_size(void)
+{
+	return hash_estimate_size(JOB_COUNTERS_SIZE, sizeof(JobCounters));
+}
+
+/* Create or attach to the hash, must be called holding AddinShmemInitLock */
+void
+job_counters_shmem_init(void)
+{
+	HASHCTL 	ctl;
+
+	memset(&ctl, 0, sizeof(ctl));
+	ctl.keysize = sizeof(uint32);
+	ctl.entrysize = sizeof(JobCounters);
+	ctl.hash = tag_hash;
+	job_counters = ShmemInitHash("elephant_worker job counters",
+								 JOB_COUNTERS_SIZE, JOB_COUNTERS_SIZE,
+								 &ctl, HASH_ELEM | HASH_FUNCTION);
+}
+
+/*
+ * Account for a run of the given job. Returns false if the hash is full, the
+ * caller then has to update the job table itself.
+ */
+bool
+job_counters_add(uint32 job_id, bool success, TimestampTz started)
+{
+	JobCounters    *entry;
+	bool 			found;
+
+	LWLockAcquire(shared_state->counters_lock, LW_EXCLUSIVE);
+	entry = hash_search(job_counters, &job_id, HASH_ENTER_NULL, &found);
+	if (entry == NULL)
+	{
+		LWLockRelease(shared_state->counters_lock);
+		return false;
+	}
+	if (!found)
+	{
+		entry->succeeded = 0;
+		entry->failed = 0;
+		entry->last_executed = 0;
+	}
+	if (success)
+		entry->succeeded++;
+	else
+		entry->failed++;
+	if (started > entry->last_executed)
+		entry->last_executed = started;
+	LWLockRelease(shared_state->counters_lock);
+
+	return true;
+}
+
+/*
+ * Write the pending counters to the job table and take them out of the hash.
+ * The hash is not locked while the job table is updated, runs accounted for in
+ * the meantime stay in the hash. Until the transaction commits, readers of the
+ * job_counters view may see some runs twice.
+ * Must be called inside a transaction with SPI connected.
+ */
+void
+job_counters_write(const char *schema)
+{
+	HASH_SEQ_STATUS status;
+	JobCounters    *entry;
+	JobCounters    *written;
+	ArrayBuildState *columns[JOB_COUNTERS_COLUMNS];
+	Oid 			elemtypes[JOB_COUNTERS_COLUMNS] = {INT4OID, INT8OID, INT8OID, TIMESTAMPTZOID};
+	Oid 			argtypes[JOB_COUNTERS_COLUMNS];
+	Datum 			values[JOB_COUNTERS_COLUMNS];
+	StringInfoData 	buf;
+	long 			nentries;
+	int 			n = 0;
+	int 			ret;
+	int 			i;
+
+	/* Take a copy, so that we do not hold the lock while running the query */
+	LWLockAcquire(shared_state->counters_lock, LW_SHARED);
+	nentries = hash_get_num_entries(job_counters);
+	if (nentries == 0)
+	{
+		LWLockRelease(shared_state->counters_lock);
+		return;
+	}
+	written = palloc(sizeof(JobCounters) * nentries);
+	hash_seq_init(&status, job_counters);
+	while ((entry = hash_seq_search(&status)) != NULL)
+	{
+		/* The hash is shared by all launchers, each one writes the jobs it owns */
+		if (launcher_owns_job(entry->job_id))
+			memcpy(&written[n++], entry, sizeof(JobCounters));
+	}
+	LWLockRelease(shared_state->counters_lock);
+
+	if (n == 0)
+	{
+		pfree(written);
+		return;
+	}
+
+	memset(columns, 0, sizeof(columns));
+	for (i = 0; i < n; i++)
+	{
+		columns[0] = accumArrayResult(columns[0], Int32GetDatum((int32) written[i].job_id), false, INT4OID, CurrentMemoryContext);
+		columns[1] = accumArrayResult(columns[1], Int64GetDatum(written[i].succeeded), false, INT8OID, CurrentMemoryContext);
+		columns[2] = accumArrayResult(columns[2], Int64GetDatum(written[i].failed), false, INT8OID, CurrentMemoryContext);
+		columns[3] = accumArrayResult(columns[3], TimestampTzGetDatum(written[i].last_executed), false, TIMESTAMPTZOID, CurrentMemoryContext);
+	}
+	for (i = 0; i < JOB_COUNTERS_COLUMNS; i++)
+	{
+		argtypes[i] = get_array_type(elemtypes[i]);
+		values[i] = makeArrayResult(columns[i], CurrentMemoryContext);
+	}
+
+	initStringInfo(&buf);
+	appendStringInfo(&buf, "UPDATE %s.job "
+							  "SET success_count = job.success_count + c.succeeded,"
+								  "failure_count = job.failure_count + c.failed,"
+								  "last_executed = greatest(job.last_executed, c.last_executed) "
+							 "FROM unnest($1, $2, $3, $4) AS c(job_id, succeeded, failed, last_executed) "
+							"WHERE job.job_id = c.job_id",
+							quote_identifier(schema));
+
+	ret = SPI_execute_with_args(buf.data, JOB_COUNTERS_COLUMNS, argtypes, values, NULL, false, 0);
+	if (ret != SPI_OK_UPDATE)
+		elog(ERROR, "could not write the counters of %d jobs", n);
+
+	/* Take out what we have written, keep what was added in the meantime */
+	LWLockAcquire(shared_state->counters_lock, LW_EXCLUSIVE);
+	for (i = 0; i < n; i++)
+	{
+		entry = hash_search(job_counters, &written[i].job_id, HASH_FIND, NULL);
+		if (entry == NULL)
+			continue;
+		entry->succeeded -= written[i].succeeded;
+		entry->failed -= written[i].failed;
+		if (entry->succeeded == 0 && entry->failed == 0)
+			hash_search(job_counters, &written[i].job_id, HASH_REMOVE, NULL);
+	}
+	LWLockRelease(shared_state->counters_lock);
+
+	elog(DEBUG1, "wrote the counters of %d jobs", n);
+
+	pfree(buf.data);
+	pfree(written);
+}
+
+/*
+ * The runs of the jobs which are not yet accounted for in the job table,
+ * used by the job_counters view.
+ */
+Datum
+job_pending_counters(PG_FUNCTION_ARGS)
+{
+	ReturnSetInfo  *rsinfo = (ReturnSetInfo *) fcinfo->resultinfo;
+	TupleDesc 		tupdesc;
+	Tuplestorestate *tupstore;
+	MemoryContext 	oldcxt;
+	HASH_SEQ_STATUS status;
+	JobCounters    *entry;
+
+	if (rsinfo == NULL || !IsA(rsinfo, ReturnSetInfo))
+		ereport(ERROR,
+				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+				 errmsg("set-valued function called in context that cannot accept a set")));
+	if (!(rsinfo->allowedModes & SFRM_Materialize))
+		ereport(ERROR,
+				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+				 errmsg("materialize mode required, but it is not allowed in this context")));
+	if (get_call_result_type(fcinfo, NULL, &tupdesc) != TYPEFUNC_COMPOSITE)
+		elog(ERROR, "return type must be a row type");
+
+	if (shared_state == NULL)
+		ereport(ERROR,
+				(errcode(ERRCODE_OBJECT_NOT_IN_PREREQUISITE_STATE),
+				 errmsg("elephant_worker must be loaded via shared_preload_libraries")));
+
+	oldcxt = MemoryContextSwitchTo(rsinfo->econtext->ecxt_per_query_memory);
+	tupstore = tuplestore_begin_heap(true, false, work_mem);
+	rsinfo->returnMode = SFRM_Materialize;
+	rsinfo->setResult = tupstore;
+	rsinfo->setDesc = tupdesc;
+	MemoryContextSwitchTo(oldcxt);
+
+	LWLockAcquire(shared_state->counters_lock, LW_SHARED);
+	hash_seq_init(&status, job_counters);
+	while ((entry = hash_seq_search(&status)) != NULL)
+	{
+		Datum 	values[JOB_COUNTERS_COLUMNS];
+		bool 	nulls[JOB_COUNTERS_COLUMNS];
+
+		memset(nulls, 0, sizeof(nulls));
+		values[0] = Int32GetDatum((int32) entry->job_id);
+		values[1] = Int64GetDatum(entry->succeeded);
+		values[2] = Int64GetDatum(entry->failed);
+		values[3] = TimestampTzGetDatum(entry->last_executed);
+		tuplestore_putvalues(tupstore, tupdesc, values, nulls);
+	}
+	LWLockRelease(shared_state->counters_lock);
+
+	tuplestore_donestoring(tupstore);
+
+	return (Datum) 0;
+}
@@ -0,0 +1,38 @@
+/* ------------------------------------------------------------------------
+ * counters.h
+ *  	Success and failure counters of the jobs, kept in shared memory
+ * 		and written to the job table from time to time.
+ *
+ * Copyright (c) 2014, Zalando SE.
+ * Portions Copyright (C) 2013-2014, PostgreSQL Global Development Group
+ * ------------------------------------------------------------------------
+ */
+
+#ifndef _COUNTERS_H
+#define _COUNTERS_H
+
+#include "postgres.h"
+
+#include "utils/hsearch.h"
+#include "utils/timestamp.h"
+
+/* Number of jobs whose counters may be pending at the same time */
+#define JOB_COUNTERS_SIZE 	16384
+
+/* The runs of a job not yet accounted for in the job table */
+typedef struct JobCounters
+{
+	uint32 		job_id; 		/* hash key, must be first */
+	int64 		succeeded;
+	int64 		failed;
+	TimestampTz last_executed;
+} JobCounters;
+
+extern HTAB *job_counters;
+
+Size job_counters_shmem_size(void);
+void job_counters_shmem_init(void);
+bool job_counters_add(uint32 job_id, bool success, TimestampTz started);
+void job_counters_write(const char *schema);
+
+#endif /* _COUNTERS_H */
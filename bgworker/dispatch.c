@@ -0,0 +1,452 @@
+/* ------------------------------------------------------------------------
+ * dispatch.c
+ *  	Holds the jobs which are due until the launcher hands them to a
+ * 		worker. Every job is released at its own moment, which allows the
+ * 		launcher to spread jobs sharing a schedule over a window. Released
+ * 		jobs pass a token bucket, which limits the number of launches per
+ * 		second, so a burst of due jobs becomes a ramp.
+ *
+ * 		Released jobs wait in a group per database and role, ordered by
+ * 		priority. The next job is taken from the database running the
+ * 		fewest jobs, so that a database with many due jobs cannot starve
+ * 		the others out of the worker slots. Groups whose database or role
+ * 		has reached its concurrency cap are passed over. A job stays queued
+ * 		until a worker slot is available for it.
+ *
+ * 		Normally a job is queued once, a job which becomes due again while
+ * 		it is still waiting is not queued twice. Jobs which must run for
+ * 		every moment they were due, see the misfire policy, are queued once
+ * 		for every such moment.
+ *
+ * 		One-shot tasks share the groups, and so the worker slots, with the
+ * 		jobs. Every task is queued once, with the lowest priority.
+ *
+ * Copyright (c) 2014, Zalando SE.
+ * Portions Copyright (C) 2013-2014, PostgreSQL Global Development Group
+ * ------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+
+#include "nodes/pg_list.h"
+#include "utils/hsearch.h"
+#include "utils/memutils.h"
+
+/* Our own include files */
+#include "dispatch.h"
+
+typedef struct DispatchGroup DispatchGroup;
+
+typedef struct DispatchItem
+{
+	TimestampTz 	release_at;
+	uint64 			seq; 		/* keeps jobs of the same moment and priority in order */
+	uint32 			job_id;
+	pg_time_t 		due_at;
+	uint64 			task_id; 	/* a one-shot task if not 0 */
+	int 			priority; 	/* higher runs first */
+	DispatchGroup  *group;
+} DispatchItem;
+
+typedef bool (*dispatch_item_order) (const DispatchItem *a, const DispatchItem *b);
+
+typedef struct DispatchHeap
+{
+	DispatchItem   *items;
+	int 			size;
+	int 			capacity;
+} DispatchHeap;
+
+/* The released jobs of a database and role */
+struct DispatchGroup
+{
+	char 			datname[NAMEDATALEN];
+	char 			rolname[NAMEDATALEN];
+	DispatchHeap 	ready;
+};
+
+/* The number of queued runs of a job */
+typedef struct QueuedJob
+{
+	uint32 			job_id; 	/* hash key, must be first */
+	int 			nruns;
+} QueuedJob;
+
+static MemoryContext 	dispatch_context = NULL;
+/* The jobs waiting for their release moment */
+static DispatchHeap 	pending;
+static List 		   *groups = NIL;
+/* The ids of all queued jobs */
+static HTAB 		   *queued_jobs = NULL;
+static int 				nqueued = 0;
+static uint64 			queue_seq = 0;
+
+/* The job handed out last, so that it can be put back */
+static DispatchItem 	last_taken;
+/* The jobs set aside until the end of the launcher's pass */
+static DispatchItem    *deferred = NULL;
+static int 				ndeferred = 0;
+static int 				deferred_capacity = 0;
+
+/* The launch rate limiter, at most max_rate tokens are kept */
+static double 			tokens = 0;
+static TimestampTz 		tokens_updated = 0;
+
+
+static bool
+released_before(const DispatchItem *a, const DispatchItem *b)
+{
+	if (a->release_at != b->release_at)
+		return a->release_at < b->release_at;
+	return a->seq < b->seq;
+}
+
+static bool
+ready_before(const DispatchItem *a, const DispatchItem *b)
+{
+	if (a->priority != b->priority)
+		return a->priority > b->priority;
+	return released_before(a, b);
+}
+
+static void
+dispatch_heap_push(DispatchHeap *heap, const DispatchItem *item, dispatch_item_order before)
+{
+	int 	index;
+
+	if (heap->items == NULL)
+	{
+		heap->capacity = 64;
+		heap->items = MemoryContextAlloc(dispatch_context, sizeof(DispatchItem) * heap->capacity);
+	}
+	else if (heap->size == heap->capacity)
+	{
+		heap->capacity *= 2;
+		heap->items = repalloc(heap->items, sizeof(DispatchItem) * heap->capacity);
+	}
+
+	index = heap->size++;
+	while (index > 0)
+	{
+		int 	parent = (index - 1) / 2;
+
+		if (!before(item, &heap->items[parent]))
+			break;
+		heap->items[index] = heap->items[parent];
+		index = parent;
+	}
+	heap->items[index] = *item;
+}
+
+static void
+dispatch_heap_pop(DispatchHeap *heap, dispatch_item_order before)
+{
+	DispatchItem 	item;
+	int 			index = 0;
+
+	item = heap->items[--heap->size];
+	if (heap->size == 0)
+		return;
+
+	for (;;)
+	{
+		int 	child = 2 * index + 1;
+
+		if (child >= heap->size)
+			break;
+		if (child + 1 < heap->size && before(&heap->items[child + 1], &heap->items[child]))
+			child++;
+		if (!before(&heap->items[child], &item))
+			break;
+		heap->items[index] = heap->items[child];
+		index = child;
+	}
+	heap->items[index] = item;
+}
+
+static void
+dispatch_init(void)
+{
+	HASHCTL 	ctl;
+
+	dispatch_context = AllocSetContextCreate(TopMemoryContext,
+											 "elephant dispatch queue",
+											 ALLOCSET_DEFAULT_MINSIZE,
+											 ALLOCSET_DEFAULT_INITSIZE,
+											 ALLOCSET_DEFAULT_MAXSIZE);
+	memset(&pending, 0, sizeof(pending));
+
+	memset(&ctl, 0, sizeof(ctl));
+	ctl.keysize = sizeof(uint32);
+	ctl.entrysize = sizeof(QueuedJob);
+	ctl.hash = tag_hash;
+	ctl.hcxt = dispatch_context;
+	queued_jobs = hash_create("elephant queued jobs", 1024, &ctl,
+							  HASH_ELEM | HASH_FUNCTION | HASH_CONTEXT);
+}
+
+static DispatchGroup *
+dispatch_group(const char *datname, const char *rolname)
+{
+	ListCell 	   *lc;
+	DispatchGroup  *group;
+	MemoryContext 	oldcxt;
+
+	foreach(lc, groups)
+	{
+		group = lfirst(lc);
+		if (strcmp(group->datname, datname) == 0 && strcmp(group->rolname, rolname) == 0)
+			return group;
+	}
+
+	oldcxt = MemoryContextSwitchTo(dispatch_context);
+	group = palloc0(sizeof(DispatchGroup));
+	snprintf(group->datname, NAMEDATALEN, "%s", datname);
+	snprintf(group->rolname, NAMEDATALEN, "%s", rolname);
+	groups = lappend(groups, group);
+	MemoryContextSwitchTo(oldcxt);
+
+	return group;
+}
+
+/* Count a run of a job, or a task, as queued */
+static void
+dispatch_count_run(const DispatchItem *item)
+{
+	QueuedJob  *queued;
+	bool 		found;
+
+	nqueued++;
+	if (item->task_id != 0)
+		return;
+
+	queued = hash_search(queued_jobs, &item->job_id, HASH_ENTER, &found);
+	if (!found)
+		queued->nruns = 0;
+	queued->nruns++;
+}
+
+/*
+ * Queue the run of a job which was due at due_at, it will not be handed out
+ * before release_at. Unless all runs are wanted, returns false if the job is
+ * queued already, for example because it is still waiting for a worker slot
+ * since its previous run was due.
+ */
+bool
+dispatch_queue_add(uint32 job_id, pg_time_t due_at, int priority, const char *datname,
+				   const char *rolname, TimestampTz release_at, bool all_runs)
+{
+	DispatchItem 	item;
+
+	if (dispatch_context == NULL)
+		dispatch_init();
+
+	if (!all_runs && hash_search(queued_jobs, &job_id, HASH_FIND, NULL) != NULL)
+		return false;
+
+	item.release_at = release_at;
+	item.seq = queue_seq++;
+	item.job_id = job_id;
+	item.due_at = due_at;
+	item.task_id = 0;
+	item.priority = priority;
+	item.group = dispatch_group(datname, rolname);
+	dispatch_count_run(&item);
+	dispatch_heap_push(&pending, &item, released_before);
+
+	return true;
+}
+
+/*
+ * Queue a one-shot task, it will not be handed out before release_at. Tasks go
+ * after the jobs of their group, whatever the priority of those jobs.
+ */
+void
+dispatch_queue_add_task(uint64 task_id, const char *datname, const char *rolname,
+						TimestampTz release_at)
+{
+	DispatchItem 	item;
+
+	if (dispatch_context == NULL)
+		dispatch_init();
+
+	item.release_at = release_at;
+	item.seq = queue_seq++;
+	item.job_id = 0;
+	item.due_at = 0;
+	item.task_id = task_id;
+	item.priority = INT_MIN;
+	item.group = dispatch_group(datname, rolname);
+	dispatch_count_run(&item);
+	dispatch_heap_push(&pending, &item, released_before);
+}
+
+/* Add the tokens earned since the last call */
+static void
+dispatch_refill_tokens(TimestampTz now, int max_rate)
+{
+	long 	secs;
+	int 	microsecs;
+
+	if (tokens_updated == 0)
+		tokens = max_rate;
+	else
+	{
+		TimestampDifference(tokens_updated, now, &secs, &microsecs);
+		tokens += (secs + microsecs / 1000000.0) * max_rate;
+	}
+	tokens_updated = now;
+	if (tokens > max_rate)
+		tokens = max_rate;
+}
+
+/*
+ * Take the next job to launch. Jobs whose release moment has passed are moved to
+ * their group first. A max_rate of 0 means unlimited. Returns false if no job
+ * may be launched now.
+ */
+bool
+dispatch_queue_next(TimestampTz now, int max_rate, dispatch_admit_hook admit,
+					dispatch_load_hook load, JobRun *run)
+{
+	QueuedJob 	   *queued;
+	DispatchGroup  *best = NULL;
+	int 			best_load = 0;
+	ListCell 	   *lc;
+
+	if (nqueued == 0)
+		return false;
+
+	while (pending.size > 0 && pending.items[0].release_at <= now)
+	{
+		DispatchItem 	item = pending.items[0];
+
+		dispatch_heap_pop(&pending, released_before);
+		dispatch_heap_push(&item.group->ready, &item, ready_before);
+	}
+
+	if (max_rate > 0)
+	{
+		dispatch_refill_tokens(now, max_rate);
+		if (tokens < 1)
+			return false;
+	}
+
+	foreach(lc, groups)
+	{
+		DispatchGroup  *group = lfirst(lc);
+		int 			group_load;
+
+		if (group->ready.size == 0 || !admit(group->datname, group->rolname))
+			continue;
+
+		group_load = load(group->datname);
+		if (best == NULL || group_load < best_load ||
+			(group_load == best_load && ready_before(&group->ready.items[0], &best->ready.items[0])))
+		{
+			best = group;
+			best_load = group_load;
+		}
+	}
+	if (best == NULL)
+		return false;
+
+	last_taken = best->ready.items[0];
+	dispatch_heap_pop(&best->ready, ready_before);
+	if (last_taken.task_id == 0)
+	{
+		queued = hash_search(queued_jobs, &last_taken.job_id, HASH_FIND, NULL);
+		if (--queued->nruns == 0)
+			hash_search(queued_jobs, &last_taken.job_id, HASH_REMOVE, NULL);
+	}
+	nqueued--;
+	if (max_rate > 0)
+		tokens -= 1;
+
+	run->job_id = last_taken.job_id;
+	run->due_at = last_taken.due_at;
+	run->task_id = last_taken.task_id;
+	return true;
+}
+
+/* Put the job handed out last back in front of its group, it could not be launched */
+void
+dispatch_queue_putback(void)
+{
+	dispatch_count_run(&last_taken);
+	dispatch_heap_push(&last_taken.group->ready, &last_taken, ready_before);
+	tokens += 1;
+}
+
+/*
+ * Set the job handed out last aside, it cannot be launched before another run
+ * of it has finished. It is not handed out again until dispatch_queue_restore
+ * is called, so the other jobs are not held up.
+ */
+void
+dispatch_queue_defer(void)
+{
+	dispatch_count_run(&last_taken);
+	if (deferred == NULL)
+	{
+		deferred_capacity = 16;
+		deferred = MemoryContextAlloc(dispatch_context, sizeof(DispatchItem) * deferred_capacity);
+	}
+	else if (ndeferred == deferred_capacity)
+	{
+		deferred_capacity *= 2;
+		deferred = repalloc(deferred, sizeof(DispatchItem) * deferred_capacity);
+	}
+	deferred[ndeferred++] = last_taken;
+	tokens += 1;
+}
+
+/* Return the jobs set aside to their groups */
+void
+dispatch_queue_restore(void)
+{
+	int 	i;
+
+	for (i = 0; i < ndeferred; i++)
+		dispatch_heap_push(&deferred[i].group->ready, &deferred[i], ready_before);
+	ndeferred = 0;
+}
+
+/* Number of jobs waiting to be launched */
+int
+dispatch_queue_length(void)
+{
+	return nqueued;
+}
+
+/*
+ * The moment the next job waiting for its release moment or for the launch rate
+ * may be launched, 0 if there is none. Jobs waiting for a worker slot do not
+ * count, the launcher is woken up when a worker stops.
+ */
+TimestampTz
+dispatch_queue_wakeup(TimestampTz now, int max_rate)
+{
+	TimestampTz 	result = 0;
+
+	if (nqueued == 0)
+		return 0;
+
+	if (pending.size > 0)
+		result = pending.items[0].release_at;
+
+	if (max_rate > 0)
+	{
+		dispatch_refill_tokens(now, max_rate);
+		if (tokens < 1)
+		{
+			TimestampTz 	refilled;
+
+			refilled = TimestampTzPlusMilliseconds(now, (int64) ((1 - tokens) * 1000 / max_rate) + 1);
+			/* Released jobs are waiting for a token */
+			if (nqueued > pending.size || refilled > result)
+				result = refilled;
+		}
+	}
+	return result;
+}
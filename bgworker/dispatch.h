@@ -0,0 +1,37 @@
+/* ------------------------------------------------------------------------
+ * dispatch.h
+ *  	The launcher's queue of jobs which are due but have not been
+ * 		handed to a worker yet.
+ *
+ * Copyright (c) 2014, Zalando SE.
+ * Portions Copyright (C) 2013-2014, PostgreSQL Global Development Group
+ * ------------------------------------------------------------------------
+ */
+
+#ifndef _DISPATCH_H
+#define _DISPATCH_H
+
+#include "postgres.h"
+
+#include "utils/timestamp.h"
+
+#include "jobs.h"
+
+/* Whether a job of the given database and role may start now, given the concurrency caps */
+typedef bool (*dispatch_admit_hook) (const char *datname, const char *rolname);
+/* The number of jobs of the given database which are running */
+typedef int (*dispatch_load_hook) (const char *datname);
+
+bool dispatch_queue_add(uint32 job_id, pg_time_t due_at, int priority, const char *datname,
+						const char *rolname, TimestampTz release_at, bool all_runs);
+void dispatch_queue_add_task(uint64 task_id, const char *datname, const char *rolname,
+							 TimestampTz release_at);
+bool dispatch_queue_next(TimestampTz now, int max_rate, dispatch_admit_hook admit,
+						 dispatch_load_hook load, JobRun *run);
+void dispatch_queue_putback(void);
+void dispatch_queue_defer(void);
+void dispatch_queue_restore(void);
+int dispatch_queue_length(void);
+TimestampTz dispatch_queue_wakeup(TimestampTz now, int max_rate);
+
+#endif /* _DISPATCH_H */
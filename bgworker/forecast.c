@@ -0,0 +1,291 @@
+/* ------------------------------------------------------------------------
+ * forecast.c
+ *  	Forecasts which jobs will run in every minute of a period, to find
+ * 		load spikes before they happen. The compiled schedules of all
+ * 		enabled jobs are loaded once, the crontab jobs into the same
+ * 		bit-sliced index the launcher uses, so that every minute of the
+ * 		period costs a few word operations per 64 jobs. Jobs scheduled to
+ * 		the second, or at an interval, are listed once for every minute in
+ * 		which they fire.
+ *
+ * Copyright (c) 2014, Zalando SE.
+ * Portions Copyright (C) 2013-2014, PostgreSQL Global Development Group
+ * ------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+
+#include "executor/spi.h"
+#include "fmgr.h"
+#include "funcapi.h"
+#include "lib/stringinfo.h"
+#include "miscadmin.h"
+#include "utils/builtins.h"
+#include "utils/lsyscache.h"
+#include "utils/memutils.h"
+#include "utils/timestamp.h"
+#include "utils/tuplestore.h"
+
+/* Our own include files */
+#include "jobindex.h"
+#include "schedule.h"
+
+PG_FUNCTION_INFO_V1(schedule_forecast);
+PG_FUNCTION_INFO_V1(schedule_forecast_counts);
+
+Datum schedule_forecast(PG_FUNCTION_ARGS);
+Datum schedule_forecast_counts(PG_FUNCTION_ARGS);
+
+/* A moment of a job scheduled at fixed timestamps */
+typedef struct ForecastMoment
+{
+	pg_time_t 	minute;
+	uint32 		job_id;
+} ForecastMoment;
+
+/* A job whose schedule is evaluated for every minute */
+typedef struct ForecastPeriodic
+{
+	uint32 			job_id;
+	CompiledSchedule schedule;
+} ForecastPeriodic;
+
+typedef struct Forecast
+{
+	uint32 		   *job_ids; 		/* the entries of the crontab index */
+	int 			njobs;
+	ForecastMoment *moments; 		/* sorted on minute */
+	int 			nmoments;
+	ForecastPeriodic *periodic; 	/* crontabs with seconds and intervals */
+	int 			nperiodic;
+} Forecast;
+
+static int
+compare_moments(const void *a, const void *b)
+{
+	const ForecastMoment *ma = (const ForecastMoment *) a;
+	const ForecastMoment *mb = (const ForecastMoment *) b;
+
+	if (ma->minute != mb->minute)
+		return (ma->minute > mb->minute) ? 1 : -1;
+	return (ma->job_id > mb->job_id) ? 1 : ((ma->job_id < mb->job_id) ? -1 : 0);
+}
+
+/*
+ * Load the schedules of the enabled jobs of the roles the session user is a
+ * member of, like job_scheduled_at does. Only the moments of timestamp
+ * schedules between first and last are kept.
+ */
+static void
+forecast_load(Forecast *forecast, const char *schema, pg_time_t first, pg_time_t last, MemoryContext cxt)
+{
+	StringInfoData 	buf;
+	int 			maxmoments = 1024;
+	int 			ret;
+	int 			i;
+
+	memset(forecast, 0, sizeof(Forecast));
+	job_index_init(cxt);
+
+	initStringInfo(&buf);
+	appendStringInfo(&buf, "SELECT job_id, schedule "
+							 "FROM %s.job "
+							"WHERE enabled "
+							  "AND schedule IS NOT NULL "
+							  "AND pg_has_role(session_user, roloid, 'MEMBER')",
+							 quote_identifier(schema));
+
+	SPI_connect();
+	ret = SPI_execute(buf.data, true, 0);
+	if (ret != SPI_OK_SELECT)
+		elog(ERROR, "cannot load the job schedules");
+
+	forecast->job_ids = MemoryContextAlloc(cxt, sizeof(uint32) * Max(SPI_processed, 1));
+	forecast->moments = MemoryContextAlloc(cxt, sizeof(ForecastMoment) * maxmoments);
+	forecast->periodic = MemoryContextAlloc(cxt, sizeof(ForecastPeriodic) * Max(SPI_processed, 1));
+
+	for (i = 0; i < SPI_processed; i++)
+	{
+		HeapTuple 	tuple = SPI_tuptable->vals[i];
+		TupleDesc 	tupdesc = SPI_tuptable->tupdesc;
+		uint32 		job_id;
+		Schedule   *schedule;
+		bool 		isnull;
+		int 		t;
+
+		job_id = DatumGetInt32(SPI_getbinval(tuple, tupdesc, 1, &isnull));
+		schedule = DatumGetScheduleP(SPI_getbinval(tuple, tupdesc, 2, &isnull));
+
+		if (schedule->kind != SCHEDULE_TIMESTAMPS)
+		{
+			ForecastPeriodic *periodic = &forecast->periodic[forecast->nperiodic];
+
+			compile_schedule(schedule, &periodic->schedule, cxt);
+			if (schedule_has_seconds(&periodic->schedule) || schedule->kind == SCHEDULE_INTERVAL)
+			{
+				periodic->job_id = job_id;
+				forecast->nperiodic++;
+				continue;
+			}
+
+			forecast->job_ids[forecast->njobs] = job_id;
+			job_index_add(&schedule->data.cron, &forecast->job_ids[forecast->njobs]);
+			forecast->njobs++;
+			continue;
+		}
+
+		for (t = 0; t < SCHEDULE_NTIMESTAMPS(schedule); t++)
+		{
+			pg_time_t 	minute = (pg_time_t) schedule->data.timestamps[t];
+
+			if (minute < first || minute > last)
+				continue;
+			if (forecast->nmoments == maxmoments)
+			{
+				maxmoments *= 2;
+				forecast->moments = repalloc(forecast->moments, sizeof(ForecastMoment) * maxmoments);
+			}
+			forecast->moments[forecast->nmoments].minute = minute;
+			forecast->moments[forecast->nmoments].job_id = job_id;
+			forecast->nmoments++;
+		}
+	}
+	SPI_finish();
+	pfree(buf.data);
+
+	qsort(forecast->moments, forecast->nmoments, sizeof(ForecastMoment), compare_moments);
+}
+
+/*
+ * Evaluate every minute from the first minute at or after "from" up to and
+ * including the minute of "to". Either one row per job and minute, or one row
+ * per minute with the number of jobs is returned.
+ */
+static Datum
+forecast_internal(FunctionCallInfo fcinfo, bool counts)
+{
+	ReturnSetInfo  *rsinfo = (ReturnSetInfo *) fcinfo->resultinfo;
+	TimestampTz 	from = PG_GETARG_TIMESTAMPTZ(0);
+	TimestampTz 	to = PG_GETARG_TIMESTAMPTZ(1);
+	TupleDesc 		tupdesc;
+	Tuplestorestate *tupstore;
+	MemoryContext 	oldcxt;
+	MemoryContext 	forecast_context;
+	Forecast 		forecast;
+	pg_time_t 		first;
+	pg_time_t 		last;
+	pg_time_t 		minute;
+	char 		   *schema;
+	int 			next_moment = 0;
+
+	if (rsinfo == NULL || !IsA(rsinfo, ReturnSetInfo))
+		ereport(ERROR,
+				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+				 errmsg("set-valued function called in context that cannot accept a set")));
+	if (!(rsinfo->allowedModes & SFRM_Materialize))
+		ereport(ERROR,
+				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+				 errmsg("materialize mode required, but it is not allowed in this context")));
+	if (get_call_result_type(fcinfo, NULL, &tupdesc) != TYPEFUNC_COMPOSITE)
+		elog(ERROR, "return type must be a row type");
+
+	if (TIMESTAMP_NOT_FINITE(from) || TIMESTAMP_NOT_FINITE(to))
+		ereport(ERROR,
+				(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+				 errmsg("the forecast period must be finite")));
+
+	first = timestamptz_to_time_t(from);
+	first = first - first % 60 + ((first % 60 != 0) ? 60 : 0);
+	last = timestamptz_to_time_t(to);
+	last -= last % 60;
+
+	oldcxt = MemoryContextSwitchTo(rsinfo->econtext->ecxt_per_query_memory);
+	tupstore = tuplestore_begin_heap(true, false, work_mem);
+	rsinfo->returnMode = SFRM_Materialize;
+	rsinfo->setResult = tupstore;
+	rsinfo->setDesc = tupdesc;
+	MemoryContextSwitchTo(oldcxt);
+
+	/* The job table lives in the schema of this function */
+	schema = get_namespace_name(get_func_namespace(fcinfo->flinfo->fn_oid));
+
+	forecast_context = AllocSetContextCreate(CurrentMemoryContext,
+											 "elephant schedule forecast",
+											 ALLOCSET_DEFAULT_MINSIZE,
+											 ALLOCSET_DEFAULT_INITSIZE,
+											 ALLOCSET_DEFAULT_MAXSIZE);
+	forecast_load(&forecast, schema, first, last, forecast_context);
+
+	for (minute = first; minute <= last; minute += 60)
+	{
+		Datum 			values[2];
+		bool 			nulls[2] = {false, false};
+		struct pg_tm   *tm = pg_localtime(&minute, session_timezone);
+		int 			p;
+
+		CHECK_FOR_INTERRUPTS();
+
+		values[0] = TimestampTzGetDatum(time_t_to_timestamptz(minute));
+
+		if (counts)
+		{
+			int 	njobs = job_index_count(minute);
+
+			for (p = 0; p < forecast.nperiodic; p++)
+				if (compiled_schedule_matches(&forecast.periodic[p].schedule, minute, tm))
+					njobs++;
+
+			while (next_moment < forecast.nmoments && forecast.moments[next_moment].minute == minute)
+			{
+				njobs++;
+				next_moment++;
+			}
+			values[1] = Int32GetDatum(njobs);
+			tuplestore_putvalues(tupstore, tupdesc, values, nulls);
+		}
+		else
+		{
+			List 	   *matches = job_index_matches(minute, NIL);
+			ListCell   *lc;
+
+			foreach(lc, matches)
+			{
+				values[1] = Int32GetDatum((int32) *(uint32 *) lfirst(lc));
+				tuplestore_putvalues(tupstore, tupdesc, values, nulls);
+			}
+			list_free(matches);
+
+			for (p = 0; p < forecast.nperiodic; p++)
+			{
+				if (!compiled_schedule_matches(&forecast.periodic[p].schedule, minute, tm))
+					continue;
+				values[1] = Int32GetDatum((int32) forecast.periodic[p].job_id);
+				tuplestore_putvalues(tupstore, tupdesc, values, nulls);
+			}
+
+			while (next_moment < forecast.nmoments && forecast.moments[next_moment].minute == minute)
+			{
+				values[1] = Int32GetDatum((int32) forecast.moments[next_moment].job_id);
+				tuplestore_putvalues(tupstore, tupdesc, values, nulls);
+				next_moment++;
+			}
+		}
+	}
+
+	tuplestore_donestoring(tupstore);
+	MemoryContextDelete(forecast_context);
+
+	return (Datum) 0;
+}
+
+Datum
+schedule_forecast(PG_FUNCTION_ARGS)
+{
+	return forecast_internal(fcinfo, false);
+}
+
+Datum
+schedule_forecast_counts(PG_FUNCTION_ARGS)
+{
+	return forecast_internal(fcinfo, true);
+}
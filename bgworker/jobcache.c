@@ -0,0 +1,822 @@
+/* ------------------------------------------------------------------------
+ * jobcache.c
+ *  	Keeps the compiled definition of all enabled jobs in the launcher's
+ * 		memory, so that finding the jobs to run requires no queries.
+ * 		Crontab jobs are kept in a bit-sliced index which finds all jobs
+ * 		matching a minute at once, see jobindex.c. All other jobs, including
+ * 		the crontabs with a seconds field and the interval jobs, are kept in
+ * 		a binary min-heap ordered by their next fire time, to the second.
+ * 		Either way the launcher can sleep until the first job is due.
+ *
+ * 		A job may depend on other jobs, it then runs as soon as all of
+ * 		them have succeeded since it last ran because of them, see
+ * 		job_cache_upstream_succeeded.
+ *
+ * Copyright (c) 2014, Zalando SE.
+ * Portions Copyright (C) 2013-2014, PostgreSQL Global Development Group
+ * ------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+
+#include "catalog/pg_type.h"
+#include "executor/spi.h"
+#include "lib/stringinfo.h"
+#include "utils/array.h"
+#include "utils/hsearch.h"
+#include "utils/lsyscache.h"
+#include "utils/memutils.h"
+#include "utils/timestamp.h"
+
+/* Our own include files */
+#include "jobcache.h"
+#include "jobindex.h"
+#include "jobs.h"
+#include "shared.h"
+
+/* The number of recent runs from which the duration of a job is predicted, and how old they may be */
+#define JOB_PREDICTION_RUNS 	10
+#define JOB_PREDICTION_DAYS 	30
+
+/* How many minutes back crontab jobs are looked for when the launcher was busy */
+#define JOB_INDEX_CATCHUP_MINUTES 	60
+/* The maximum number of missed runs of a job which are run again, see job_cache_missed_runs */
+#define JOB_MISSED_RUNS_MAX 		1000
+
+static HTAB 		   *job_cache = NULL;
+static MemoryContext 	job_cache_context = NULL;
+static uint32 			job_cache_generation = 0;
+
+/* The timer queue: a binary min-heap on next_fire */
+static JobCacheEntry  **timer_heap = NULL;
+static int 				timer_heap_size = 0;
+static int 				timer_heap_capacity = 0;
+
+/* The last minute the crontab jobs were looked for in the index */
+static pg_time_t 		index_evaluated = 0;
+/* Crontab jobs (re)loaded after their current minute has been evaluated */
+static List 		   *late_jobs = NIL;
+/* The ids of the jobs whose next_run_at has to be written to the job table */
+static List 		   *next_run_changes = NIL;
+/* The jobs depending on other jobs */
+static List 		   *dependent_jobs = NIL;
+
+
+void
+job_cache_init(void)
+{
+	HASHCTL 	ctl;
+
+	job_cache_context = AllocSetContextCreate(TopMemoryContext,
+											  "elephant job cache",
+											  ALLOCSET_DEFAULT_MINSIZE,
+											  ALLOCSET_DEFAULT_INITSIZE,
+											  ALLOCSET_DEFAULT_MAXSIZE);
+
+	memset(&ctl, 0, sizeof(ctl));
+	ctl.keysize = sizeof(uint32);
+	ctl.entrysize = sizeof(JobCacheEntry);
+	ctl.hash = tag_hash;
+	ctl.hcxt = job_cache_context;
+	job_cache = hash_create("elephant job cache", 1024, &ctl,
+							HASH_ELEM | HASH_FUNCTION | HASH_CONTEXT);
+
+	timer_heap_capacity = 1024;
+	timer_heap = MemoryContextAlloc(job_cache_context, sizeof(JobCacheEntry *) * timer_heap_capacity);
+
+	job_index_init(job_cache_context);
+}
+
+static void
+timer_heap_place(int index, JobCacheEntry *entry)
+{
+	timer_heap[index] = entry;
+	entry->heap_index = index;
+}
+
+static void
+timer_heap_sift_up(int index)
+{
+	JobCacheEntry  *entry = timer_heap[index];
+
+	while (index > 0)
+	{
+		int 	parent = (index - 1) / 2;
+
+		if (timer_heap[parent]->next_fire <= entry->next_fire)
+			break;
+		timer_heap_place(index, timer_heap[parent]);
+		index = parent;
+	}
+	timer_heap_place(index, entry);
+}
+
+static void
+timer_heap_sift_down(int index)
+{
+	JobCacheEntry  *entry = timer_heap[index];
+
+	for (;;)
+	{
+		int 	child = 2 * index + 1;
+
+		if (child >= timer_heap_size)
+			break;
+		if (child + 1 < timer_heap_size &&
+			timer_heap[child + 1]->next_fire < timer_heap[child]->next_fire)
+			child++;
+		if (entry->next_fire <= timer_heap[child]->next_fire)
+			break;
+		timer_heap_place(index, timer_heap[child]);
+		index = child;
+	}
+	timer_heap_place(index, entry);
+}
+
+static void
+timer_heap_remove(JobCacheEntry *entry)
+{
+	int 			index = entry->heap_index;
+	JobCacheEntry  *last;
+
+	if (index < 0)
+		return;
+
+	entry->heap_index = -1;
+	last = timer_heap[--timer_heap_size];
+	if (last == entry)
+		return;
+
+	timer_heap_place(index, last);
+	timer_heap_sift_up(index);
+	timer_heap_sift_down(last->heap_index);
+}
+
+/* (Re)position a job in the timer queue after its next_fire has been set */
+static void
+timer_heap_update(JobCacheEntry *entry)
+{
+	if (entry->next_fire == SCHEDULE_NEVER)
+	{
+		timer_heap_remove(entry);
+		return;
+	}
+
+	if (entry->heap_index < 0)
+	{
+		if (timer_heap_size == timer_heap_capacity)
+		{
+			timer_heap_capacity *= 2;
+			timer_heap = repalloc(timer_heap, sizeof(JobCacheEntry *) * timer_heap_capacity);
+		}
+		timer_heap_place(timer_heap_size++, entry);
+	}
+	timer_heap_sift_up(entry->heap_index);
+	timer_heap_sift_down(entry->heap_index);
+}
+
+/* Whether the job is found through the crontab index rather than the timer queue */
+static bool
+job_cache_indexed(JobCacheEntry *entry)
+{
+	return entry->schedule.kind == SCHEDULE_CRONTAB && !schedule_has_seconds(&entry->schedule);
+}
+
+/* Remember to write the next run of the job to the job table */
+static void
+job_cache_next_run_changed(JobCacheEntry *entry)
+{
+	MemoryContext 	oldcxt;
+
+	if (entry->next_run_changed)
+		return;
+
+	entry->next_run_changed = true;
+	oldcxt = MemoryContextSwitchTo(job_cache_context);
+	next_run_changes = lappend_int(next_run_changes, (int) entry->job_id);
+	MemoryContextSwitchTo(oldcxt);
+}
+
+/*
+ * Compute when the job should run next. A job which matches the current minute
+ * and has not run in it yet, is due right away. A job with a schedule finer than
+ * a minute just runs at its next moment.
+ */
+static void
+job_cache_schedule(JobCacheEntry *entry, pg_time_t now)
+{
+	pg_time_t 	after = now - now % 60 - 1;
+
+	if (schedule_has_seconds(&entry->schedule))
+		after = now - 1;
+
+	/* Crontab jobs are found through the index, unless we are past their minute already */
+	if (job_cache_indexed(entry))
+	{
+		pg_time_t 	minute = now - now % 60;
+
+		timer_heap_remove(entry);
+		entry->next_fire = SCHEDULE_NEVER;
+		if (index_evaluated >= minute && entry->last_dispatched < minute &&
+			cron_schedule_matches(&entry->schedule.cron, pg_localtime(&minute, session_timezone)) &&
+			!list_member_ptr(late_jobs, entry))
+		{
+			MemoryContext 	oldcxt = MemoryContextSwitchTo(job_cache_context);
+
+			late_jobs = lappend(late_jobs, entry);
+			MemoryContextSwitchTo(oldcxt);
+		}
+		job_cache_next_run_changed(entry);
+		return;
+	}
+
+	entry->next_fire = schedule_next_fire(&entry->schedule, Max(after, entry->last_dispatched));
+	timer_heap_update(entry);
+	job_cache_next_run_changed(entry);
+}
+
+/* Set the jobs the job depends on, from an int4[] or NULL */
+static void
+job_cache_set_upstream(JobCacheEntry *entry, ArrayType *upstream)
+{
+	MemoryContext 	oldcxt;
+	Datum 		   *elems;
+	int 			nelems;
+	int 			i;
+
+	if (entry->nupstream > 0)
+	{
+		pfree(entry->upstream);
+		pfree(entry->upstream_done);
+		dependent_jobs = list_delete_ptr(dependent_jobs, entry);
+	}
+	entry->upstream = NULL;
+	entry->upstream_done = NULL;
+	entry->nupstream = 0;
+
+	if (upstream == NULL)
+		return;
+	deconstruct_array(upstream, INT4OID, sizeof(int32), true, 'i', &elems, NULL, &nelems);
+	if (nelems == 0)
+		return;
+
+	entry->upstream = MemoryContextAlloc(job_cache_context, sizeof(uint32) * nelems);
+	entry->upstream_done = MemoryContextAllocZero(job_cache_context, sizeof(bool) * nelems);
+	for (i = 0; i < nelems; i++)
+	{
+		entry->upstream[i] = (uint32) DatumGetInt32(elems[i]);
+		/* Only possible after the number of launchers has changed, see validate_job_dependency */
+		if (!launcher_owns_job(entry->upstream[i]))
+			elog(WARNING, "job %d depends on job %d, which is run by another launcher: it will not run for it",
+				 entry->job_id, entry->upstream[i]);
+	}
+	entry->nupstream = nelems;
+	pfree(elems);
+
+	oldcxt = MemoryContextSwitchTo(job_cache_context);
+	dependent_jobs = lappend(dependent_jobs, entry);
+	MemoryContextSwitchTo(oldcxt);
+}
+
+static void
+job_cache_remove(JobCacheEntry *entry)
+{
+	job_cache_set_upstream(entry, NULL);
+	timer_heap_remove(entry);
+	if (entry->index_slot >= 0)
+		job_index_remove(entry->index_slot);
+	late_jobs = list_delete_ptr(late_jobs, entry);
+	free_compiled_schedule(&entry->schedule);
+	pfree(entry->command);
+	hash_search(job_cache, &entry->job_id, HASH_REMOVE, NULL);
+}
+
+static MisfirePolicy
+job_cache_misfire_policy(const char *misfire)
+{
+	if (strcmp(misfire, "all") == 0)
+		return MISFIRE_ALL;
+	if (strcmp(misfire, "skip") == 0)
+		return MISFIRE_SKIP;
+	return MISFIRE_ONCE;
+}
+
+/*
+ * Read the predicted duration of the jobs in a maintenance window which have
+ * none yet from the job log: the average of their recent successful runs. A
+ * job keeps its prediction across reloads, the launcher adjusts it after every
+ * run, so the job log is read once per job in a single query. The lower bound
+ * on job_started is a parameter rather than now(), so that the partitions of
+ * older days are excluded from the plan.
+ */
+static void
+job_cache_seed_predictions(const char *schema)
+{
+	HASH_SEQ_STATUS status;
+	JobCacheEntry  *entry;
+	ArrayBuildState *job_ids = NULL;
+	StringInfoData 	buf;
+	Oid 			argtypes[2] = {INT4ARRAYOID, TIMESTAMPTZOID};
+	Datum 			values[2];
+	int 			n = 0;
+	int 			i;
+
+	hash_seq_init(&status, job_cache);
+	while ((entry = hash_seq_search(&status)) != NULL)
+	{
+		if (entry->window_id == 0 || entry->prediction_seeded)
+			continue;
+		job_ids = accumArrayResult(job_ids, Int32GetDatum((int32) entry->job_id), false, INT4OID, CurrentMemoryContext);
+		entry->prediction_seeded = true;
+		n++;
+	}
+	if (n == 0)
+		return;
+
+	values[0] = makeArrayResult(job_ids, CurrentMemoryContext);
+	values[1] = TimestampTzGetDatum(TimestampTzPlusMilliseconds(GetCurrentTimestamp(),
+																 -(int64) JOB_PREDICTION_DAYS * SECS_PER_DAY * 1000));
+
+	initStringInfo(&buf);
+	appendStringInfo(&buf, "SELECT job_id, extract(epoch from avg(job_finished - job_started))::integer "
+							 "FROM (SELECT job_id, job_started, job_finished,"
+										  "row_number() OVER (PARTITION BY job_id ORDER BY job_started DESC) AS recent "
+									 "FROM %s.%s "
+									"WHERE job_id = ANY($1) "
+									  "AND job_sqlstate = '00000' "
+									  "AND job_started >= $2) l "
+							"WHERE recent <= %d "
+							"GROUP BY job_id",
+							schema, JOB_LOG_RELNAME, JOB_PREDICTION_RUNS);
+
+	if (SPI_execute_with_args(buf.data, 2, argtypes, values, NULL, true, 0) != SPI_OK_SELECT)
+		elog(ERROR, "cannot read the duration of the recent runs of %d jobs", n);
+
+	for (i = 0; i < SPI_processed; i++)
+	{
+		HeapTuple 	tuple = SPI_tuptable->vals[i];
+		TupleDesc 	tupdesc = SPI_tuptable->tupdesc;
+		uint32 		job_id;
+		bool 		isnull;
+		Datum 		duration;
+
+		job_id = DatumGetInt32(SPI_getbinval(tuple, tupdesc, 1, &isnull));
+		duration = SPI_getbinval(tuple, tupdesc, 2, &isnull);
+		entry = hash_search(job_cache, &job_id, HASH_FIND, NULL);
+		if (entry != NULL && !isnull)
+			entry->predicted_duration = (uint32) Max(DatumGetInt32(duration), 0);
+	}
+	pfree(buf.data);
+
+	elog(DEBUG1, "read the predicted duration of %d jobs in a maintenance window", n);
+}
+
+/*
+ * (Re)load the given jobs from the job table, or all of them if job_ids is NULL.
+ * Jobs which have been deleted or disabled are removed from the cache.
+ * Must be called inside a transaction with SPI connected.
+ */
+void
+job_cache_load(const char *schema, const char *table, uint32 *job_ids, int njobs)
+{
+	StringInfoData 	buf;
+	JobCacheEntry  *entry;
+	pg_time_t 		now = (pg_time_t) time(NULL);
+	int 			ret;
+	int 			i;
+
+	job_cache_generation++;
+
+	initStringInfo(&buf);
+	appendStringInfo(&buf, "SELECT job_id,"
+								   "schedule,"
+								   "parallel,"
+								   "extract(epoch from job_timeout)::integer as job_timeout,"
+								   "datname,"
+								   "rolname,"
+								   "job_command,"
+								   "priority,"
+								   "misfire,"
+								   "array(SELECT depends_on FROM %s.%s d WHERE d.job_id = job.job_id) as upstream,"
+								   "coalesce(batch_size, 0) as batch_size,"
+								   "(extract(epoch from batch_delay) * 1000)::integer as batch_delay,"
+								   "coalesce(cost_limit, 0) as cost_limit,"
+								   "coalesce((extract(epoch from cost_delay) * 1000)::integer, -1) as cost_delay,"
+								   "deferrable,"
+								   "job.datoid,"
+								   "job.roloid,"
+								   "pd.datconnlimit,"
+								   "CASE WHEN pr.rolsuper THEN -1 ELSE pr.rolconnlimit END as rolconnlimit,"
+								   "coalesce(job.window_id, 0) as window_id "
+							  "FROM %s.%s job "
+							  "JOIN pg_catalog.pg_roles    pr ON (job.roloid = pr.oid) "
+							  "JOIN pg_catalog.pg_database pd ON (job.datoid = pd.oid) "
+							 "WHERE job.enabled%s",
+							 schema, JOB_DEPENDENCY_RELNAME, schema, table,
+							 launcher_partition_filter("job.job_id"));
+
+	if (job_ids == NULL)
+		ret = SPI_execute(buf.data, true, 0);
+	else
+	{
+		Datum 	   *elems = palloc(sizeof(Datum) * njobs);
+		Oid 		argtypes[1] = {INT4ARRAYOID};
+		Datum 		values[1];
+
+		for (i = 0; i < njobs; i++)
+			elems[i] = Int32GetDatum((int32) job_ids[i]);
+		values[0] = PointerGetDatum(construct_array(elems, njobs, INT4OID, sizeof(int32), true, 'i'));
+
+		appendStringInfoString(&buf, " AND job.job_id = ANY($1)");
+		ret = SPI_execute_with_args(buf.data, 1, argtypes, values, NULL, true, 0);
+	}
+	if (ret != SPI_OK_SELECT)
+		elog(FATAL, "cannot load the job definitions");
+
+	for (i = 0; i < SPI_processed; i++)
+	{
+		HeapTuple 	tuple = SPI_tuptable->vals[i];
+		TupleDesc 	tupdesc = SPI_tuptable->tupdesc;
+		uint32 		job_id;
+		Datum 		schedule;
+		bool 		isnull;
+		bool 		found;
+
+		job_id = DatumGetInt32(SPI_getbinval(tuple, tupdesc, 1, &isnull));
+		Assert(!isnull);
+
+		entry = hash_search(job_cache, &job_id, HASH_ENTER, &found);
+		if (found)
+		{
+			free_compiled_schedule(&entry->schedule);
+			pfree(entry->command);
+		}
+		else
+		{
+			entry->last_dispatched = 0;
+			entry->heap_index = -1;
+			entry->index_slot = -1;
+			entry->next_run_changed = false;
+			entry->nupstream = 0;
+			entry->predicted_duration = 0;
+			entry->prediction_seeded = false;
+		}
+
+		entry->generation = job_cache_generation;
+		/* The schedule column holds the compiled form already, nothing to parse */
+		schedule = SPI_getbinval(tuple, tupdesc, 2, &isnull);
+		compile_schedule(isnull ? NULL : DatumGetScheduleP(schedule), &entry->schedule, job_cache_context);
+		if (entry->index_slot >= 0)
+			job_index_remove(entry->index_slot);
+		entry->index_slot = -1;
+		if (job_cache_indexed(entry))
+			entry->index_slot = job_index_add(&entry->schedule.cron, entry);
+		entry->parallel = DatumGetBool(SPI_getbinval(tuple, tupdesc, 3, &isnull));
+		entry->job_timeout = DatumGetInt32(SPI_getbinval(tuple, tupdesc, 4, &isnull));
+		snprintf(entry->datname, NAMEDATALEN, "%s", SPI_getvalue(tuple, tupdesc, 5));
+		snprintf(entry->rolname, NAMEDATALEN, "%s", SPI_getvalue(tuple, tupdesc, 6));
+		entry->command = MemoryContextStrdup(job_cache_context, SPI_getvalue(tuple, tupdesc, 7));
+		entry->priority = DatumGetInt16(SPI_getbinval(tuple, tupdesc, 8, &isnull));
+		entry->misfire = job_cache_misfire_policy(SPI_getvalue(tuple, tupdesc, 9));
+		/* Whatever had succeeded before the job changed does not count anymore */
+		job_cache_set_upstream(entry, DatumGetArrayTypeP(SPI_getbinval(tuple, tupdesc, 10, &isnull)));
+		entry->batch_size = DatumGetInt32(SPI_getbinval(tuple, tupdesc, 11, &isnull));
+		entry->batch_delay = DatumGetInt32(SPI_getbinval(tuple, tupdesc, 12, &isnull));
+		entry->cost_limit = DatumGetInt32(SPI_getbinval(tuple, tupdesc, 13, &isnull));
+		entry->cost_delay = DatumGetInt32(SPI_getbinval(tuple, tupdesc, 14, &isnull));
+		entry->deferrable = DatumGetBool(SPI_getbinval(tuple, tupdesc, 15, &isnull));
+		entry->datoid = DatumGetObjectId(SPI_getbinval(tuple, tupdesc, 16, &isnull));
+		entry->roloid = DatumGetObjectId(SPI_getbinval(tuple, tupdesc, 17, &isnull));
+		entry->datconnlimit = DatumGetInt32(SPI_getbinval(tuple, tupdesc, 18, &isnull));
+		entry->rolconnlimit = DatumGetInt32(SPI_getbinval(tuple, tupdesc, 19, &isnull));
+		entry->window_id = DatumGetInt32(SPI_getbinval(tuple, tupdesc, 20, &isnull));
+
+		job_cache_schedule(entry, now);
+	}
+
+	/* Forget about the jobs which were not returned */
+	if (job_ids == NULL)
+	{
+		HASH_SEQ_STATUS status;
+
+		hash_seq_init(&status, job_cache);
+		while ((entry = hash_seq_search(&status)) != NULL)
+			if (entry->generation != job_cache_generation)
+				job_cache_remove(entry);
+	}
+	else
+	{
+		for (i = 0; i < njobs; i++)
+		{
+			entry = hash_search(job_cache, &job_ids[i], HASH_FIND, NULL);
+			if (entry != NULL && entry->generation != job_cache_generation)
+				job_cache_remove(entry);
+		}
+	}
+	elog(DEBUG1, "job cache holds %ld jobs", hash_get_num_entries(job_cache));
+
+	job_cache_seed_predictions(schema);
+}
+
+/* Recompute the next fire time of all jobs, needed when the time zone changed */
+void
+job_cache_reschedule(void)
+{
+	HASH_SEQ_STATUS status;
+	JobCacheEntry  *entry;
+	pg_time_t 		now = (pg_time_t) time(NULL);
+
+	hash_seq_init(&status, job_cache);
+	while ((entry = hash_seq_search(&status)) != NULL)
+		job_cache_schedule(entry, now);
+}
+
+/* The moment the first job is due, or SCHEDULE_NEVER if no job is scheduled */
+pg_time_t
+job_cache_next_fire(void)
+{
+	pg_time_t 		now = (pg_time_t) time(NULL);
+	pg_time_t 		result = SCHEDULE_NEVER;
+	pg_time_t 		index_next;
+
+	if (late_jobs != NIL)
+		return now;
+
+	if (timer_heap_size > 0)
+		result = timer_heap[0]->next_fire;
+
+	/* The index only gives a lower bound, we may wake up for nothing */
+	index_next = job_index_next_fire(Max(index_evaluated, now - now % 60 - 1));
+	if (index_next != SCHEDULE_NEVER && (result == SCHEDULE_NEVER || index_next < result))
+		result = index_next;
+
+	return result;
+}
+
+/*
+ * Take the jobs which are due from the head of the timer queue and requeue them
+ * at their next fire time. The next fire time is computed from the moment the
+ * job was due, so no drift accumulates. A job which was due a while ago, because
+ * the launcher was busy, runs once and is not repeated for every missed moment.
+ *
+ * Crontab jobs are looked up in the index for every minute since the previous
+ * call, up to JOB_INDEX_CATCHUP_MINUTES back, with the same run once rule.
+ */
+List *
+job_cache_due_jobs(pg_time_t now)
+{
+	pg_time_t 		minute = now - now % 60;
+	pg_time_t 		first;
+	pg_time_t 		m;
+	List 		   *matches = NIL;
+	List 		   *result = NIL;
+	ListCell 	   *lc;
+
+	while (timer_heap_size > 0 && timer_heap[0]->next_fire <= now)
+	{
+		JobCacheEntry  *entry = timer_heap[0];
+
+		entry->last_dispatched = entry->next_fire;
+		entry->next_fire = schedule_next_fire(&entry->schedule, Max(entry->last_dispatched, now));
+		timer_heap_update(entry);
+		job_cache_next_run_changed(entry);
+
+		result = lappend(result, entry);
+	}
+
+	foreach(lc, late_jobs)
+	{
+		JobCacheEntry  *entry = lfirst(lc);
+
+		if (entry->last_dispatched >= minute)
+			continue;
+		entry->last_dispatched = minute;
+		job_cache_next_run_changed(entry);
+		result = lappend(result, entry);
+	}
+	list_free(late_jobs);
+	late_jobs = NIL;
+
+	if (index_evaluated >= minute)
+		return result;
+
+	if (index_evaluated == 0)
+		first = minute;
+	else
+		first = Max(index_evaluated + 60, minute - (JOB_INDEX_CATCHUP_MINUTES - 1) * 60);
+
+	for (m = first; m <= minute; m += 60)
+		matches = job_index_matches(m, matches);
+	index_evaluated = minute;
+
+	foreach(lc, matches)
+	{
+		JobCacheEntry  *entry = lfirst(lc);
+
+		/* Either dispatched already by an earlier minute of this round, or as a late job */
+		if (entry->last_dispatched >= first)
+			continue;
+		entry->last_dispatched = minute;
+		job_cache_next_run_changed(entry);
+		result = lappend(result, entry);
+	}
+	list_free(matches);
+
+	return result;
+}
+
+/*
+ * A job has succeeded. Returns the jobs depending on it of which all upstream
+ * jobs have now succeeded since they last ran because of them, those start
+ * waiting for all of their upstream jobs again.
+ */
+List *
+job_cache_upstream_succeeded(uint32 job_id)
+{
+	List 	   *result = NIL;
+	ListCell   *lc;
+
+	foreach(lc, dependent_jobs)
+	{
+		JobCacheEntry  *entry = lfirst(lc);
+		bool 			depends = false;
+		bool 			ready = true;
+		int 			i;
+
+		for (i = 0; i < entry->nupstream; i++)
+		{
+			if (entry->upstream[i] == job_id)
+			{
+				entry->upstream_done[i] = true;
+				depends = true;
+			}
+			ready = ready && entry->upstream_done[i];
+		}
+		if (!depends || !ready)
+			continue;
+
+		memset(entry->upstream_done, 0, sizeof(bool) * entry->nupstream);
+		result = lappend(result, entry);
+	}
+	return result;
+}
+
+/* The cached definition of an enabled job, NULL if the job is unknown or disabled */
+JobCacheEntry *
+job_cache_lookup(uint32 job_id)
+{
+	return hash_search(job_cache, &job_id, HASH_FIND, NULL);
+}
+
+/*
+ * The runs missed while the launcher was not running, following the misfire
+ * policy of every job. The runs planned by the previous launcher are the ones
+ * at or after next_run_at, so a run is missed if it was due before the current
+ * minute, at or after next_run_at and after the last start of the job. They are
+ * found by stepping through the compiled schedule from there, not by evaluating
+ * every minute since.
+ * Must be called inside a transaction with SPI connected, after the jobs have
+ * been loaded and before their next runs are written to the job table.
+ */
+List *
+job_cache_missed_runs(const char *schema, const char *table, pg_time_t now)
+{
+	StringInfoData 	buf;
+	pg_time_t 		minute = now - now % 60;
+	Oid 			argtypes[1] = {TIMESTAMPTZOID};
+	Datum 			values[1];
+	List 		   *result = NIL;
+	int 			ret;
+	int 			i;
+
+	initStringInfo(&buf);
+	appendStringInfo(&buf, "SELECT job_id,"
+								   "extract(epoch from greatest(last_executed, next_run_at - interval '1 second'))::bigint "
+							  "FROM %s.%s "
+							 "WHERE enabled "
+							   "AND misfire <> 'skip' "
+							   "AND next_run_at < $1%s",
+							 schema, table, launcher_partition_filter("job_id"));
+	values[0] = TimestampTzGetDatum(time_t_to_timestamptz(minute));
+
+	ret = SPI_execute_with_args(buf.data, 1, argtypes, values, NULL, true, 0);
+	if (ret != SPI_OK_SELECT)
+		elog(ERROR, "could not look for missed job runs");
+
+	for (i = 0; i < SPI_processed; i++)
+	{
+		HeapTuple 		tuple = SPI_tuptable->vals[i];
+		TupleDesc 		tupdesc = SPI_tuptable->tupdesc;
+		JobCacheEntry  *entry;
+		uint32 			job_id;
+		pg_time_t 		fire;
+		bool 			isnull;
+		int 			nmissed = 0;
+
+		job_id = DatumGetInt32(SPI_getbinval(tuple, tupdesc, 1, &isnull));
+		entry = hash_search(job_cache, &job_id, HASH_FIND, NULL);
+		if (entry == NULL)
+			continue;
+
+		fire = schedule_next_fire(&entry->schedule, (pg_time_t) DatumGetInt64(SPI_getbinval(tuple, tupdesc, 2, &isnull)));
+		while (fire != SCHEDULE_NEVER && fire < minute)
+		{
+			JobRun 	   *run;
+
+			if (nmissed == JOB_MISSED_RUNS_MAX)
+			{
+				elog(WARNING, "job %d missed more than %d runs, only the first %d are run",
+					 job_id, JOB_MISSED_RUNS_MAX, JOB_MISSED_RUNS_MAX);
+				break;
+			}
+
+			run = palloc0(sizeof(JobRun));
+			run->job_id = job_id;
+			run->due_at = fire;
+			result = lappend(result, run);
+			nmissed++;
+
+			/* A single run makes up for all of them */
+			if (entry->misfire == MISFIRE_ONCE)
+				break;
+			fire = schedule_next_fire(&entry->schedule, fire);
+		}
+	}
+	pfree(buf.data);
+
+	return result;
+}
+
+bool
+job_cache_next_runs_changed(void)
+{
+	return next_run_changes != NIL;
+}
+
+/*
+ * Write the next run of the jobs which were dispatched or (re)loaded since the
+ * previous call to the next_run_at column of the job table, in a single statement.
+ * Crontab jobs are not kept in the timer queue, their next run is computed here.
+ * Must be called inside a transaction with SPI connected.
+ */
+void
+job_cache_write_next_runs(const char *schema, const char *table)
+{
+	ArrayBuildState *job_ids = NULL;
+	ArrayBuildState *next_runs = NULL;
+	Oid 			argtypes[2];
+	Datum 			values[2];
+	StringInfoData 	buf;
+	ListCell 	   *lc;
+	pg_time_t 		now = (pg_time_t) time(NULL);
+	int 			n = 0;
+	int 			ret;
+
+	foreach(lc, next_run_changes)
+	{
+		uint32 			job_id = (uint32) lfirst_int(lc);
+		JobCacheEntry  *entry = hash_search(job_cache, &job_id, HASH_FIND, NULL);
+		pg_time_t 		next_run;
+
+		/* Removed from the cache in the meantime */
+		if (entry == NULL)
+			continue;
+		entry->next_run_changed = false;
+
+		if (job_cache_indexed(entry))
+			next_run = schedule_next_fire(&entry->schedule, Max(now - now % 60 - 1, entry->last_dispatched));
+		else
+			next_run = entry->next_fire;
+
+		job_ids = accumArrayResult(job_ids, Int32GetDatum((int32) job_id), false, INT4OID, CurrentMemoryContext);
+		next_runs = accumArrayResult(next_runs,
+									 next_run == SCHEDULE_NEVER ? (Datum) 0 : TimestampTzGetDatum(time_t_to_timestamptz(next_run)),
+									 next_run == SCHEDULE_NEVER, TIMESTAMPTZOID, CurrentMemoryContext);
+		n++;
+	}
+	list_free(next_run_changes);
+	next_run_changes = NIL;
+
+	if (n == 0)
+		return;
+
+	argtypes[0] = INT4ARRAYOID;
+	argtypes[1] = get_array_type(TIMESTAMPTZOID);
+	values[0] = makeArrayResult(job_ids, CurrentMemoryContext);
+	values[1] = makeArrayResult(next_runs, CurrentMemoryContext);
+
+	initStringInfo(&buf);
+	appendStringInfo(&buf, "UPDATE %s.%s job "
+							  "SET next_run_at = n.next_run_at "
+							 "FROM unnest($1, $2) AS n(job_id, next_run_at) "
+							"WHERE job.job_id = n.job_id "
+							  "AND job.next_run_at IS DISTINCT FROM n.next_run_at",
+							schema, table);
+
+	ret = SPI_execute_with_args(buf.data, 2, argtypes, values, NULL, false, 0);
+	if (ret != SPI_OK_UPDATE)
+		elog(ERROR, "could not write the next run of %d jobs", n);
+
+	elog(DEBUG1, "wrote the next run of %d jobs", n);
+	pfree(buf.data);
+}
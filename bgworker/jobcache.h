@@ -0,0 +1,76 @@
+/* ------------------------------------------------------------------------
+ * jobcache.h
+ *  	The launcher's in-memory copy of the enabled jobs, ordered by
+ * 		the moment they should run next or indexed by their crontab.
+ *
+ * Copyright (c) 2014, Zalando SE.
+ * Portions Copyright (C) 2013-2014, PostgreSQL Global Development Group
+ * ------------------------------------------------------------------------
+ */
+
+#ifndef _JOBCACHE_H
+#define _JOBCACHE_H
+
+#include "postgres.h"
+
+#include "nodes/pg_list.h"
+
+#include "schedule.h"
+
+#define JOB_DEPENDENCY_RELNAME 	"job_dependency"
+#define JOB_LOG_RELNAME 		"job_log"
+
+/* What to do with the runs missed while the launcher was not running */
+typedef enum MisfirePolicy
+{
+	MISFIRE_ONCE, 			/* run once for all of them */
+	MISFIRE_ALL, 			/* run every missed run */
+	MISFIRE_SKIP 			/* do not run at all */
+} MisfirePolicy;
+
+typedef struct JobCacheEntry
+{
+	uint32 		job_id; 		/* hash key, must be first */
+	uint32 		generation;
+	bool 		parallel;
+	int 		priority;
+	MisfirePolicy misfire;
+	uint32 		job_timeout;
+	int32 		batch_size; 	/* 0 if the job does not run in batches */
+	uint32 		batch_delay; 	/* in milliseconds */
+	int32 		cost_limit; 	/* 0 if the global job_cost_limit applies */
+	int32 		cost_delay; 	/* in milliseconds, -1 if the global job_cost_delay applies */
+	bool 		deferrable; 	/* may be held while the cluster is busy */
+	Oid 		datoid;
+	Oid 		roloid;
+	int 		datconnlimit; 	/* the connection limits when the job was loaded, -1 if none */
+	int 		rolconnlimit;
+	uint32 		window_id; 		/* the maintenance window the job runs in, 0 if none */
+	uint32 		predicted_duration; /* in seconds, 0 if unknown */
+	bool 		prediction_seeded; /* predicted_duration has been read from the job log */
+	char 		datname[NAMEDATALEN];
+	char 		rolname[NAMEDATALEN];
+	char 	   *command;
+	CompiledSchedule schedule;
+	pg_time_t 	last_dispatched;
+	pg_time_t 	next_fire;
+	int 		heap_index; 	/* position in the timer queue, -1 if not queued */
+	int 		index_slot; 	/* slot in the crontab index, -1 if not indexed */
+	bool 		next_run_changed; /* next_run_at in the job table is out of date */
+	uint32 	   *upstream; 		/* the jobs which must succeed before this one runs */
+	bool 	   *upstream_done; 	/* which of them have succeeded since it last ran */
+	int 		nupstream;
+} JobCacheEntry;
+
+void job_cache_init(void);
+void job_cache_load(const char *schema, const char *table, uint32 *job_ids, int njobs);
+void job_cache_reschedule(void);
+pg_time_t job_cache_next_fire(void);
+List *job_cache_due_jobs(pg_time_t now);
+JobCacheEntry *job_cache_lookup(uint32 job_id);
+List *job_cache_upstream_succeeded(uint32 job_id);
+List *job_cache_missed_runs(const char *schema, const char *table, pg_time_t now);
+bool job_cache_next_runs_changed(void);
+void job_cache_write_next_runs(const char *schema, const char *table);
+
+#endif /* _JOBCACHE_H */
@@ -0,0 +1,298 @@
+/* ------------------------------------------------------------------------
+ * jobindex.c
+ *  	A bit-sliced index over the crontab schedules of the cached jobs.
+ * 		Every crontab job gets a slot, and for every possible value of the
+ * 		minute, hour, day of month, month and day of week fields we keep a
+ * 		bitmap over the slots. The jobs matching a given minute are then
+ * 		found by combining five bitmaps a word at a time:
+ *
+ * 			minute & hour & month & (dom | dow)
+ *
+ * 		which follows the dom or dow rule of cron_schedule_matches. The cost
+ * 		of evaluating a minute is proportional to the number of slots / 64,
+ * 		no matter how many jobs are due. Crontabs with a seconds field are
+ * 		not indexed. Used by the launcher's job cache and by the schedule
+ * 		forecast.
+ *
+ * Copyright (c) 2014, Zalando SE.
+ * Portions Copyright (C) 2013-2014, PostgreSQL Global Development Group
+ * ------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+
+#include "utils/memutils.h"
+#include "utils/timestamp.h"
+
+/* Our own include files */
+#include "jobindex.h"
+
+/* The bitmaps of all field values are stored one after the other */
+#define SLICE_MINUTE 	0
+#define SLICE_HOUR 		(SLICE_MINUTE + CRON_MINUTE_MAX + 1)
+#define SLICE_DOM 		(SLICE_HOUR + CRON_HOUR_MAX + 1)
+#define SLICE_MONTH 	(SLICE_DOM + CRON_DOM_MAX + 1)
+#define SLICE_DOW 		(SLICE_MONTH + CRON_MONTH_MAX + 1)
+/* Day of week 7 is folded into 0 by the crontab parser */
+#define NSLICES 		(SLICE_DOW + CRON_DOW_MAX)
+
+#define INITIAL_WORDS 	16
+
+static MemoryContext 	index_context = NULL;
+
+/* slices[s] is a bitmap of nwords words, bit n is set if slot n has value s */
+static uint64 		   *slices[NSLICES];
+static int 				nwords = 0;
+
+/* Number of slots having each value, a value is in the union if it is used at all */
+static int 				slice_refs[NSLICES];
+
+/* The job and schedule in every slot, and the stack of free slots */
+static void 		  **slot_entries = NULL;
+static CronSchedule    *slot_schedules = NULL;
+static int 			   *free_slots = NULL;
+static int 				nfree = 0;
+static int 				nslots = 0;
+
+
+/* Position of the lowest bit set in a non-zero word */
+static inline int
+lowest_bit(uint64 word)
+{
+#ifdef __GNUC__
+	return __builtin_ctzll(word);
+#else
+	int 	pos = 0;
+
+	while ((word & 1) == 0)
+	{
+		word >>= 1;
+		pos++;
+	}
+	return pos;
+#endif
+}
+
+/* Number of bits set in a word */
+static inline int
+count_bits(uint64 word)
+{
+#ifdef __GNUC__
+	return __builtin_popcountll(word);
+#else
+	int 	n = 0;
+
+	while (word != 0)
+	{
+		word &= word - 1;
+		n++;
+	}
+	return n;
+#endif
+}
+
+/* Make room for 64 slots more per word added */
+static void
+job_index_grow(int newwords)
+{
+	int 	s;
+	int 	i;
+
+	for (s = 0; s < NSLICES; s++)
+	{
+		if (slices[s] == NULL)
+			slices[s] = MemoryContextAllocZero(index_context, sizeof(uint64) * newwords);
+		else
+		{
+			slices[s] = repalloc(slices[s], sizeof(uint64) * newwords);
+			memset(slices[s] + nwords, 0, sizeof(uint64) * (newwords - nwords));
+		}
+	}
+
+	if (slot_entries == NULL)
+	{
+		slot_entries = MemoryContextAlloc(index_context, sizeof(void *) * newwords * 64);
+		slot_schedules = MemoryContextAlloc(index_context, sizeof(CronSchedule) * newwords * 64);
+		free_slots = MemoryContextAlloc(index_context, sizeof(int) * newwords * 64);
+	}
+	else
+	{
+		slot_entries = repalloc(slot_entries, sizeof(void *) * newwords * 64);
+		slot_schedules = repalloc(slot_schedules, sizeof(CronSchedule) * newwords * 64);
+		free_slots = repalloc(free_slots, sizeof(int) * newwords * 64);
+	}
+
+	/* The new slots are free, hand out the lowest ones first */
+	for (i = newwords * 64 - 1; i >= nwords * 64; i--)
+		free_slots[nfree++] = i;
+
+	nwords = newwords;
+}
+
+void
+job_index_init(MemoryContext cxt)
+{
+	index_context = cxt;
+	memset(slices, 0, sizeof(slices));
+	memset(slice_refs, 0, sizeof(slice_refs));
+	nwords = 0;
+	nfree = 0;
+	nslots = 0;
+	slot_entries = NULL;
+	job_index_grow(INITIAL_WORDS);
+}
+
+/* Set or clear the bit of a slot in the bitmaps of all values in the given mask */
+static void
+job_index_mark(int slot, int first_slice, int minvalue, int maxvalue, uint64 mask, bool set)
+{
+	uint64 	bit = UINT64CONST(1) << (slot % 64);
+	int 	word = slot / 64;
+	int 	value;
+
+	for (value = minvalue; value <= maxvalue; value++)
+	{
+		if ((mask & (UINT64CONST(1) << value)) == 0)
+			continue;
+		if (set)
+		{
+			slices[first_slice + value][word] |= bit;
+			slice_refs[first_slice + value]++;
+		}
+		else
+		{
+			slices[first_slice + value][word] &= ~bit;
+			slice_refs[first_slice + value]--;
+		}
+	}
+}
+
+static void
+job_index_mark_schedule(int slot, const CronSchedule *cron, bool set)
+{
+	job_index_mark(slot, SLICE_MINUTE, CRON_MINUTE_MIN, CRON_MINUTE_MAX, cron->minute, set);
+	job_index_mark(slot, SLICE_HOUR, CRON_HOUR_MIN, CRON_HOUR_MAX, cron->hour, set);
+	job_index_mark(slot, SLICE_DOM, CRON_DOM_MIN, CRON_DOM_MAX, cron->dom, set);
+	job_index_mark(slot, SLICE_MONTH, CRON_MONTH_MIN, CRON_MONTH_MAX, cron->month, set);
+	job_index_mark(slot, SLICE_DOW, CRON_DOW_MIN, CRON_DOW_MAX - 1, cron->dow, set);
+}
+
+/* Add a crontab schedule to the index, returns the slot of the given job */
+int
+job_index_add(const CronSchedule *cron, void *entry)
+{
+	int 	slot;
+
+	if (nfree == 0)
+		job_index_grow(nwords * 2);
+
+	slot = free_slots[--nfree];
+	slot_entries[slot] = entry;
+	slot_schedules[slot] = *cron;
+	job_index_mark_schedule(slot, cron, true);
+	nslots++;
+
+	return slot;
+}
+
+void
+job_index_remove(int slot)
+{
+	job_index_mark_schedule(slot, &slot_schedules[slot], false);
+	slot_entries[slot] = NULL;
+	free_slots[nfree++] = slot;
+	nslots--;
+}
+
+/*
+ * Append the jobs whose schedule matches the given minute, in the local time
+ * zone, to the list.
+ */
+List *
+job_index_matches(pg_time_t minute, List *result)
+{
+	struct pg_tm   *tm = pg_localtime(&minute, session_timezone);
+	const uint64   *min_bits = slices[SLICE_MINUTE + tm->tm_min];
+	const uint64   *hour_bits = slices[SLICE_HOUR + tm->tm_hour];
+	const uint64   *dom_bits = slices[SLICE_DOM + tm->tm_mday];
+	const uint64   *month_bits = slices[SLICE_MONTH + tm->tm_mon + 1];
+	const uint64   *dow_bits = slices[SLICE_DOW + tm->tm_wday];
+	int 			w;
+
+	if (nslots == 0 ||
+		slice_refs[SLICE_MINUTE + tm->tm_min] == 0 ||
+		slice_refs[SLICE_HOUR + tm->tm_hour] == 0 ||
+		slice_refs[SLICE_MONTH + tm->tm_mon + 1] == 0)
+		return result;
+
+	for (w = 0; w < nwords; w++)
+	{
+		uint64 	word = min_bits[w] & hour_bits[w] & month_bits[w] & (dom_bits[w] | dow_bits[w]);
+
+		while (word != 0)
+		{
+			result = lappend(result, slot_entries[w * 64 + lowest_bit(word)]);
+			word &= word - 1;
+		}
+	}
+	return result;
+}
+
+/* The number of jobs whose schedule matches the given minute, in the local time zone */
+int
+job_index_count(pg_time_t minute)
+{
+	struct pg_tm   *tm = pg_localtime(&minute, session_timezone);
+	const uint64   *min_bits = slices[SLICE_MINUTE + tm->tm_min];
+	const uint64   *hour_bits = slices[SLICE_HOUR + tm->tm_hour];
+	const uint64   *dom_bits = slices[SLICE_DOM + tm->tm_mday];
+	const uint64   *month_bits = slices[SLICE_MONTH + tm->tm_mon + 1];
+	const uint64   *dow_bits = slices[SLICE_DOW + tm->tm_wday];
+	int 			result = 0;
+	int 			w;
+
+	if (nslots == 0 ||
+		slice_refs[SLICE_MINUTE + tm->tm_min] == 0 ||
+		slice_refs[SLICE_HOUR + tm->tm_hour] == 0 ||
+		slice_refs[SLICE_MONTH + tm->tm_mon + 1] == 0)
+		return 0;
+
+	for (w = 0; w < nwords; w++)
+		result += count_bits(min_bits[w] & hour_bits[w] & month_bits[w] & (dom_bits[w] | dow_bits[w]));
+	return result;
+}
+
+/*
+ * A lower bound for the first minute after the given moment at which any of
+ * the indexed jobs fires: the first minute matching the union of all schedules.
+ * Returns SCHEDULE_NEVER if the index is empty.
+ */
+pg_time_t
+job_index_next_fire(pg_time_t after)
+{
+	CompiledSchedule 	any;
+	int 				s;
+
+	if (nslots == 0)
+		return SCHEDULE_NEVER;
+
+	memset(&any, 0, sizeof(any));
+	any.kind = SCHEDULE_CRONTAB;
+	any.cron.second = UINT64CONST(1);
+	for (s = 0; s < NSLICES; s++)
+	{
+		if (slice_refs[s] == 0)
+			continue;
+		if (s >= SLICE_DOW)
+			any.cron.dow |= 1U << (s - SLICE_DOW);
+		else if (s >= SLICE_MONTH)
+			any.cron.month |= 1U << (s - SLICE_MONTH);
+		else if (s >= SLICE_DOM)
+			any.cron.dom |= 1U << (s - SLICE_DOM);
+		else if (s >= SLICE_HOUR)
+			any.cron.hour |= 1U << (s - SLICE_HOUR);
+		else
+			any.cron.minute |= UINT64CONST(1) << (s - SLICE_MINUTE);
+	}
+	return schedule_next_fire(&any, after);
+}
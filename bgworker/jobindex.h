@@ -0,0 +1,26 @@
+/* ------------------------------------------------------------------------
+ * jobindex.h
+ *  	Bit-sliced index over the crontab schedules of the cached jobs.
+ *
+ * Copyright (c) 2014, Zalando SE.
+ * Portions Copyright (C) 2013-2014, PostgreSQL Global Development Group
+ * ------------------------------------------------------------------------
+ */
+
+#ifndef _JOBINDEX_H
+#define _JOBINDEX_H
+
+#include "postgres.h"
+
+#include "nodes/pg_list.h"
+
+#include "schedule.h"
+
+void job_index_init(MemoryContext cxt);
+int job_index_add(const CronSchedule *cron, void *entry);
+void job_index_remove(int slot);
+List *job_index_matches(pg_time_t minute, List *result);
+int job_index_count(pg_time_t minute);
+pg_time_t job_index_next_fire(pg_time_t after);
+
+#endif /* _JOBINDEX_H */
@@ -0,0 +1,316 @@
+/* ------------------------------------------------------------------------
+ * joblog.c
+ *  	Collects the outcomes reported by the workers in the launcher's
+ * 		memory and writes them to the job log in batches. A whole batch takes
+ * 		a statement per day, instead of several statements per job run. The
+ * 		job log is partitioned by day, the outcomes go into the partitions
+ * 		directly. The runs are accounted for in the shared memory job
+ * 		counters, see counters.c.
+ *
+ * Copyright (c) 2014, Zalando SE.
+ * Portions Copyright (C) 2013-2014, PostgreSQL Global Development Group
+ * ------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+
+#include "catalog/pg_type.h"
+#include "executor/spi.h"
+#include "lib/stringinfo.h"
+#include "nodes/pg_list.h"
+#include "utils/array.h"
+#include "utils/builtins.h"
+#include "utils/lsyscache.h"
+#include "utils/memutils.h"
+#include "utils/timestamp.h"
+
+/* Our own include files */
+#include "counters.h"
+#include "joblog.h"
+
+#define JOB_LOG_COLUMNS 	13
+
+typedef struct JobLogEntry
+{
+	uint32 		job_id;
+	uint64 		task_id; 		/* a one-shot task, which has no job_id */
+	char 		datname[NAMEDATALEN];
+	char 		rolname[NAMEDATALEN];
+	char 	   *command;
+	JobResult 	result;
+	bool 		counted; 		/* accounted for in the job counters hash */
+} JobLogEntry;
+
+static MemoryContext 	job_log_context = NULL;
+static List 		   *pending_entries = NIL;
+static TimestampTz 		oldest_entry = 0;
+
+
+/* Remember the outcome of a job run until the next job log write */
+void
+job_log_add(JobDesc *job, JobResult *result)
+{
+	MemoryContext 	oldcxt;
+	JobLogEntry    *entry;
+
+	if (job_log_context == NULL)
+		job_log_context = AllocSetContextCreate(TopMemoryContext,
+												"elephant job log",
+												ALLOCSET_DEFAULT_MINSIZE,
+												ALLOCSET_DEFAULT_INITSIZE,
+												ALLOCSET_DEFAULT_MAXSIZE);
+
+	oldcxt = MemoryContextSwitchTo(job_log_context);
+
+	entry = palloc(sizeof(JobLogEntry));
+	entry->job_id = job->job_id;
+	entry->task_id = job->task_id;
+	snprintf(entry->datname, NAMEDATALEN, "%s", job->datname);
+	snprintf(entry->rolname, NAMEDATALEN, "%s", job->rolname);
+	entry->command = pstrdup(job->command);
+	memcpy(&entry->result, result, sizeof(JobResult));
+	/* Tasks have no counters */
+	entry->counted = (job->task_id != 0 ||
+					  job_counters_add(job->job_id, strcmp(result->sqlstate, "00000") == 0, result->started));
+
+	if (pending_entries == NIL)
+		oldest_entry = GetCurrentTimestamp();
+	pending_entries = lappend(pending_entries, entry);
+
+	MemoryContextSwitchTo(oldcxt);
+}
+
+/* Number of outcomes waiting to be written */
+int
+job_log_pending(void)
+{
+	return list_length(pending_entries);
+}
+
+/* When the oldest pending outcome was reported, 0 if none is pending */
+TimestampTz
+job_log_oldest(void)
+{
+	if (pending_entries == NIL)
+		return 0;
+	return oldest_entry;
+}
+
+static Datum
+nullable_text(const char *value, bool *isnull)
+{
+	*isnull = (value[0] == '\0');
+	return *isnull ? (Datum) 0 : CStringGetTextDatum(value);
+}
+
+/*
+ * The row counts of the batches of a batch job, as the text of a bigint array:
+ * an array of arrays cannot be passed through unnest.
+ */
+static Datum
+batch_rows_text(JobResult *result, bool *isnull)
+{
+	StringInfoData 	buf;
+	int 			i;
+
+	*isnull = (result->nbatches == 0);
+	if (*isnull)
+		return (Datum) 0;
+
+	initStringInfo(&buf);
+	appendStringInfoChar(&buf, '{');
+	for (i = 0; i < Min(result->nbatches, JOB_RESULT_MAX_BATCHES); i++)
+		appendStringInfo(&buf, "%s" UINT64_FORMAT, i > 0 ? "," : "", result->batch_rows[i]);
+	appendStringInfoChar(&buf, '}');
+
+	return CStringGetTextDatum(buf.data);
+}
+
+/* The job log is partitioned by day (UTC) on job_started */
+static int32
+job_log_day(JobLogEntry *entry)
+{
+	return (int32) (timestamptz_to_time_t(entry->result.started) / SECS_PER_DAY);
+}
+
+/*
+ * Insert the pending outcomes of the jobs started on the given day into the job
+ * log partition of that day, creating it if needed. The outcomes are passed as
+ * one array per column.
+ */
+static void
+job_log_insert_day(const char *schema, int32 day)
+{
+	ArrayBuildState *columns[JOB_LOG_COLUMNS];
+	Oid 			elemtypes[JOB_LOG_COLUMNS] = {INT4OID, TEXTOID, TEXTOID,
+												  TIMESTAMPTZOID, TIMESTAMPTZOID, TEXTOID,
+												  TEXTOID, TEXTOID, TEXTOID, TEXTOID, TEXTOID, INT8OID,
+												  TEXTOID};
+	Oid 			argtypes[JOB_LOG_COLUMNS];
+	Datum 			values[JOB_LOG_COLUMNS];
+	StringInfoData 	buf;
+	ListCell 	   *lc;
+	char 		   *partition = NULL;
+	int 			nrows = 0;
+	int 			ret;
+	int 			i;
+
+	memset(columns, 0, sizeof(columns));
+	foreach(lc, pending_entries)
+	{
+		JobLogEntry    *entry = lfirst(lc);
+		Datum 			row[JOB_LOG_COLUMNS];
+		bool 			nulls[JOB_LOG_COLUMNS];
+
+		if (job_log_day(entry) != day)
+			continue;
+
+		memset(nulls, 0, sizeof(nulls));
+		row[0] = Int32GetDatum((int32) entry->job_id);
+		nulls[0] = (entry->task_id != 0);
+		row[1] = CStringGetTextDatum(entry->rolname);
+		row[2] = CStringGetTextDatum(entry->datname);
+		row[3] = TimestampTzGetDatum(entry->result.started);
+		row[4] = TimestampTzGetDatum(entry->result.stopped);
+		row[5] = CStringGetTextDatum(entry->command);
+		row[6] = CStringGetTextDatum(entry->result.sqlstate);
+		row[7] = nullable_text(entry->result.message, &nulls[7]);
+		row[8] = nullable_text(entry->result.detail, &nulls[8]);
+		row[9] = nullable_text(entry->result.hint, &nulls[9]);
+		row[10] = nullable_text(entry->result.context, &nulls[10]);
+		row[11] = Int64GetDatum((int64) entry->task_id);
+		nulls[11] = (entry->task_id == 0);
+		row[12] = batch_rows_text(&entry->result, &nulls[12]);
+
+		for (i = 0; i < JOB_LOG_COLUMNS; i++)
+			columns[i] = accumArrayResult(columns[i], row[i], nulls[i], elemtypes[i], CurrentMemoryContext);
+
+		/* Find the partition the first time we see the day */
+		if (partition == NULL)
+		{
+			Oid 	argtype = TIMESTAMPTZOID;
+
+			initStringInfo(&buf);
+			appendStringInfo(&buf, "SELECT %s.create_job_log_partition(($1 AT TIME ZONE 'utc')::date)",
+							 quote_identifier(schema));
+			ret = SPI_execute_with_args(buf.data, 1, &argtype, &row[3], NULL, false, 1);
+			if (ret != SPI_OK_SELECT || SPI_processed != 1)
+				elog(ERROR, "could not create the job log partition for %s",
+					 timestamptz_to_str(entry->result.started));
+			partition = SPI_getvalue(SPI_tuptable->vals[0], SPI_tuptable->tupdesc, 1);
+			pfree(buf.data);
+		}
+		nrows++;
+	}
+
+	for (i = 0; i < JOB_LOG_COLUMNS; i++)
+	{
+		argtypes[i] = get_array_type(elemtypes[i]);
+		values[i] = makeArrayResult(columns[i], CurrentMemoryContext);
+	}
+
+	initStringInfo(&buf);
+	appendStringInfo(&buf, "INSERT INTO %s (job_id, rolname, datname, job_started, job_finished, job_command, "
+										   "job_sqlstate, exception_message, exception_detail, exception_hint, exception_context, task_id, "
+										   "batch_rows) "
+						   "SELECT job_id, rolname, datname, job_started, job_finished, job_command, "
+								  "job_sqlstate, exception_message, exception_detail, exception_hint, exception_context, task_id, "
+								  "batch_rows::bigint[] "
+							 "FROM unnest($1, $2, $3, $4, $5, $6, $7, $8, $9, $10, $11, $12, $13) "
+							   "AS l(job_id, rolname, datname, job_started, job_finished, job_command, "
+									"job_sqlstate, exception_message, exception_detail, exception_hint, exception_context, task_id, "
+									"batch_rows)",
+						   partition);
+
+	ret = SPI_execute_with_args(buf.data, JOB_LOG_COLUMNS, argtypes, values, NULL, false, 0);
+	if (ret != SPI_OK_INSERT)
+		elog(ERROR, "could not write %d entries to the job log partition %s", nrows, partition);
+
+	pfree(buf.data);
+}
+
+/* Update the counters in the job table directly, for the given job runs */
+static void
+job_log_update_counters(const char *schema, ArrayBuildState *job_ids, ArrayBuildState *started,
+						ArrayBuildState *sqlstates, int nruns)
+{
+	Oid 			argtypes[3];
+	Datum 			values[3];
+	StringInfoData 	buf;
+	int 			ret;
+
+	argtypes[0] = INT4ARRAYOID;
+	argtypes[1] = get_array_type(TIMESTAMPTZOID);
+	argtypes[2] = TEXTARRAYOID;
+	values[0] = makeArrayResult(job_ids, CurrentMemoryContext);
+	values[1] = makeArrayResult(started, CurrentMemoryContext);
+	values[2] = makeArrayResult(sqlstates, CurrentMemoryContext);
+
+	initStringInfo(&buf);
+	appendStringInfo(&buf, "UPDATE %s.%s job "
+							  "SET success_count = job.success_count + r.succeeded,"
+								  "failure_count = job.failure_count + r.failed,"
+								  "last_executed = greatest(job.last_executed, r.last_started) "
+							 "FROM (SELECT job_id,"
+										  "count(*) FILTER (WHERE job_sqlstate =  '00000') AS succeeded,"
+										  "count(*) FILTER (WHERE job_sqlstate <> '00000') AS failed,"
+										  "max(job_started) AS last_started "
+									 "FROM unnest($1, $2, $3) AS log(job_id, job_started, job_sqlstate) "
+									"GROUP BY job_id) r "
+							"WHERE job.job_id = r.job_id",
+							quote_identifier(schema), JOB_RELNAME);
+
+	ret = SPI_execute_with_args(buf.data, 3, argtypes, values, NULL, false, 0);
+	if (ret != SPI_OK_UPDATE)
+		elog(ERROR, "could not update the counters of %d job runs", nruns);
+
+	pfree(buf.data);
+}
+
+/*
+ * Write all pending outcomes to the job log, one statement per partition. The
+ * counters of the jobs are normally kept in shared memory, if that was full we
+ * update them in the job table right away, in a single statement.
+ * Must be called inside a transaction with SPI connected.
+ */
+void
+job_log_write(const char *schema)
+{
+	ArrayBuildState *job_ids = NULL;
+	ArrayBuildState *started = NULL;
+	ArrayBuildState *sqlstates = NULL;
+	List 		   *days = NIL;
+	ListCell 	   *lc;
+	int 			nuncounted = 0;
+
+	if (pending_entries == NIL)
+		return;
+
+	foreach(lc, pending_entries)
+	{
+		JobLogEntry    *entry = lfirst(lc);
+
+		if (!list_member_int(days, job_log_day(entry)))
+			days = lappend_int(days, job_log_day(entry));
+
+		if (entry->counted)
+			continue;
+		nuncounted++;
+		job_ids = accumArrayResult(job_ids, Int32GetDatum((int32) entry->job_id), false, INT4OID, CurrentMemoryContext);
+		started = accumArrayResult(started, TimestampTzGetDatum(entry->result.started), false, TIMESTAMPTZOID, CurrentMemoryContext);
+		sqlstates = accumArrayResult(sqlstates, CStringGetTextDatum(entry->result.sqlstate), false, TEXTOID, CurrentMemoryContext);
+	}
+
+	foreach(lc, days)
+		job_log_insert_day(schema, lfirst_int(lc));
+
+	elog(DEBUG1, "wrote %d entries to the job log", list_length(pending_entries));
+
+	list_free(days);
+	if (nuncounted > 0)
+		job_log_update_counters(schema, job_ids, started, sqlstates, nuncounted);
+
+	MemoryContextReset(job_log_context);
+	pending_entries = NIL;
+	oldest_entry = 0;
+}
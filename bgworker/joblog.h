@@ -0,0 +1,28 @@
+/* ------------------------------------------------------------------------
+ * joblog.h
+ *  	Outcomes of job runs collected by the launcher and written to
+ * 		the job log in batches.
+ *
+ * Copyright (c) 2014, Zalando SE.
+ * Portions Copyright (C) 2013-2014, PostgreSQL Global Development Group
+ * ------------------------------------------------------------------------
+ */
+
+#ifndef _JOBLOG_H
+#define _JOBLOG_H
+
+#include "postgres.h"
+
+#include "jobs.h"
+
+/* The launcher writes the job log as soon as this many results are pending */
+#define JOB_LOG_BATCH_SIZE 	256
+
+#define JOB_RELNAME 		"job"
+
+void job_log_add(JobDesc *job, JobResult *result);
+int job_log_pending(void);
+TimestampTz job_log_oldest(void);
+void job_log_write(const char *schema);
+
+#endif /* _JOBLOG_H */
@@ -17,13 +17,19 @@ fill_job_description(JobDesc *desc,
 					 uint32 id, uint32 log_id,
 					 char *datname, char *rolname,
 					 char *schema, bool parallel,
-					 uint32 timeout)
+					 uint32 timeout, char *command)
 {
 	desc->job_id = id;
+	desc->task_id = 0;
 	desc->job_log_id = log_id;
 	desc->job_timeout = timeout;
 	desc->parallel = parallel;
+	desc->batch_size = 0;
+	desc->batch_delay = 0;
+	desc->cost_limit = 0;
+	desc->cost_delay = 0;
 	snprintf(desc->datname, NAMEDATALEN, "%s", datname);
 	snprintf(desc->rolname, NAMEDATALEN, "%s", rolname);
 	snprintf(desc->schemaname, NAMEDATALEN, "%s", schema);
+	snprintf(desc->command, JOB_COMMAND_MAXLEN, "%s", command);
 }
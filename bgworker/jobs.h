@@ -12,22 +12,81 @@
 
 #include "postgres.h"
 
+#include "utils/timestamp.h"
+
+/* Maximum length of a job command, enforced by a check constraint on the job table */
+#define JOB_COMMAND_MAXLEN 		8192
+/* Error fields reported by a worker are truncated to this length */
+#define JOB_RESULT_FIELD_LEN 	1024
+/* The row counts of the batches of a batch job reported by a worker */
+#define JOB_RESULT_MAX_BATCHES 	1024
+
 typedef struct JobDesc
 {
 	uint32 	job_id;
+	uint64 	task_id; 		/* a one-shot task from the task table, job_id is 0 */
 	uint32	job_log_id;
 	uint32 	job_timeout;
 	bool    parallel;
+	int32 	batch_size; 	/* run the command in batches of this size, 0 runs it once */
+	uint32 	batch_delay; 	/* milliseconds to sleep between two batches */
+	int32 	cost_limit; 	/* the cost of a batch worth cost_delay of sleep */
+	uint32 	cost_delay; 	/* in milliseconds, 0 disables the cost-based throttling */
 	char 	datname[NAMEDATALEN];
 	char 	rolname[NAMEDATALEN];
 	char 	schemaname[NAMEDATALEN];
+	char 	command[JOB_COMMAND_MAXLEN];
 } JobDesc;
 
+/* A run of a job, identified by the moment it was due, or a one-shot task */
+typedef struct JobRun
+{
+	uint32 		job_id;
+	pg_time_t 	due_at;
+	uint64 		task_id; 		/* 0 for a run of a job */
+} JobRun;
+
+/*
+ * The outcome of a job run, reported by the worker to the launcher, which
+ * writes it to the job log. The error fields are empty strings on success.
+ * A batch job reports the rows of its first JOB_RESULT_MAX_BATCHES batches,
+ * rows is the total of all batches.
+ */
+typedef struct JobResult
+{
+	bool 		finished;
+	uint32 		job_id;
+	TimestampTz started;
+	TimestampTz stopped;
+	uint64 		rows;
+	uint32 		nbatches;
+	uint64 		batch_rows[JOB_RESULT_MAX_BATCHES];
+	char 		sqlstate[6];
+	char 		message[JOB_RESULT_FIELD_LEN];
+	char 		detail[JOB_RESULT_FIELD_LEN];
+	char 		hint[JOB_RESULT_FIELD_LEN];
+	char 		context[JOB_RESULT_FIELD_LEN];
+} JobResult;
+
+/*
+ * The shared memory slot through which the launcher hands a job to a worker,
+ * the slots live in the main shared memory. The worker sets attached once it
+ * has copied the job description, so that the launcher can tell a worker
+ * which failed to start from one which has finished. The worker leaves the
+ * outcome of the job in result before it exits.
+ */
+typedef struct JobSlot
+{
+	bool 		attached;
+	JobDesc 	job;
+	JobResult 	result;
+} JobSlot;
+
 void fill_job_description(JobDesc *desc,
 						  uint32 id, uint32 log_id,
 						  char *datname, char *rolname,
 						  char *schema, bool parallel,
-						  uint32 timeout);
+						  uint32 timeout, char *command);
 JobDesc * copy_job_description(JobDesc *source);
 
 #endif /* _JOBS_H */
\ No newline at end of file
@@ -20,6 +20,7 @@
 #include "storage/shmem.h"
 
  /* these headers are used by this particular worker's code */
+#include "access/hash.h"
 #include "access/xact.h"
 #include "executor/spi.h"
 #include "fmgr.h"
@@ -27,49 +28,132 @@
 #include "pgstat.h"
 #include "postmaster/postmaster.h"
 #include "utils/builtins.h"
+#include "utils/guc.h"
 #include "utils/memutils.h"
 #include "utils/snapmgr.h"
+#include "utils/timestamp.h"
+#include "utils/resowner.h"
 #include "storage/dsm.h"
+#include "storage/shm_mq.h"
+#include "storage/shm_toc.h"
 #include "tcop/utility.h"
 
 /* Our own include files */
+#include "admission.h"
 #include "commons.h"
+#include "counters.h"
+#include "dispatch.h"
+#include "jobcache.h"
+#include "joblog.h"
 #include "jobs.h"
+#include "pool.h"
+#include "runqueue.h"
+#include "shared.h"
+#include "taskqueue.h"
+#include "window.h"
 #include "worker.h"
 
 #define PROCESS_NAME "elephant launcher"
 
+/* Seconds after which the postmaster restarts a launcher which has exited with an error */
+#define LAUNCHER_RESTART_TIME 	10
+/* Milliseconds a launcher waits after an error in its main loop before it tries again */
+#define LAUNCHER_ERROR_DELAY 	1000
+
 PG_MODULE_MAGIC;
-PG_FUNCTION_INFO_V1(launcher_main);
 
 void _PG_init(void);
+void launcher_main(Datum main_arg);
 
 
 static volatile sig_atomic_t got_sighup = false;
 static volatile sig_atomic_t got_sigterm = false;
 static volatile sig_atomic_t got_sigusr1 = false;
 
-static uint32 	launcher_naptime = 500;
+static uint32 	launcher_naptime = 60000;
+
+/*
+ * The number of launchers, and the number of the launcher running in this
+ * process. Every launcher owns a partition of the jobs and tasks.
+ */
+static int 		launcher_count = 1;
+static int 		launcher_number = 0;
 
 extern uint32 	launcher_max_workers = 10;
 static char 	*launcher_database = NULL;
+static bool 	launcher_pool_mode = false;
+static int 		launcher_pool_idle_timeout = 300;
+static int 		launcher_log_flush_delay = 1000;
+static int 		launcher_log_retention = 30 * 24 * 60;
+
+/* How often the partitions of the job log are maintained, in seconds */
+#define JOB_LOG_MAINTENANCE_INTERVAL 	3600
+static pg_time_t 	next_log_maintenance = 0;
+
+static int 		launcher_counter_flush_interval = 60;
+static pg_time_t 	next_counter_flush = 0;
+
+/* Spreading of jobs sharing a schedule, and the maximum number of launches per second */
+static int 		launcher_spread_window = 0;
+static int 		launcher_max_launch_rate = 0;
+
+/* Concurrency caps per database and per role, 0 means no cap */
+static int 		launcher_max_workers_per_database = 0;
+static int 		launcher_max_workers_per_role = 0;
+
+/* The cost-based throttling of batch jobs which do not set their own */
+static int 		launcher_job_cost_limit = 200;
+static int 		launcher_job_cost_delay = 0;
+
+/* The thresholds over which deferrable jobs are held, and for how long at most */
+static AdmissionLimits admission_limits = {0, 0, false};
+static int 		launcher_max_defer_time = 300;
+/* When to look at the cluster again for the jobs being held, 0 if none is */
+static TimestampTz 	admission_recheck = 0;
+
+/*
+ * Workers are launched without waiting for them to start. The postmaster signals
+ * us when a worker has started or stopped, and we resolve the state of the slot
+ * on the next wakeup.
+ */
+typedef enum worker_status
+{
+	WORKER_PENDING, 		/* registered, not started by the postmaster yet */
+	WORKER_STARTED, 		/* running */
+	WORKER_FAILED 			/* stopped without ever picking up its job */
+} worker_status;
 
 typedef struct worker_state
 {
+	worker_status 			status;
 	pid_t 					pid;
 	uint32 					job_id;
-	pg_time_t 				last_executed;
+	JobDesc 				job; 		/* the job being run, for the job log */
+	pg_time_t 				due_at; 	/* the moment the run being executed was due */
 	dsm_segment 		   *segment;
 	BackgroundWorkerHandle *handle;
+	/* Pooled workers serve a database and role until they are idle for too long */
+	bool 					pooled;
+	bool 					busy;
+	bool 					retiring;
+	pg_time_t 				idle_since;
+	char 					datname[NAMEDATALEN];
+	char 					rolname[NAMEDATALEN];
+	shm_mq 				   *job_mq;
+	shm_mq_handle 		   *job_queue;
+	shm_mq_handle 		   *result_queue;
 } worker_state;
 
 static worker_state 	*wstate;
 
+static void job_completed(JobDesc *job, JobResult *result);
+
+/* Owns the dynamic shared memory segments we create for the pooled workers */
+static ResourceOwner 	 launcher_resowner = NULL;
+
 static char 			 schema_name[NAMEDATALEN];
 
 static db_object_data    job_table;
-static db_object_data    log_table;
-static db_object_data 	 schedule_function;
 
 
 static Datum
@@ -112,7 +196,8 @@ launcher_sigusr1(SIGNAL_ARGS)
 
 	got_sigusr1 = true;
 
-	if (set_latch_on_sigusr1 && MyProc != NULL)
+	/* The postmaster signals us when a worker has started or stopped */
+	if (MyProc != NULL)
 		SetLatch(&MyProc->procLatch);
 
 	errno = save_errno;
@@ -143,7 +228,7 @@ init_launcher()
 
 	/* allocate the workers state in the global context */
 	wstate = palloc0(sizeof(worker_state) * launcher_max_workers);
-	/*CurrentResourceOwner = ResourceOwnerCreate(NULL, PROCESS_NAME);*/
+	launcher_resowner = ResourceOwnerCreate(NULL, PROCESS_NAME);
 	pgstat_report_activity(STATE_RUNNING, "launcher initialization");
 }
 
@@ -193,33 +278,142 @@ init_table_names()
 {
 	/* Allocate them in a persistent context */
 
-	log_table.name = quote_identifier("job_log");
-	log_table.schema = quote_identifier(schema_name);
-
 	job_table.name = quote_identifier("job");
 	job_table.schema = quote_identifier(schema_name);
+}
+
+/*
+ * The job slot in shared memory of the worker in the given launcher slot, every
+ * launcher has a range of max_workers job slots.
+ */
+static int
+launcher_job_slot(int i)
+{
+	return launcher_number * launcher_max_workers + i;
+}
 
-	schedule_function.name = quote_identifier("job_scheduled_at");
-	schedule_function.schema = quote_identifier(schema_name);
+/* Whether the worker in the given slot has picked up its job */
+static bool
+worker_attached(int i)
+{
+	if (wstate[i].pooled)
+		return shm_mq_get_receiver(wstate[i].job_mq) != NULL;
+	return get_job_slot(launcher_job_slot(i))->attached;
+}
+
+/*
+ * Write a failure to the job log for the job of a worker which could not be
+ * started or which exited without reporting an outcome, the run would otherwise
+ * leave no trace but a warning.
+ */
+static void
+report_run_failure(int i, int sqlerrcode, const char *message)
+{
+	JobResult  *result = palloc0(sizeof(JobResult));
+
+	result->finished = true;
+	result->job_id = wstate[i].job_id;
+	result->started = GetCurrentTimestamp();
+	result->stopped = result->started;
+	snprintf(result->sqlstate, sizeof(result->sqlstate), "%s", unpack_sql_state(sqlerrcode));
+	snprintf(result->message, JOB_RESULT_FIELD_LEN, "%s", message);
+	job_completed(&wstate[i].job, result);
+	pfree(result);
 }
 
+/*
+ * Resolve the state of the worker in the given slot, without waiting. Returns
+ * false, after releasing the slot, if the worker is gone.
+ */
 bool check_worker_alive(int i)
 {
-	pid_t 	pid;
+	pid_t 			pid;
+	BgwHandleStatus status;
 
 	if (wstate[i].handle == NULL)
 		return false;
-	else if (GetBackgroundWorkerPid(wstate[i].handle, &pid) != BGWH_STARTED)
+
+	status = GetBackgroundWorkerPid(wstate[i].handle, &pid);
+
+	if (status == BGWH_POSTMASTER_DIED)
+		ereport(ERROR,
+				(errcode(ERRCODE_INSUFFICIENT_RESOURCES),
+				 errmsg("cannot start background processes without postmaster"),
+				 errhint("Kill all remaining database processes and restart the database.")));
+
+	if (status == BGWH_NOT_YET_STARTED)
+		return true;
+
+	if (status == BGWH_STARTED)
 	{
-		/* cleanup */
-		pfree(wstate[i].handle);
-		wstate[i].handle = NULL;
-		dsm_detach(wstate[i].segment);
-		elog(LOG, "worker %d has terminated", pid);
+		if (wstate[i].status == WORKER_PENDING)
+		{
+			wstate[i].status = WORKER_STARTED;
+			wstate[i].pid = pid;
+			elog(LOG, "started a worker for job %d", wstate[i].job_id);
+		}
+		return true;
+	}
 
-		return false;
+	/* The worker has stopped, find out whether it ever ran */
+	if (!worker_attached(i))
+	{
+		wstate[i].status = WORKER_FAILED;
+		ereport(WARNING,
+				(errcode(ERRCODE_INSUFFICIENT_RESOURCES),
+				 errmsg("could not start background process for job %d", wstate[i].job_id),
+				 errhint("More details may be available in the server log.")));
+		/* An idle pooled worker has no job */
+		if (!wstate[i].pooled || wstate[i].busy)
+			report_run_failure(i, ERRCODE_INSUFFICIENT_RESOURCES, "could not start background process");
 	}
-	return true;
+	else
+	{
+		elog(LOG, "worker %d has terminated", wstate[i].pid);
+		if (!wstate[i].pooled)
+		{
+			JobSlot    *slot = get_job_slot(launcher_job_slot(i));
+
+			if (slot->result.finished)
+				job_completed(&wstate[i].job, &slot->result);
+			else
+			{
+				elog(WARNING, "worker %d exited without reporting the outcome of job %d", wstate[i].pid, wstate[i].job_id);
+				report_run_failure(i, ERRCODE_INTERNAL_ERROR, "worker exited without reporting an outcome");
+			}
+		}
+		else if (wstate[i].busy)
+		{
+			shm_mq_result 	res;
+			Size 			nbytes;
+			void 		   *data;
+
+			/* The outcome may have been sent just before the worker exited */
+			res = shm_mq_receive(wstate[i].result_queue, &nbytes, &data, true);
+			if (res == SHM_MQ_SUCCESS && nbytes == sizeof(JobResult))
+				job_completed(&wstate[i].job, (JobResult *) data);
+			else
+			{
+				elog(WARNING, "pooled worker %d exited while running job %d", wstate[i].pid, wstate[i].job_id);
+				report_run_failure(i, ERRCODE_INTERNAL_ERROR, "worker exited without reporting an outcome");
+			}
+		}
+	}
+
+	/* cleanup */
+	pfree(wstate[i].handle);
+	wstate[i].handle = NULL;
+	if (wstate[i].segment != NULL)
+		dsm_detach(wstate[i].segment);
+	wstate[i].segment = NULL;
+	wstate[i].pooled = false;
+	wstate[i].busy = false;
+	wstate[i].retiring = false;
+	wstate[i].job_mq = NULL;
+	wstate[i].job_queue = NULL;
+	wstate[i].result_queue = NULL;
+
+	return false;
 }
 
 /* Cleanup after workers that terminated. */
@@ -237,30 +431,49 @@ check_for_terminated_workers()
 }
 
 /*
- * Launch a new worker and put its data into the launcher slot with a
- * given index.
+ * Create a dynamic shared memory segment for a pooled worker. The segment stays mapped
+ * beyond the current transaction, until we detach from it explicitly.
  */
-static void
-launch_worker(int index, JobDesc *job_desc)
+static dsm_segment *
+launcher_dsm_create(Size size)
 {
-	int  	j;
-	bool 			started;
-	pg_time_t		last_executed;
+	ResourceOwner 	oldowner = CurrentResourceOwner;
 	dsm_segment    *segment;
-	BackgroundWorker 			worker;
-	BackgroundWorkerHandle     *handle;
+
+	CurrentResourceOwner = launcher_resowner;
+	segment = dsm_create(size);
+	dsm_pin_mapping(segment);
+	CurrentResourceOwner = oldowner;
+
+	return segment;
+}
+
+/*
+ * Check whether the job may be started: a run due at a given moment is started
+ * only once, and only one instance runs at a time unless it allows parallel
+ * execution. A task may always be started.
+ */
+static bool
+job_may_start(int index, JobDesc *job_desc, pg_time_t due_at)
+{
+	int  	j;
+
+	if (job_desc->task_id != 0)
+		return true;
 
 	/* Check if no jobs are running with the same id */
 	for (j = 0; j < launcher_max_workers; j++)
 	{
 		if (j == index || wstate[j].handle == NULL)
 			continue;
+		/* An idle pooled worker does not run any job */
+		if (wstate[j].pooled && !wstate[j].busy)
+			continue;
 		if (wstate[j].job_id == job_desc->job_id)
 		{
-		 	pg_time_t 	now = (pg_time_t) time(NULL);
-		 	/* Check if we are trying to run the same job for the second time in the duration of a single minute */
-		 	if (wstate[j].last_executed/60 == now/60)
-		 		return;
+		 	/* Check if we are trying to start the same run for the second time */
+		 	if (wstate[j].due_at == due_at)
+		 		return false;
 			/*
 			 * Another job with the same id, but we only
 			 * allow one at a time. Check whether the old
@@ -269,14 +482,51 @@ launch_worker(int index, JobDesc *job_desc)
 			 if (!job_desc->parallel && check_worker_alive(j))
 			 {
 			 	elog(WARNING, "could not run multiple instances of job %d: parallel execution is disabled for it", job_desc->job_id);
-			 	return;
+			 	return false;
 			 }
 		}
 	}
-	/* copy the job information to shared memory */
-	segment = dsm_create(sizeof(JobDesc));
+	return true;
+}
+
+/*
+ * Register a dynamic background worker, we do not wait for it to start.
+ * Returns the handle of the worker, or NULL if it could not be registered.
+ */
+static BackgroundWorkerHandle *
+start_worker(BackgroundWorker *worker, uint32 job_id)
+{
+	BackgroundWorkerHandle     *handle;
+
+	if (!RegisterDynamicBackgroundWorker(worker, &handle))
+	{
+		elog(WARNING, "could not register dynamic background worker for job %d", job_id);
+		return NULL;
+	}
+	return handle;
+}
+
+/*
+ * Launch a new worker and put its data into the launcher slot with a
+ * given index. The job is handed over in the job slot with the same index.
+ * Returns false if the worker could not be registered, a job which may not
+ * start is dropped.
+ */
+static bool
+launch_worker(int index, JobDesc *job_desc, pg_time_t due_at)
+{
+	JobSlot 				   *slot;
+	BackgroundWorker 			worker;
+	BackgroundWorkerHandle     *handle;
+
+	if (!job_may_start(index, job_desc, due_at))
+		return true;
 
-	memcpy(dsm_segment_address(segment), job_desc, sizeof(JobDesc));
+	/* copy the job information to shared memory, the slot is free while wstate[index] is */
+	slot = get_job_slot(launcher_job_slot(index));
+	slot->attached = false;
+	slot->result.finished = false;
+	memcpy(&slot->job, job_desc, sizeof(JobDesc));
 	/* prepare the information to actually launch the worker */
 	worker.bgw_flags = BGWORKER_SHMEM_ACCESS | BGWORKER_BACKEND_DATABASE_CONNECTION;
 	worker.bgw_start_time = BgWorkerStart_RecoveryFinished;
@@ -284,192 +534,923 @@ launch_worker(int index, JobDesc *job_desc)
 	worker.bgw_main = NULL;
 	sprintf(worker.bgw_library_name, EXTENSION_NAME);
 	sprintf(worker.bgw_function_name, "worker_main");
-	snprintf(worker.bgw_name, BGW_MAXLEN, "worker %d", job_desc->job_id);
+	if (job_desc->task_id != 0)
+		snprintf(worker.bgw_name, BGW_MAXLEN, "worker task " UINT64_FORMAT, job_desc->task_id);
+	else
+		snprintf(worker.bgw_name, BGW_MAXLEN, "worker %d", job_desc->job_id);
+	worker.bgw_main_arg = Int32GetDatum(launcher_job_slot(index));
+	worker.bgw_notify_pid = MyProcPid;
+
+	handle = start_worker(&worker, job_desc->job_id);
+	if (handle == NULL)
+	{
+		wstate[index].handle = NULL;
+		return false;
+	}
+
+	elog(DEBUG1, "registered a worker for job %d", job_desc->job_id);
+
+	wstate[index].status = WORKER_PENDING;
+	wstate[index].segment = NULL;
+	wstate[index].handle = handle;
+	wstate[index].pid = 0;
+	wstate[index].job_id = job_desc->job_id;
+	memcpy(&wstate[index].job, job_desc, sizeof(JobDesc));
+	wstate[index].due_at = due_at;
+	wstate[index].pooled = false;
+	return true;
+}
+
+/*
+ * Launch a pooled worker for the database and role of the job in the given slot,
+ * the job becomes the first one it executes. We talk to the worker through a
+ * shared memory segment holding a queue in each direction. Returns false if the
+ * worker could not be registered.
+ */
+static bool
+launch_pool_worker(int index, JobDesc *job_desc, pg_time_t due_at)
+{
+	shm_toc_estimator 			e;
+	Size 						segsize;
+	dsm_segment    			   *segment;
+	shm_toc 				   *toc;
+	PoolHeader 				   *hdr;
+	shm_mq 					   *job_mq;
+	shm_mq 					   *result_mq;
+	BackgroundWorker 			worker;
+	BackgroundWorkerHandle     *handle;
+	MemoryContext 				oldcxt;
+
+	shm_toc_initialize_estimator(&e);
+	shm_toc_estimate_chunk(&e, sizeof(PoolHeader));
+	shm_toc_estimate_chunk(&e, POOL_QUEUE_SIZE);
+	shm_toc_estimate_chunk(&e, POOL_QUEUE_SIZE);
+	shm_toc_estimate_keys(&e, 3);
+	segsize = shm_toc_estimate(&e);
+
+	segment = launcher_dsm_create(segsize);
+	toc = shm_toc_create(POOL_SHM_MAGIC, dsm_segment_address(segment), segsize);
+
+	hdr = shm_toc_allocate(toc, sizeof(PoolHeader));
+	snprintf(hdr->datname, NAMEDATALEN, "%s", job_desc->datname);
+	snprintf(hdr->rolname, NAMEDATALEN, "%s", job_desc->rolname);
+	shm_toc_insert(toc, POOL_KEY_HEADER, hdr);
+
+	job_mq = shm_mq_create(shm_toc_allocate(toc, POOL_QUEUE_SIZE), POOL_QUEUE_SIZE);
+	shm_toc_insert(toc, POOL_KEY_JOB_QUEUE, job_mq);
+	shm_mq_set_sender(job_mq, MyProc);
+
+	result_mq = shm_mq_create(shm_toc_allocate(toc, POOL_QUEUE_SIZE), POOL_QUEUE_SIZE);
+	shm_toc_insert(toc, POOL_KEY_RESULT_QUEUE, result_mq);
+	shm_mq_set_receiver(result_mq, MyProc);
+
+	worker.bgw_flags = BGWORKER_SHMEM_ACCESS | BGWORKER_BACKEND_DATABASE_CONNECTION;
+	worker.bgw_start_time = BgWorkerStart_RecoveryFinished;
+	worker.bgw_restart_time = BGW_NEVER_RESTART;
+	worker.bgw_main = NULL;
+	sprintf(worker.bgw_library_name, EXTENSION_NAME);
+	sprintf(worker.bgw_function_name, "pool_worker_main");
+	snprintf(worker.bgw_name, BGW_MAXLEN, "pool worker %s/%s", job_desc->datname, job_desc->rolname);
 	worker.bgw_main_arg = UInt32GetDatum(dsm_segment_handle(segment));
 	worker.bgw_notify_pid = MyProcPid;
 
-	started = false;
-	last_executed = (pg_time_t) time(NULL);
+	handle = start_worker(&worker, job_desc->job_id);
+	if (handle == NULL)
+	{
+		dsm_detach(segment);
+		return false;
+	}
+
+	oldcxt = MemoryContextSwitchTo(TopMemoryContext);
+	wstate[index].job_queue = shm_mq_attach(job_mq, segment, handle);
+	wstate[index].result_queue = shm_mq_attach(result_mq, segment, handle);
+	MemoryContextSwitchTo(oldcxt);
+
+	/* The queue is empty, so this cannot block */
+	if (shm_mq_send(wstate[index].job_queue, sizeof(JobDesc), job_desc, true) != SHM_MQ_SUCCESS)
+		elog(WARNING, "could not hand job %d to the new pooled worker", job_desc->job_id);
+
+	elog(DEBUG1, "registered a pooled worker for database %s and role %s", job_desc->datname, job_desc->rolname);
+
+	wstate[index].status = WORKER_PENDING;
+	wstate[index].segment = segment;
+	wstate[index].handle = handle;
+	wstate[index].pid = 0;
+	wstate[index].job_mq = job_mq;
+	wstate[index].job_id = job_desc->job_id;
+	memcpy(&wstate[index].job, job_desc, sizeof(JobDesc));
+	wstate[index].due_at = due_at;
+	wstate[index].pooled = true;
+	wstate[index].busy = true;
+	wstate[index].retiring = false;
+	snprintf(wstate[index].datname, NAMEDATALEN, "%s", job_desc->datname);
+	snprintf(wstate[index].rolname, NAMEDATALEN, "%s", job_desc->rolname);
+	return true;
+}
 
-	if (!RegisterDynamicBackgroundWorker(&worker, &handle))
-		elog(WARNING, "could not register dynamic background worker for job %d", job_desc->job_id);
-	else
+/*
+ * Launch a worker for the job in the first free slot. Returns false if all slots
+ * are occupied or the worker could not be registered, the job should then wait.
+ */
+static bool
+dispatch_job(JobDesc *job_desc, pg_time_t due_at)
+{
+	int 	i;
+
+	for (i = 0; i < launcher_max_workers; i++)
 	{
-		pid_t 	pid;
-		BgwHandleStatus 	status;
+		/* Look for a first free slot */
+		if (wstate[i].handle == NULL)
+		{
+			/* Launch the new worker if we don't have one for the job already*/
+			return launch_worker(i, job_desc, due_at);
+		}
+	}
+	return false;
+}
 
-		status = WaitForBackgroundWorkerStartup(handle, &pid);
+/*
+ * Hand the job to an idle pooled worker serving its database and role, or
+ * launch a new pooled worker if there is none. Returns false if all worker
+ * slots are occupied or the new worker could not be registered.
+ */
+static bool
+dispatch_pooled_job(JobDesc *job_desc, pg_time_t due_at)
+{
+	int 	i;
+	int 	free_slot = -1;
 
-		if (status == BGWH_STOPPED)
-			ereport(WARNING,
-					(errcode(ERRCODE_INSUFFICIENT_RESOURCES),
-					 errmsg("could not start background process"),
-				     errhint("More details may be available in the server log.")));
+	if (!job_may_start(-1, job_desc, due_at))
+		return true;
 
-		if (status == BGWH_POSTMASTER_DIED)
-				ereport(ERROR,
-						(errcode(ERRCODE_INSUFFICIENT_RESOURCES),
-					     errmsg("cannot start background processes without postmaster"),
-						 errhint("Kill all remaining database processes and restart the database.")));
+	for (i = 0; i < launcher_max_workers; i++)
+	{
+		if (wstate[i].handle == NULL)
+		{
+			if (free_slot < 0)
+				free_slot = i;
+			continue;
+		}
+		if (!wstate[i].pooled || wstate[i].busy || wstate[i].retiring ||
+			strcmp(wstate[i].datname, job_desc->datname) != 0 ||
+			strcmp(wstate[i].rolname, job_desc->rolname) != 0)
+			continue;
 
-		if (status == BGWH_STARTED)
+		if (shm_mq_send(wstate[i].job_queue, sizeof(JobDesc), job_desc, true) == SHM_MQ_SUCCESS)
 		{
-			elog(LOG, "started a worker for job %d", job_desc->job_id);
-
-			started = true;
-			wstate[index].segment = segment;
-			wstate[index].handle = handle;
-			wstate[index].pid = pid;
-			wstate[index].job_id = job_desc->job_id;
-			wstate[index].last_executed = last_executed;
+			elog(DEBUG1, "handed job %d to pooled worker %d", job_desc->job_id, wstate[i].pid);
+			wstate[i].busy = true;
+			wstate[i].job_id = job_desc->job_id;
+			memcpy(&wstate[i].job, job_desc, sizeof(JobDesc));
+			wstate[i].due_at = due_at;
+			return true;
 		}
 	}
-	if (!started)
+
+	if (free_slot < 0)
+		return false;
+
+	return launch_pool_worker(free_slot, job_desc, due_at);
+}
+
+/* Collect the outcomes reported by pooled workers, which then become idle */
+static void
+collect_pool_results()
+{
+	int 	i;
+
+	for (i = 0; i < launcher_max_workers; i++)
 	{
-		/* cleanup the resource we've allocated */
-		dsm_detach(segment);
-		wstate[index].handle = NULL;
+		shm_mq_result 	res;
+		Size 			nbytes;
+		void 		   *data;
+
+		if (wstate[i].handle == NULL || !wstate[i].pooled || !wstate[i].busy)
+			continue;
+
+		res = shm_mq_receive(wstate[i].result_queue, &nbytes, &data, true);
+		if (res != SHM_MQ_SUCCESS || nbytes != sizeof(JobResult))
+			continue;
+
+		elog(DEBUG1, "pooled worker %d finished job %d with sqlstate %s", wstate[i].pid,
+			 ((JobResult *) data)->job_id, ((JobResult *) data)->sqlstate);
+
+		job_completed(&wstate[i].job, (JobResult *) data);
+
+		wstate[i].busy = false;
+		wstate[i].idle_since = (pg_time_t) time(NULL);
 	}
 }
 
-/* Check if there are jobs scheduled to run and spawn worker subprocesses to run them. */
-static void run_scheduled_jobs()
+/* Terminate the pooled workers which have been idle for too long, or all idle ones if pool mode was disabled */
+static void
+retire_idle_pool_workers()
 {
-	StringInfoData 	buf;
-	int 			ret;
-	int 			i;
-	MemoryContext 	uppercxt;
-	ListCell  	   *lc;
-	List 		   *scheduled_jobs = NIL;
+	int 		i;
+	pg_time_t 	now = (pg_time_t) time(NULL);
+
+	for (i = 0; i < launcher_max_workers; i++)
+	{
+		if (wstate[i].handle == NULL || !wstate[i].pooled || wstate[i].busy || wstate[i].retiring)
+			continue;
+		if (launcher_pool_mode && now - wstate[i].idle_since < launcher_pool_idle_timeout)
+			continue;
 
+		elog(LOG, "retiring idle pooled worker %d", wstate[i].pid);
+		TerminateBackgroundWorker(wstate[i].handle);
+		wstate[i].retiring = true;
+	}
+}
+
+/*
+ * Bring the job cache up to date with the job table. Only the jobs changed since
+ * the last call are fetched, unless a full reload is requested or required.
+ */
+static void
+refresh_job_cache(bool full)
+{
+	uint32 	changed[JOB_CHANGE_QUEUE_SIZE];
+	int 	nchanged;
+
+	nchanged = fetch_job_changes(changed);
+	if (nchanged == 0 && !full)
+		return;
 
-	initStringInfo(&buf);
-	appendStringInfo(&buf, "SELECT job_id,"
-								   "parallel,"
-								   "extract(epoch from job_timeout) as job_timeout,"
-								   "datname,"
-								   "rolname "
-							  "FROM %s.%s()",
-							  schedule_function.schema,
-							  schedule_function.name);
-
-	uppercxt = CurrentMemoryContext;
-
-	/* First, check if there are jobs to run */
 	SetCurrentStatementStartTimestamp();
 	StartTransactionCommand();
 	SPI_connect();
 	PushActiveSnapshot(GetTransactionSnapshot());
 
-	pgstat_report_activity(STATE_RUNNING, buf.data);
+	pgstat_report_activity(STATE_RUNNING, "refreshing the job cache");
 
-	SetCurrentStatementStartTimestamp();
-	ret = SPI_execute(buf.data, false, 0);
+	if (full || nchanged < 0)
+	{
+		window_cache_load(schema_name, launcher_max_workers);
+		job_cache_load(job_table.schema, job_table.name, NULL, 0);
+	}
+	else
+		job_cache_load(job_table.schema, job_table.name, changed, nchanged);
 
-	if (ret < 0)
-		elog(FATAL, "cannot obtain list of jobs to run");
+	SPI_finish();
+	PopActiveSnapshot();
+	CommitTransactionCommand();
 
-	/* Get the oids of jobs to run */
-	elog(LOG, "fetching attributes");
-	for (i = 0; i < SPI_processed; i++)
-	{
-		char   *datname;
-		char   *rolname;
+	pgstat_report_activity(STATE_IDLE, NULL);
+}
 
-		uint32 	job_id;
-		uint32	job_timeout;
-		bool 	isnull;
-		bool 	parallel;
-		MemoryContext  oldcxt;
-		JobDesc 	  *job_desc;
+/*
+ * Write the next run of the jobs dispatched or (re)loaded since the previous call
+ * to the job table, so that the due jobs can be found with an index range scan.
+ * The runs which are due but not started yet go to the job run queue in the same
+ * transaction: after a restart every run is either in the queue or still ahead
+ * of next_run_at. The tasks which have been started are deleted.
+ */
+static void
+write_run_state()
+{
+	if (!job_cache_next_runs_changed() && !run_queue_changed() && !task_queue_changed())
+		return;
 
-		/* fetch interesting attributes */
-		job_id = DatumGetUInt32(get_attribute_via_spi(SPI_tuptable, i, "job_id", &isnull));
-		Assert(!isnull);
+	SetCurrentStatementStartTimestamp();
+	StartTransactionCommand();
+	SPI_connect();
+	PushActiveSnapshot(GetTransactionSnapshot());
 
-		datname = get_text_via_spi(SPI_tuptable, i, "datname");
-		Assert(len(datname) > 0);
+	pgstat_report_activity(STATE_RUNNING, "writing the next run of the jobs");
 
-		rolname = get_text_via_spi(SPI_tuptable, i, "rolname");
-		Assert(len(rolname) > 0);
+	job_cache_write_next_runs(job_table.schema, job_table.name);
+	run_queue_write(schema_name);
+	task_queue_write(schema_name);
 
-		parallel = DatumGetBool(get_attribute_via_spi(SPI_tuptable, i, "parallel", &isnull));
-		Assert(!isnull);
+	SPI_finish();
+	PopActiveSnapshot();
+	CommitTransactionCommand();
 
-		job_timeout = DatumGetInt32(get_attribute_via_spi(SPI_tuptable, i, "job_timeout", &isnull));
-		Assert(!isnull);
+	pgstat_report_activity(STATE_IDLE, NULL);
+}
 
-		/*
-		 * Allocate a new job description in the permanent context, so it does not go away
-		 * after SPI_finish.
-		 */
-		oldcxt = MemoryContextSwitchTo(uppercxt);
-		job_desc = palloc(sizeof(JobDesc));
-		fill_job_description(job_desc, job_id, 0, datname, rolname, schema_name, parallel, job_timeout);
+/*
+ * Write the outcomes reported by the workers to the job log. Unless forced, this
+ * waits until a batch is full or the oldest outcome is log_flush_delay old.
+ */
+static void
+write_job_log(bool force)
+{
+	TimestampTz 	oldest = job_log_oldest();
 
+	if (oldest == 0)
+		return;
+	if (!force && job_log_pending() < JOB_LOG_BATCH_SIZE &&
+		!TimestampDifferenceExceeds(oldest, GetCurrentTimestamp(), launcher_log_flush_delay))
+		return;
 
-		scheduled_jobs = lappend(scheduled_jobs, job_desc);
-		MemoryContextSwitchTo(oldcxt);
-	}
+	SetCurrentStatementStartTimestamp();
+	StartTransactionCommand();
+	SPI_connect();
+	PushActiveSnapshot(GetTransactionSnapshot());
+
+	pgstat_report_activity(STATE_RUNNING, "writing the job log");
+
+	job_log_write(schema_name);
 
-	/* We are done with the database, finish the SPI call */
 	SPI_finish();
 	PopActiveSnapshot();
 	CommitTransactionCommand();
 
 	pgstat_report_activity(STATE_IDLE, NULL);
-
-	/* Now launch the child processes */
-	foreach(lc, scheduled_jobs)
-	{
-		JobDesc   *job_desc = lfirst(lc);
-		for (i = 0; i < launcher_max_workers; i++)
-		{
-			/* Look for a first free slot */
-			if (wstate[i].handle == NULL)
-			{
-				/* Launch the new worker if we don't have one for the job already*/
-				launch_worker(i, job_desc);
-				break;
-			}
-		}
-		elog(WARNING, "unable to launch more job: all available worker slots are occupied",
-					  (errhint("Increase the elephant_worker.max_worker value")));
-		break;
-	}
-	list_free_deep(scheduled_jobs);
 }
 
-Datum launcher_main(PG_FUNCTION_ARGS)
+/*
+ * Write the job counters kept in shared memory to the job table, every
+ * counter_flush_interval or when forced.
+ */
+static void
+write_job_counters(bool force)
 {
-	/* Setup signal handlers */
-	pqsignal(SIGHUP, launcher_sighup);
-	pqsignal(SIGTERM, launcher_sigterm);
-	pqsignal(SIGUSR1, launcher_sigusr1);
+	pg_time_t 		now = (pg_time_t) time(NULL);
 
-	/* Allow signals after the signal handlers have been established */
-	BackgroundWorkerUnblockSignals();
+	if (!force && now < next_counter_flush)
+		return;
+	next_counter_flush = now + launcher_counter_flush_interval;
 
-	init_launcher();
-	BackgroundWorkerInitializeConnection(launcher_database, NULL);
-	launcher_get_extension_schema(EXTENSION_NAME);
-	init_table_names();
+	SetCurrentStatementStartTimestamp();
+	StartTransactionCommand();
+	SPI_connect();
+	PushActiveSnapshot(GetTransactionSnapshot());
+
+	pgstat_report_activity(STATE_RUNNING, "writing the job counters");
+
+	job_counters_write(schema_name);
+
+	SPI_finish();
+	PopActiveSnapshot();
+	CommitTransactionCommand();
+
+	pgstat_report_activity(STATE_IDLE, NULL);
+}
+
+/*
+ * Create the upcoming partitions of the job log and drop the ones older than
+ * log_retention. Dropping a partition is much cheaper than deleting its rows.
+ */
+static void
+maintain_job_log()
+{
+	StringInfoData 	buf;
+	pg_time_t 		now = (pg_time_t) time(NULL);
+
+	if (now < next_log_maintenance)
+		return;
+	next_log_maintenance = now + JOB_LOG_MAINTENANCE_INTERVAL;
+
+	initStringInfo(&buf);
+	appendStringInfo(&buf, "SELECT %s.maintain_job_log_partitions(%d * interval '1 minute')",
+					 quote_identifier(schema_name), launcher_log_retention);
+
+	SetCurrentStatementStartTimestamp();
+	StartTransactionCommand();
+	SPI_connect();
+	PushActiveSnapshot(GetTransactionSnapshot());
+
+	pgstat_report_activity(STATE_RUNNING, buf.data);
+
+	if (SPI_execute(buf.data, false, 0) != SPI_OK_SELECT)
+		elog(ERROR, "could not maintain the job log partitions");
+
+	SPI_finish();
+	PopActiveSnapshot();
+	CommitTransactionCommand();
+
+	pgstat_report_activity(STATE_IDLE, NULL);
+	pfree(buf.data);
+}
+
+/*
+ * The moment a job due at the given moment is released to a worker. With a spread
+ * window every job gets its own offset within the window, derived from its id, so
+ * that the @hourly and @daily jobs do not all start at the top of the hour. Jobs
+ * scheduled to the second are released at that second, they are not spread.
+ */
+static TimestampTz
+job_release_time(JobCacheEntry *entry, pg_time_t due_at)
+{
+	TimestampTz 	result = time_t_to_timestamptz(due_at);
+
+	if (launcher_spread_window > 0 && !schedule_has_seconds(&entry->schedule))
+		result = TimestampTzPlusMilliseconds(result,
+											 hash_uint32(entry->job_id) % ((uint32) launcher_spread_window * 1000));
+	return result;
+}
+
+/*
+ * The moment a run of a job is released, given the moment it would be released
+ * otherwise. The run of a job in a maintenance window is planned in the window.
+ */
+static TimestampTz
+job_window_release(JobCacheEntry *entry, TimestampTz release)
+{
+	pg_time_t 	planned;
+
+	if (entry->window_id == 0)
+		return release;
+	planned = window_plan_run(entry->window_id, entry->predicted_duration,
+							  timestamptz_to_time_t(release));
+	return Max(release, time_t_to_timestamptz(planned));
+}
+
+/* The number of jobs running for the given database and/or role, NULL matches any */
+static int
+running_jobs(const char *datname, const char *rolname)
+{
+	int 	i;
+	int 	result = 0;
+
+	for (i = 0; i < launcher_max_workers; i++)
+	{
+		if (wstate[i].handle == NULL || (wstate[i].pooled && !wstate[i].busy))
+			continue;
+		if (datname != NULL && strcmp(wstate[i].job.datname, datname) != 0)
+			continue;
+		if (rolname != NULL && strcmp(wstate[i].job.rolname, rolname) != 0)
+			continue;
+		result++;
+	}
+	return result;
+}
+
+/* Whether a job for the given database and role stays within the concurrency caps */
+static bool
+job_admitted(const char *datname, const char *rolname)
+{
+	if (launcher_max_workers_per_database > 0 &&
+		running_jobs(datname, NULL) >= launcher_max_workers_per_database)
+		return false;
+	if (launcher_max_workers_per_role > 0 &&
+		running_jobs(NULL, rolname) >= launcher_max_workers_per_role)
+		return false;
+	return true;
+}
+
+static int
+database_load(const char *datname)
+{
+	return running_jobs(datname, NULL);
+}
+
+/* Whether a run of the given job is executing */
+static bool
+job_running(uint32 job_id)
+{
+	int 	i;
+
+	for (i = 0; i < launcher_max_workers; i++)
+	{
+		if (wstate[i].handle == NULL || (wstate[i].pooled && !wstate[i].busy))
+			continue;
+		if (wstate[i].job_id == job_id)
+			return true;
+	}
+	return false;
+}
+
+/*
+ * Queue a run of a job which is due. A job which runs for every moment it was
+ * due is queued for each of them, any other job is queued once. Returns false
+ * if the run was not queued.
+ */
+static bool
+queue_job_run(JobCacheEntry *entry, pg_time_t due_at)
+{
+	if (!dispatch_queue_add(entry->job_id, due_at, entry->priority, entry->datname, entry->rolname,
+							job_window_release(entry, job_release_time(entry, due_at)),
+							entry->misfire == MISFIRE_ALL))
+		return false;
+	run_queue_claim(entry->job_id, due_at);
+	return true;
+}
+
+/*
+ * Queue a run of a job which should start right away rather than according to
+ * its schedule. The run is released immediately, it is not spread, but it waits
+ * for the maintenance window of the job unless in_window is false. Returns
+ * false if a run of the job is waiting for a worker slot already.
+ */
+static bool
+queue_immediate_run(JobCacheEntry *entry, bool in_window)
+{
+	pg_time_t 	now = (pg_time_t) time(NULL);
+	TimestampTz release = GetCurrentTimestamp();
+
+	if (in_window)
+		release = job_window_release(entry, release);
+	if (!dispatch_queue_add(entry->job_id, now, entry->priority, entry->datname, entry->rolname,
+							release, false))
+		return false;
+	run_queue_claim(entry->job_id, now);
+	return true;
+}
+
+/*
+ * A job or task has finished, its outcome goes to the job log. The jobs depending
+ * on a job which succeeded are queued right away once all of their upstream jobs
+ * have succeeded, they are launched at the end of the current wakeup.
+ */
+static void
+job_completed(JobDesc *job, JobResult *result)
+{
+	JobCacheEntry  *entry;
+	List 	   *ready;
+	ListCell   *lc;
+
+	job_log_add(job, result);
+
+	if (job->task_id != 0 || strcmp(result->sqlstate, "00000") != 0)
+		return;
+
+	/* Keep the predicted duration of a job in a maintenance window close to its recent runs */
+	entry = job_cache_lookup(job->job_id);
+	if (entry != NULL && entry->window_id != 0)
+	{
+		long 	secs;
+		int 	microsecs;
+
+		TimestampDifference(result->started, result->stopped, &secs, &microsecs);
+		if (entry->predicted_duration == 0)
+			entry->predicted_duration = (uint32) secs;
+		else
+			entry->predicted_duration = (3 * entry->predicted_duration + (uint32) secs) / 4;
+	}
+
+	ready = job_cache_upstream_succeeded(job->job_id);
+	foreach(lc, ready)
+	{
+		entry = lfirst(lc);
+
+		if (queue_immediate_run(entry, true))
+			elog(DEBUG1, "job %d is queued, the jobs it depends on have succeeded", entry->job_id);
+		else
+			elog(DEBUG1, "job %d is ready while it is still waiting for a worker", entry->job_id);
+	}
+	list_free(ready);
+}
+
+/* Queue a run for every job triggered with trigger_job since the previous call */
+static void
+queue_triggered_jobs()
+{
+	uint32 			triggered[JOB_TRIGGER_QUEUE_SIZE];
+	int 			ntriggered;
+	int 			i;
+
+	ntriggered = fetch_job_triggers(triggered);
+	for (i = 0; i < ntriggered; i++)
+	{
+		JobCacheEntry  *entry = job_cache_lookup(triggered[i]);
+
+		/* Disabled or deleted since it was triggered */
+		if (entry == NULL)
+			continue;
+		if (!queue_immediate_run(entry, false))
+			elog(DEBUG1, "job %d is triggered while it is still waiting for a worker", entry->job_id);
+	}
+}
+
+/*
+ * Read the due tasks from the task table into the dispatch queue, when tasks
+ * have been enqueued or became due, and the launcher is not holding a full
+ * batch of waiting tasks already.
+ */
+static void
+queue_due_tasks()
+{
+	TimestampTz 	current = GetCurrentTimestamp();
+	ListCell 	   *lc;
+
+	if (fetch_tasks_enqueued())
+		task_queue_notify();
+	if (!task_queue_wanted(current))
+		return;
+
+	SetCurrentStatementStartTimestamp();
+	StartTransactionCommand();
+	SPI_connect();
+	PushActiveSnapshot(GetTransactionSnapshot());
+
+	pgstat_report_activity(STATE_RUNNING, "reading the task queue");
+
+	foreach(lc, task_queue_load(schema_name))
+	{
+		Task 	   *task = lfirst(lc);
+
+		dispatch_queue_add_task(task->task_id, task->datname, task->rolname, current);
+	}
+
+	SPI_finish();
+	PopActiveSnapshot();
+	CommitTransactionCommand();
+
+	pgstat_report_activity(STATE_IDLE, NULL);
+}
+
+/*
+ * Queue the runs left in the job run queue by the previous launcher, and the
+ * runs missed while no launcher was running according to the misfire policy of
+ * every job. Must be called after the job cache has been loaded, before the next
+ * runs of the jobs are written.
+ */
+static void
+recover_job_runs()
+{
+	ListCell 	   *lc;
+	int 			nqueued = 0;
+	int 			nmissed = 0;
+
+	SetCurrentStatementStartTimestamp();
+	StartTransactionCommand();
+	SPI_connect();
+	PushActiveSnapshot(GetTransactionSnapshot());
+
+	pgstat_report_activity(STATE_RUNNING, "recovering the job runs");
+
+	/* The runs in the queue are released right away, the ones of a disabled job are dropped */
+	foreach(lc, run_queue_load(schema_name))
+	{
+		JobRun 		   *run = lfirst(lc);
+		JobCacheEntry  *entry = job_cache_lookup(run->job_id);
+
+		if (entry != NULL &&
+			dispatch_queue_add(entry->job_id, run->due_at, entry->priority, entry->datname, entry->rolname,
+							   job_window_release(entry, time_t_to_timestamptz(run->due_at)),
+							   entry->misfire == MISFIRE_ALL))
+			nqueued++;
+		else
+			run_queue_started(run->job_id, run->due_at);
+	}
+
+	foreach(lc, job_cache_missed_runs(job_table.schema, job_table.name, (pg_time_t) time(NULL)))
+	{
+		JobRun 		   *run = lfirst(lc);
+		JobCacheEntry  *entry = job_cache_lookup(run->job_id);
+
+		/* In the queue already */
+		if (!run_queue_claim(run->job_id, run->due_at))
+			continue;
+		if (dispatch_queue_add(entry->job_id, run->due_at, entry->priority, entry->datname, entry->rolname,
+							   job_window_release(entry, time_t_to_timestamptz(run->due_at)),
+							   entry->misfire == MISFIRE_ALL))
+			nmissed++;
+		else
+			run_queue_started(run->job_id, run->due_at);
+	}
+
+	if (nqueued > 0 || nmissed > 0)
+		elog(LOG, "queued %d job runs left by the previous launcher and %d missed runs", nqueued, nmissed);
+
+	SPI_finish();
+	PopActiveSnapshot();
+	CommitTransactionCommand();
+
+	pgstat_report_activity(STATE_IDLE, NULL);
+}
+
+/* Check if there are jobs scheduled to run and spawn worker subprocesses to run them. */
+static void run_scheduled_jobs()
+{
+	ListCell  	   *lc;
+	List 		   *due_jobs;
+	pg_time_t 		now = (pg_time_t) time(NULL);
+	TimestampTz 	current;
+	JobRun 			run;
+	JobDesc 	   *job_desc = NULL;
+
+	refresh_job_cache(false);
+
+	/* The schedules are evaluated from the cache, this requires no database access */
+	due_jobs = job_cache_due_jobs(now);
+	foreach(lc, due_jobs)
+	{
+		JobCacheEntry  *entry = lfirst(lc);
+
+		/* The job cache sets last_dispatched to the moment the job was due */
+		if (!queue_job_run(entry, entry->last_dispatched))
+			elog(DEBUG1, "job %d is due while it is still waiting for a worker", entry->job_id);
+	}
+	list_free(due_jobs);
+
+	queue_triggered_jobs();
+	queue_due_tasks();
+
+	admission_reset();
+	admission_recheck = 0;
+
+	/*
+	 * Now launch the child processes for the jobs which have been released.
+	 * Launching does not wait for the workers to start, so a burst of due jobs
+	 * is dispatched in a single pass, unless max_launch_rate says otherwise.
+	 * The jobs which do not get a worker slot stay queued until a worker stops.
+	 */
+	current = GetCurrentTimestamp();
+	while (dispatch_queue_next(current, launcher_max_launch_rate, job_admitted, database_load, &run))
+	{
+		bool 			dispatched;
+
+		if (job_desc == NULL)
+			job_desc = palloc(sizeof(JobDesc));
+
+		if (run.task_id != 0)
+		{
+			Task 	   *task = task_queue_lookup(run.task_id);
+
+			fill_job_description(job_desc, 0, 0, task->datname, task->rolname,
+								 schema_name, true, TASK_TIMEOUT, task->command);
+			job_desc->task_id = task->task_id;
+		}
+		else
+		{
+			JobCacheEntry  *entry = job_cache_lookup(run.job_id);
+
+			/* Disabled or deleted while waiting to be released */
+			if (entry == NULL)
+			{
+				run_queue_started(run.job_id, run.due_at);
+				continue;
+			}
+
+			/* Every run of the job is wanted, this one waits for the previous one to finish */
+			if (entry->misfire == MISFIRE_ALL && !entry->parallel && job_running(entry->job_id))
+			{
+				dispatch_queue_defer();
+				continue;
+			}
+
+			/* Released in its maintenance window, which may have closed or become too short since */
+			if (entry->window_id != 0 &&
+				!window_allows_run(entry->window_id, entry->predicted_duration, now))
+			{
+				pg_time_t 	release = window_plan_run(entry->window_id, entry->predicted_duration, now);
+
+				if (release > now)
+				{
+					elog(DEBUG1, "job %d waits for its maintenance window", entry->job_id);
+					if (!dispatch_queue_add(entry->job_id, run.due_at, entry->priority, entry->datname,
+											entry->rolname, time_t_to_timestamptz(release),
+											entry->misfire == MISFIRE_ALL))
+						run_queue_started(run.job_id, run.due_at);
+					continue;
+				}
+			}
+
+			/* A deferrable job is held while the cluster is busy, but not forever */
+			if (entry->deferrable && now < run.due_at + launcher_max_defer_time)
+			{
+				const char *reason = admission_hold(entry, &admission_limits);
+
+				if (reason != NULL)
+				{
+					elog(DEBUG1, "job %d is held back: %s", entry->job_id, reason);
+					dispatch_queue_defer();
+					admission_recheck = TimestampTzPlusMilliseconds(current, ADMISSION_RECHECK_INTERVAL);
+					continue;
+				}
+			}
+
+			fill_job_description(job_desc, entry->job_id, 0, entry->datname, entry->rolname,
+								 schema_name, entry->parallel, entry->job_timeout, entry->command);
+			job_desc->batch_size = entry->batch_size;
+			job_desc->batch_delay = entry->batch_delay;
+			job_desc->cost_limit = entry->cost_limit > 0 ? entry->cost_limit : launcher_job_cost_limit;
+			job_desc->cost_delay = entry->cost_delay >= 0 ? entry->cost_delay : launcher_job_cost_delay;
+		}
+
+		if (launcher_pool_mode)
+			dispatched = dispatch_pooled_job(job_desc, run.due_at);
+		else
+			dispatched = dispatch_job(job_desc, run.due_at);
+
+		if (!dispatched)
+		{
+			dispatch_queue_putback();
+			elog(DEBUG1, "no worker could be started, %d jobs are waiting",
+				 dispatch_queue_length());
+			break;
+		}
+		if (run.task_id != 0)
+			task_queue_started(run.task_id);
+		else
+			run_queue_started(run.job_id, run.due_at);
+	}
+	dispatch_queue_restore();
+	if (job_desc != NULL)
+		pfree(job_desc);
+
+	write_run_state();
+}
+
+/* Milliseconds from now until the given moment, at most launcher_naptime */
+static long
+launcher_sleep_until(TimestampTz wakeup)
+{
+	long 		secs;
+	int 		microsecs;
+
+	TimestampDifference(GetCurrentTimestamp(), wakeup, &secs, &microsecs);
+	if (secs >= launcher_naptime / 1000)
+		return launcher_naptime;
+
+	/* Round up, so we do not wake up just before the moment */
+	return secs * 1000 + (microsecs + 999) / 1000;
+}
+
+/*
+ * Compute how long to sleep until the first job in the timer queue is due, a
+ * queued job may be released, a task becomes due, a job held back because the cluster is busy
+ * should be looked at again, or the pending job log entries or job counters have to be written.
+ * We never sleep longer than launcher_naptime, to protect against clock jumps.
+ */
+static long
+launcher_sleep_time()
+{
+	pg_time_t 	next_fire = job_cache_next_fire();
+	TimestampTz oldest_result = job_log_oldest();
+	TimestampTz next_release = dispatch_queue_wakeup(GetCurrentTimestamp(), launcher_max_launch_rate);
+	TimestampTz next_task = task_queue_next_due();
+	long 		result = launcher_naptime;
+
+	if (admission_recheck != 0)
+		result = Min(result, launcher_sleep_until(admission_recheck));
+
+	if (next_fire != SCHEDULE_NEVER)
+		result = Min(result, launcher_sleep_until(time_t_to_timestamptz(next_fire)));
+	if (next_release != 0)
+		result = Min(result, launcher_sleep_until(next_release));
+	if (next_task != 0)
+		result = Min(result, launcher_sleep_until(next_task));
+	if (oldest_result != 0)
+		result = Min(result, launcher_sleep_until(TimestampTzPlusMilliseconds(oldest_result,
+																			   launcher_log_flush_delay)));
+	result = Min(result, launcher_sleep_until(time_t_to_timestamptz(next_counter_flush)));
+	return result;
+}
+
+/* One pass of the launcher after a wakeup: collect the outcomes, write what is due and launch the due jobs */
+static void
+launcher_pass()
+{
+	if (got_sigusr1)
+	{
+		got_sigusr1 = false;
+		check_for_terminated_workers();
+	}
+	collect_pool_results();
+	write_job_log(false);
+	write_job_counters(false);
+	/* The job log is shared, the first launcher maintains it */
+	if (launcher_number == 0)
+		maintain_job_log();
+	retire_idle_pool_workers();
+	run_scheduled_jobs();
+}
+
+void
+launcher_main(Datum main_arg)
+{
+	MemoryContext 	launcher_cxt;
+
+	launcher_number = DatumGetInt32(main_arg);
+
+	/* Setup signal handlers */
+	pqsignal(SIGHUP, launcher_sighup);
+	pqsignal(SIGTERM, launcher_sigterm);
+	pqsignal(SIGUSR1, launcher_sigusr1);
+
+	/* Allow signals after the signal handlers have been established */
+	BackgroundWorkerUnblockSignals();
+
+	init_launcher();
+	BackgroundWorkerInitializeConnection(launcher_database, NULL);
+	launcher_get_extension_schema(EXTENSION_NAME);
+	init_table_names();
+
+	/* Listen to job changes before loading the jobs, so that we won't miss any */
+	launcher_attach_shared_state(launcher_number);
+	job_cache_init();
+	refresh_job_cache(true);
+	recover_job_runs();
 	elog(LOG, "entering main loop");
+	launcher_cxt = CurrentMemoryContext;
 
 	/* loop until SIGTERM will command us to exit */
 	while (!got_sigterm)
 	{
-		int 	ret;
 		int 	rc;
 
 		/*
-		 * Sleep on a latch until we are signaled, timed out or the postmaster dies.
-		 * Default sleep interval is 0.5 second so that we'll be able to check the job
-		 * schedule every second.
+		 * Sleep on a latch until we are signaled, the next job is due or the postmaster
+		 * dies. Job changes and terminating workers set our latch.
 		 */
 		 rc = WaitLatch(&MyProc->procLatch,
 		 				WL_LATCH_SET | WL_TIMEOUT | WL_POSTMASTER_DEATH,
-		 				launcher_naptime);
+		 				launcher_sleep_time());
 		 ResetLatch(&MyProc->procLatch);
 
 		 /* Emergency exit */
@@ -481,15 +1462,42 @@ Datum launcher_main(PG_FUNCTION_ARGS)
 		 {
 		 	got_sighup = false;
 		 	ProcessConfigFile(PGC_SIGHUP);
+		 	/* The time zone may have changed */
+		 	job_cache_reschedule();
+		 	/* And so may the retention of the job log */
+		 	next_log_maintenance = 0;
 		 }
 
-		 if (got_sigusr1)
+		 /*
+		  * An error in a pass, say a failing write to the job log, aborts the pass
+		  * but not the launcher: it would lose track of the workers it is running.
+		  * What was not written is written by the next pass.
+		  */
+		 PG_TRY();
 		 {
-		 	got_sigusr1 = false;
-		 	check_for_terminated_workers();
+		 	launcher_pass();
 		 }
-		 run_scheduled_jobs();
+		 PG_CATCH();
+		 {
+		 	HOLD_INTERRUPTS();
+		 	MemoryContextSwitchTo(launcher_cxt);
+		 	EmitErrorReport();
+		 	FlushErrorState();
+		 	AbortOutOfAnyTransaction();
+		 	/* The runs set aside by the aborted pass are waiting again */
+		 	dispatch_queue_restore();
+		 	RESUME_INTERRUPTS();
+		 	pgstat_report_activity(STATE_IDLE, NULL);
+		 	pg_usleep(LAUNCHER_ERROR_DELAY * 1000L);
+		 }
+		 PG_END_TRY();
 	}
+
+	/* Do not lose the outcomes of the jobs that have finished */
+	check_for_terminated_workers();
+	collect_pool_results();
+	write_job_log(true);
+	write_job_counters(true);
 }
 
 static bool
@@ -500,10 +1508,24 @@ check_launcher_max_workers(int *newval, void **extra, GucSource source)
 	return true;
 }
 
+/* Every launcher is a worker process itself, and may run max_workers workers */
+static bool
+check_launcher_count(int *newval, void **extra, GucSource source)
+{
+	if (*newval * (launcher_max_workers + 1) > max_worker_processes)
+	{
+		GUC_check_errdetail("%d launchers with %d workers each need more than max_worker_processes (%d).",
+							*newval, launcher_max_workers, max_worker_processes);
+		return false;
+	}
+	return true;
+}
+
 /* Entry point for the shared library, start the launcher process */
 void _PG_init(void)
 {
 	BackgroundWorker 	worker;
+	int 				i;
 
 	/* Should be started from the postgresql.conf */
 	if (!process_shared_preload_libraries_in_progress)
@@ -523,19 +1545,225 @@ void _PG_init(void)
 							NULL,
 							NULL);
 
-	DefineCustomIntVariable("elephant_worker.launcher_naptime",
-							"time in ms that launcher sleeps before checking for jobs",
+	DefineCustomIntVariable("elephant_worker.launchers",
+							"number of launcher processes, each one schedules a partition of the jobs",
+							"The jobs and tasks are partitioned on their id modulo the number of launchers. "
+							"max_workers and the other limits apply to every launcher.",
+							&launcher_count,
+							1,
+							1,
+							MAX_LAUNCHERS,
+							PGC_POSTMASTER,
+							0,
+							check_launcher_count,
 							NULL,
+							NULL);
+
+	DefineCustomIntVariable("elephant_worker.launcher_naptime",
+							"maximum time in ms that launcher sleeps before checking for jobs",
+							"The launcher wakes up when the next job is due, or after this interval if that is sooner.",
 							&launcher_naptime,
-							500,
+							60000,
 							100,
-							900,
+							3600000,
 							PGC_SIGHUP,
 							0,
 							NULL,
 							NULL,
 							NULL);
 
+	DefineCustomBoolVariable("elephant_worker.pool_mode",
+							 "run jobs in long-lived pooled workers per database and role",
+							 NULL,
+							 &launcher_pool_mode,
+							 false,
+							 PGC_SIGHUP,
+							 0,
+							 NULL,
+							 NULL,
+							 NULL);
+
+	DefineCustomIntVariable("elephant_worker.pool_idle_timeout",
+							"time in s after which an idle pooled worker exits",
+							NULL,
+							&launcher_pool_idle_timeout,
+							300,
+							1,
+							86400,
+							PGC_SIGHUP,
+							GUC_UNIT_S,
+							NULL,
+							NULL,
+							NULL);
+
+	DefineCustomIntVariable("elephant_worker.log_flush_delay",
+							"maximum time in ms the outcome of a job waits before it is written to the job log",
+							"The launcher writes the job log in batches, a full batch is written right away.",
+							&launcher_log_flush_delay,
+							1000,
+							0,
+							3600000,
+							PGC_SIGHUP,
+							GUC_UNIT_MS,
+							NULL,
+							NULL,
+							NULL);
+
+	DefineCustomIntVariable("elephant_worker.log_retention",
+							"time after which the job log of a day is dropped, 0 keeps it forever",
+							"The job log is partitioned by day, expired days are dropped by the launcher.",
+							&launcher_log_retention,
+							30 * 24 * 60,
+							0,
+							INT_MAX,
+							PGC_SIGHUP,
+							GUC_UNIT_MIN,
+							NULL,
+							NULL,
+							NULL);
+
+	DefineCustomIntVariable("elephant_worker.counter_flush_interval",
+							"time in s between writes of the job counters to the job table",
+							"The success and failure counters are kept in shared memory, the job_counters view shows their live values.",
+							&launcher_counter_flush_interval,
+							60,
+							1,
+							86400,
+							PGC_SIGHUP,
+							GUC_UNIT_S,
+							NULL,
+							NULL,
+							NULL);
+
+	DefineCustomIntVariable("elephant_worker.spread_window",
+							"time in s over which the jobs due in the same minute are spread, 0 disables spreading",
+							"Every job gets a fixed offset within the window, derived from its job_id.",
+							&launcher_spread_window,
+							0,
+							0,
+							3600,
+							PGC_SIGHUP,
+							GUC_UNIT_S,
+							NULL,
+							NULL,
+							NULL);
+
+	DefineCustomIntVariable("elephant_worker.max_launch_rate",
+							"maximum number of jobs launched per second, 0 means unlimited",
+							"Jobs which are due wait in the launcher until they may be launched.",
+							&launcher_max_launch_rate,
+							0,
+							0,
+							100000,
+							PGC_SIGHUP,
+							0,
+							NULL,
+							NULL,
+							NULL);
+
+	DefineCustomIntVariable("elephant_worker.max_workers_per_database",
+							"maximum number of jobs running at the same time for a database, 0 means no limit",
+							"Jobs over the limit wait in the launcher, the worker slots are shared fairly among the databases.",
+							&launcher_max_workers_per_database,
+							0,
+							0,
+							MAX_BACKENDS,
+							PGC_SIGHUP,
+							0,
+							NULL,
+							NULL,
+							NULL);
+
+	DefineCustomIntVariable("elephant_worker.max_workers_per_role",
+							"maximum number of jobs running at the same time for a role, 0 means no limit",
+							NULL,
+							&launcher_max_workers_per_role,
+							0,
+							0,
+							MAX_BACKENDS,
+							PGC_SIGHUP,
+							0,
+							NULL,
+							NULL,
+							NULL);
+
+	DefineCustomIntVariable("elephant_worker.job_cost_limit",
+							"the cost of the buffer accesses of a batch which is worth job_cost_delay of sleep",
+							"Buffer hits, misses and dirtied pages are charged like vacuum_cost_page_hit, vacuum_cost_page_miss and vacuum_cost_page_dirty. "
+							"Only jobs with a batch_size are throttled, between their batches.",
+							&launcher_job_cost_limit,
+							200,
+							1,
+							10000,
+							PGC_SIGHUP,
+							0,
+							NULL,
+							NULL,
+							NULL);
+
+	DefineCustomIntVariable("elephant_worker.job_cost_delay",
+							"time in ms a batch job sleeps after a batch for every job_cost_limit it has spent, 0 disables it",
+							NULL,
+							&launcher_job_cost_delay,
+							0,
+							0,
+							1000,
+							PGC_SIGHUP,
+							GUC_UNIT_MS,
+							NULL,
+							NULL,
+							NULL);
+
+	DefineCustomIntVariable("elephant_worker.defer_max_active",
+							"number of active client backends from which deferrable jobs are held, 0 means no limit",
+							NULL,
+							&admission_limits.max_active,
+							0,
+							0,
+							MAX_BACKENDS,
+							PGC_SIGHUP,
+							0,
+							NULL,
+							NULL,
+							NULL);
+
+	DefineCustomIntVariable("elephant_worker.defer_connection_reserve",
+							"number of connections which must be left free for a deferrable job to start",
+							"Applies to max_connections and to the connection limits of the database and role of the job.",
+							&admission_limits.connection_reserve,
+							0,
+							0,
+							MAX_BACKENDS,
+							PGC_SIGHUP,
+							0,
+							NULL,
+							NULL,
+							NULL);
+
+	DefineCustomBoolVariable("elephant_worker.defer_during_checkpoint",
+							 "hold deferrable jobs while a checkpoint is in progress",
+							 NULL,
+							 &admission_limits.during_checkpoint,
+							 false,
+							 PGC_SIGHUP,
+							 0,
+							 NULL,
+							 NULL,
+							 NULL);
+
+	DefineCustomIntVariable("elephant_worker.max_defer_time",
+							"maximum time in s a deferrable job is held after it was due",
+							"After that the job starts, however busy the cluster is.",
+							&launcher_max_defer_time,
+							300,
+							0,
+							86400,
+							PGC_SIGHUP,
+							GUC_UNIT_S,
+							NULL,
+							NULL,
+							NULL);
+
 	DefineCustomStringVariable("elephant_worker.database",
 							   "database system to run the extension in",
 							   NULL,
@@ -547,14 +1775,25 @@ void _PG_init(void)
 							   NULL,
 							   NULL);
 
-   /* Setup common flags for the launcher */
+	/* The job slots are sized by max_workers, so it must be known by now */
+	request_shared_state(launcher_count, launcher_count * launcher_max_workers);
+
+   /* Setup common flags for the launchers */
    worker.bgw_flags = BGWORKER_SHMEM_ACCESS | BGWORKER_BACKEND_DATABASE_CONNECTION;
    worker.bgw_start_time = BgWorkerStart_RecoveryFinished;
    worker.bgw_main = launcher_main;
    worker.bgw_notify_pid = 0;
-   snprintf(worker.bgw_name, BGW_MAXLEN, PROCESS_NAME);
-   worker.bgw_main_arg = (Datum) 0;
-   worker.bgw_restart_time = BGW_NEVER_RESTART;
-
-   RegisterBackgroundWorker(&worker);
+   /* A launcher which exits with an error is started again, its due runs are kept in the job run queue */
+   worker.bgw_restart_time = LAUNCHER_RESTART_TIME;
+
+   for (i = 0; i < launcher_count; i++)
+   {
+	   if (launcher_count == 1)
+		   snprintf(worker.bgw_name, BGW_MAXLEN, PROCESS_NAME);
+	   else
+		   snprintf(worker.bgw_name, BGW_MAXLEN, PROCESS_NAME " %d", i);
+	   worker.bgw_main_arg = Int32GetDatum(i);
+
+	   RegisterBackgroundWorker(&worker);
+   }
 }
@@ -0,0 +1,34 @@
+/* ------------------------------------------------------------------------
+ * pool.h
+ *  	Definitions shared by the launcher and the pooled worker processes.
+ *
+ * Copyright (c) 2014, Zalando SE.
+ * Portions Copyright (C) 2013-2014, PostgreSQL Global Development Group
+ * ------------------------------------------------------------------------
+ */
+
+#ifndef _POOL_H
+#define _POOL_H
+
+#include "postgres.h"
+
+/* Identifier for the shared memory segments of pooled workers */
+#define POOL_SHM_MAGIC 			0x6a6f6273
+/* Large enough to hold a job description or a job result */
+#define POOL_QUEUE_SIZE 		65536
+
+/* Keys in the table of contents of a pooled worker's segment */
+#define POOL_KEY_HEADER 		0
+#define POOL_KEY_JOB_QUEUE 		1
+#define POOL_KEY_RESULT_QUEUE 	2
+
+/* The database and role a pooled worker is serving */
+typedef struct PoolHeader
+{
+	char 	datname[NAMEDATALEN];
+	char 	rolname[NAMEDATALEN];
+} PoolHeader;
+
+/* A pooled worker sends a JobResult back to the launcher after every job */
+
+#endif /* _POOL_H */
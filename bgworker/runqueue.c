@@ -0,0 +1,271 @@
+/* ------------------------------------------------------------------------
+ * runqueue.c
+ *  	Keeps track of the job runs which are due but have not been started,
+ * 		because they wait for their release moment or for a worker slot.
+ * 		They are written to the job_run_queue table, together with the next
+ * 		runs of the jobs, so that a restarted launcher picks them up again.
+ *
+ * 		Most runs are started in the same pass of the launcher in which they
+ * 		are claimed. Those are never written: only the runs still waiting
+ * 		when the launcher writes its state are inserted, and deleted once
+ * 		they have been started.
+ *
+ * Copyright (c) 2014, Zalando SE.
+ * Portions Copyright (C) 2013-2014, PostgreSQL Global Development Group
+ * ------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+
+#include "catalog/pg_type.h"
+#include "executor/spi.h"
+#include "lib/stringinfo.h"
+#include "utils/array.h"
+#include "utils/builtins.h"
+#include "utils/hsearch.h"
+#include "utils/lsyscache.h"
+#include "utils/memutils.h"
+#include "utils/timestamp.h"
+
+/* Our own include files */
+#include "runqueue.h"
+#include "shared.h"
+
+typedef struct RunKey
+{
+	pg_time_t 	due_at;
+	uint32 		job_id;
+	uint32 		padding; 		/* zeroed, the key is hashed as a whole */
+} RunKey;
+
+typedef struct QueuedRun
+{
+	RunKey 		key; 			/* hash key, must be first */
+	bool 		written; 		/* present in the job_run_queue table */
+} QueuedRun;
+
+static MemoryContext 	run_queue_context = NULL;
+static HTAB 		   *queued_runs = NULL;
+/* The runs claimed and the written runs started since the last write */
+static List 		   *claimed_runs = NIL;
+static List 		   *started_runs = NIL;
+
+
+static void
+run_queue_init(void)
+{
+	HASHCTL 	ctl;
+
+	run_queue_context = AllocSetContextCreate(TopMemoryContext,
+											  "elephant run queue",
+											  ALLOCSET_DEFAULT_MINSIZE,
+											  ALLOCSET_DEFAULT_INITSIZE,
+											  ALLOCSET_DEFAULT_MAXSIZE);
+
+	memset(&ctl, 0, sizeof(ctl));
+	ctl.keysize = sizeof(RunKey);
+	ctl.entrysize = sizeof(QueuedRun);
+	ctl.hash = tag_hash;
+	ctl.hcxt = run_queue_context;
+	queued_runs = hash_create("elephant queued runs", 1024, &ctl,
+							  HASH_ELEM | HASH_FUNCTION | HASH_CONTEXT);
+}
+
+static void
+run_key(RunKey *key, uint32 job_id, pg_time_t due_at)
+{
+	memset(key, 0, sizeof(RunKey));
+	key->job_id = job_id;
+	key->due_at = due_at;
+}
+
+/* Remember a run of a job in one of the lists of changes */
+static void
+run_queue_remember(List **runs, const RunKey *key)
+{
+	MemoryContext 	oldcxt = MemoryContextSwitchTo(run_queue_context);
+	RunKey 		   *copy = palloc(sizeof(RunKey));
+
+	memcpy(copy, key, sizeof(RunKey));
+	*runs = lappend(*runs, copy);
+	MemoryContextSwitchTo(oldcxt);
+}
+
+/*
+ * Register a run which is due. Returns false if the run is known already, for
+ * example because it was picked up from the job_run_queue table.
+ */
+bool
+run_queue_claim(uint32 job_id, pg_time_t due_at)
+{
+	QueuedRun  *run;
+	RunKey 		key;
+	bool 		found;
+
+	if (run_queue_context == NULL)
+		run_queue_init();
+
+	run_key(&key, job_id, due_at);
+	run = hash_search(queued_runs, &key, HASH_ENTER, &found);
+	if (found)
+		return false;
+
+	run->written = false;
+	run_queue_remember(&claimed_runs, &key);
+	return true;
+}
+
+/* A run has been handed to a worker, or will never be because its job is gone */
+void
+run_queue_started(uint32 job_id, pg_time_t due_at)
+{
+	QueuedRun  *run;
+	RunKey 		key;
+
+	if (run_queue_context == NULL)
+		return;
+
+	run_key(&key, job_id, due_at);
+	run = hash_search(queued_runs, &key, HASH_FIND, NULL);
+	if (run == NULL)
+		return;
+
+	if (run->written)
+		run_queue_remember(&started_runs, &key);
+	hash_search(queued_runs, &key, HASH_REMOVE, NULL);
+}
+
+/* Whether the job_run_queue table has to be brought up to date */
+bool
+run_queue_changed(void)
+{
+	return claimed_runs != NIL || started_runs != NIL;
+}
+
+/* Execute a statement taking the job ids and due moments of the given runs as its parameters */
+static void
+run_queue_execute(const char *query, List *runs, int expected)
+{
+	ArrayBuildState *job_ids = NULL;
+	ArrayBuildState *due_ats = NULL;
+	Oid 			argtypes[2];
+	Datum 			values[2];
+	ListCell 	   *lc;
+
+	foreach(lc, runs)
+	{
+		RunKey 	   *key = lfirst(lc);
+
+		job_ids = accumArrayResult(job_ids, Int32GetDatum((int32) key->job_id), false, INT4OID, CurrentMemoryContext);
+		due_ats = accumArrayResult(due_ats, TimestampTzGetDatum(time_t_to_timestamptz(key->due_at)), false,
+								   TIMESTAMPTZOID, CurrentMemoryContext);
+	}
+
+	argtypes[0] = INT4ARRAYOID;
+	argtypes[1] = get_array_type(TIMESTAMPTZOID);
+	values[0] = makeArrayResult(job_ids, CurrentMemoryContext);
+	values[1] = makeArrayResult(due_ats, CurrentMemoryContext);
+
+	if (SPI_execute_with_args(query, 2, argtypes, values, NULL, false, 0) != expected)
+		elog(ERROR, "could not write %d runs to the job run queue", list_length(runs));
+}
+
+/*
+ * Insert the runs claimed since the previous call which have not been started
+ * yet, and delete the written runs which have been started since.
+ * Must be called inside a transaction with SPI connected.
+ */
+void
+run_queue_write(const char *schema)
+{
+	StringInfoData 	buf;
+	List 		   *inserts = NIL;
+	ListCell 	   *lc;
+
+	foreach(lc, claimed_runs)
+	{
+		QueuedRun  *run = hash_search(queued_runs, lfirst(lc), HASH_FIND, NULL);
+
+		/* Started in the meantime */
+		if (run == NULL)
+			continue;
+		run->written = true;
+		inserts = lappend(inserts, lfirst(lc));
+	}
+
+	initStringInfo(&buf);
+	if (started_runs != NIL)
+	{
+		appendStringInfo(&buf, "DELETE FROM %s.%s queue "
+								"USING unnest($1, $2) AS r(job_id, due_at) "
+								"WHERE queue.job_id = r.job_id "
+								  "AND queue.due_at = r.due_at",
+								quote_identifier(schema), RUN_QUEUE_RELNAME);
+		run_queue_execute(buf.data, started_runs, SPI_OK_DELETE);
+	}
+	if (inserts != NIL)
+	{
+		resetStringInfo(&buf);
+		appendStringInfo(&buf, "INSERT INTO %s.%s (job_id, due_at) "
+								"SELECT * FROM unnest($1, $2) AS r(job_id, due_at) "
+								"WHERE NOT EXISTS (SELECT 1 FROM %s.%s queue "
+												   "WHERE queue.job_id = r.job_id "
+													 "AND queue.due_at = r.due_at)",
+								quote_identifier(schema), RUN_QUEUE_RELNAME,
+								quote_identifier(schema), RUN_QUEUE_RELNAME);
+		run_queue_execute(buf.data, inserts, SPI_OK_INSERT);
+	}
+	elog(DEBUG1, "queued %d job runs and removed %d from the job run queue",
+		 list_length(inserts), list_length(started_runs));
+
+	pfree(buf.data);
+	list_free(inserts);
+	list_free_deep(claimed_runs);
+	list_free_deep(started_runs);
+	claimed_runs = NIL;
+	started_runs = NIL;
+}
+
+/*
+ * Pick up the runs left in the job_run_queue table by a previous launcher. They
+ * are known as written, the caller should claim them again through the dispatch
+ * queue. The result is allocated in the current memory context.
+ * Must be called inside a transaction with SPI connected.
+ */
+List *
+run_queue_load(const char *schema)
+{
+	StringInfoData 	buf;
+	List 		   *result = NIL;
+	int 			i;
+
+	if (run_queue_context == NULL)
+		run_queue_init();
+
+	initStringInfo(&buf);
+	appendStringInfo(&buf, "SELECT job_id, due_at FROM %s.%s WHERE true%s ORDER BY due_at",
+					 quote_identifier(schema), RUN_QUEUE_RELNAME, launcher_partition_filter("job_id"));
+	if (SPI_execute(buf.data, true, 0) != SPI_OK_SELECT)
+		elog(ERROR, "could not read the job run queue");
+
+	for (i = 0; i < SPI_processed; i++)
+	{
+		HeapTuple 	tuple = SPI_tuptable->vals[i];
+		TupleDesc 	tupdesc = SPI_tuptable->tupdesc;
+		JobRun 	   *run = palloc0(sizeof(JobRun));
+		QueuedRun  *queued;
+		RunKey 		key;
+		bool 		isnull;
+
+		run->job_id = DatumGetInt32(SPI_getbinval(tuple, tupdesc, 1, &isnull));
+		run->due_at = timestamptz_to_time_t(DatumGetTimestampTz(SPI_getbinval(tuple, tupdesc, 2, &isnull)));
+
+		run_key(&key, run->job_id, run->due_at);
+		queued = hash_search(queued_runs, &key, HASH_ENTER, NULL);
+		queued->written = true;
+		result = lappend(result, run);
+	}
+	pfree(buf.data);
+
+	return result;
+}
@@ -0,0 +1,28 @@
+/* ------------------------------------------------------------------------
+ * runqueue.h
+ *  	The due job runs which have not been started yet, kept in the
+ * 		job_run_queue table so that they survive a launcher restart.
+ *
+ * Copyright (c) 2014, Zalando SE.
+ * Portions Copyright (C) 2013-2014, PostgreSQL Global Development Group
+ * ------------------------------------------------------------------------
+ */
+
+#ifndef _RUNQUEUE_H
+#define _RUNQUEUE_H
+
+#include "postgres.h"
+
+#include "nodes/pg_list.h"
+
+#include "jobs.h"
+
+#define RUN_QUEUE_RELNAME 	"job_run_queue"
+
+bool run_queue_claim(uint32 job_id, pg_time_t due_at);
+void run_queue_started(uint32 job_id, pg_time_t due_at);
+bool run_queue_changed(void);
+void run_queue_write(const char *schema);
+List *run_queue_load(const char *schema);
+
+#endif /* _RUNQUEUE_H */
@@ -0,0 +1,1100 @@
+/* ------------------------------------------------------------------------
+ * schedule.c
+ *  	Compiles job schedules for fast matching and exposes the crontab
+ * 		compiler to SQL as replacements for the plpgsql parsers. Also
+ * 		implements the schedule type, which stores the compiled form.
+ * 		Crontab entries may have a seconds field, interval schedules
+ * 		("@every 10s") fire at every multiple of the interval.
+ *
+ * Copyright (c) 2014, Zalando SE.
+ * Portions Copyright (C) 2013-2014, PostgreSQL Global Development Group
+ * ------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+
+#include <ctype.h>
+
+#include "access/htup_details.h"
+#include "catalog/pg_type.h"
+#include "fmgr.h"
+#include "funcapi.h"
+#include "libpq/pqformat.h"
+#include "utils/array.h"
+#include "utils/builtins.h"
+#include "utils/timestamp.h"
+
+/* Our own include files */
+#include "schedule.h"
+
+PG_FUNCTION_INFO_V1(parse_cronfield);
+PG_FUNCTION_INFO_V1(parse_crontab);
+PG_FUNCTION_INFO_V1(schedule_in);
+PG_FUNCTION_INFO_V1(schedule_out);
+PG_FUNCTION_INFO_V1(schedule_recv);
+PG_FUNCTION_INFO_V1(schedule_send);
+PG_FUNCTION_INFO_V1(schedule_eq);
+PG_FUNCTION_INFO_V1(schedule_ne);
+PG_FUNCTION_INFO_V1(schedule_matches);
+PG_FUNCTION_INFO_V1(schedule_next_run);
+
+Datum parse_cronfield(PG_FUNCTION_ARGS);
+Datum parse_crontab(PG_FUNCTION_ARGS);
+Datum schedule_in(PG_FUNCTION_ARGS);
+Datum schedule_out(PG_FUNCTION_ARGS);
+Datum schedule_recv(PG_FUNCTION_ARGS);
+Datum schedule_send(PG_FUNCTION_ARGS);
+Datum schedule_eq(PG_FUNCTION_ARGS);
+Datum schedule_ne(PG_FUNCTION_ARGS);
+Datum schedule_matches(PG_FUNCTION_ARGS);
+Datum schedule_next_run(PG_FUNCTION_ARGS);
+
+/* Named entries, we transform them into the documented equivalent */
+static const struct
+{
+	const char *name;
+	const char *fields[CRON_FIELDS];
+} cron_macros[] =
+{
+	{"@yearly", 	{"0", "0", "1", "1", "*"}},
+	{"@annually", 	{"0", "0", "1", "1", "*"}},
+	{"@monthly", 	{"0", "0", "1", "*", "*"}},
+	{"@weekly", 	{"0", "0", "*", "*", "0"}},
+	{"@daily", 		{"0", "0", "*", "*", "*"}},
+	{"@midnight", 	{"0", "0", "*", "*", "*"}},
+	{"@hourly", 	{"0", "*", "*", "*", "*"}},
+	{NULL, 			{NULL}}
+};
+
+/* Read a number of at most 2 digits, advance the pointer past it */
+static bool
+read_cron_number(const char **ptr, int *result)
+{
+	const char *p = *ptr;
+	int 		value = 0;
+	int 		digits = 0;
+
+	while (isdigit((unsigned char) *p) && digits < 2)
+	{
+		value = value * 10 + (*p - '0');
+		digits++;
+		p++;
+	}
+	if (digits == 0 || isdigit((unsigned char) *p))
+		return false;
+
+	*ptr = p;
+	*result = value;
+	return true;
+}
+
+/*
+ * Parse a single crontab field, example entries: 0-4,5-9/3,8 or 11-12, a star
+ * may be given a step as well.
+ *
+ * Returns false when the field is not in crontab format at all, raises an
+ * error when the format is right but the values are out of bounds.
+ */
+bool
+parse_cronfield_bits(const char *field, int minvalue, int maxvalue, uint64 *bits)
+{
+	const char *p = field;
+	uint64 		result = 0;
+
+	Assert(minvalue >= 0 && maxvalue < 64);
+
+	for (;;)
+	{
+		int 	min;
+		int 	max;
+		int 	step = 1;
+		int 	value;
+
+		if (*p == '*')
+		{
+			min = minvalue;
+			max = maxvalue;
+			p++;
+		}
+		else
+		{
+			if (!read_cron_number(&p, &min))
+				return false;
+			max = min;
+			if (*p == '-')
+			{
+				p++;
+				if (!read_cron_number(&p, &max))
+					return false;
+			}
+		}
+		if (*p == '/')
+		{
+			p++;
+			if (!read_cron_number(&p, &step))
+				return false;
+		}
+		if (*p != ',' && *p != '\0')
+			return false;
+
+		if (max < min || max > maxvalue || min < minvalue || step == 0)
+			ereport(ERROR,
+					(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+					 errmsg("Invalid crontab parameter."),
+					 errdetail("Range start: %d (%d), End range: %d (%d), Step: %d for crontab field: %s",
+							   min, minvalue, max, maxvalue, step, field),
+					 errhint("Ensure range is ascending, the step is positive and that the ranges is within allowed bounds")));
+
+		for (value = min; value <= max; value += step)
+			result |= UINT64CONST(1) << value;
+
+		if (*p == '\0')
+			break;
+		p++;
+	}
+
+	*bits = result;
+	return true;
+}
+
+/* Mask with the bits of all values from minvalue up to and including maxvalue */
+static uint64
+cron_range_bits(int minvalue, int maxvalue)
+{
+	return ((UINT64CONST(1) << (maxvalue - minvalue + 1)) - 1) << minvalue;
+}
+
+/*
+ * A full dom or dow mask matches every day, whatever the other one holds. Such
+ * a crontab is stored as "* * * * *" would be, so that the masks of schedules
+ * firing at the same moments are equal byte for byte and survive a round trip
+ * through their text form.
+ */
+static void
+cron_normalize_days(CronSchedule *cron)
+{
+	uint32 		all_dom = (uint32) cron_range_bits(CRON_DOM_MIN, CRON_DOM_MAX);
+	uint32 		all_dow = (uint32) cron_range_bits(CRON_DOW_MIN, CRON_DOW_MAX - 1);
+
+	if (cron->dom == all_dom || cron->dow == all_dow)
+	{
+		cron->dom = all_dom;
+		cron->dow = all_dow;
+	}
+}
+
+/*
+ * Compile a crontab entry into bitmasks. Returns false if the schedule is not
+ * a crontab entry (it may still be a valid list of timestamps). An entry of six
+ * fields starts with the seconds.
+ */
+bool
+parse_crontab_string(const char *schedule, CronSchedule *cron)
+{
+	char 	   *copy = pstrdup(schedule);
+	char 	   *p = copy;
+	const char *fields[CRON_FIELDS_SECONDS];
+	const char *seconds = "0";
+	int 		nfields = 0;
+	uint64 		bits[CRON_FIELDS];
+	uint64 		second_bits;
+	bool 		result = false;
+
+	/* Split the entry on whitespace */
+	while (*p != '\0')
+	{
+		while (isspace((unsigned char) *p))
+			p++;
+		if (*p == '\0')
+			break;
+		if (nfields == CRON_FIELDS_SECONDS)
+		{
+			nfields++;
+			break;
+		}
+		fields[nfields++] = p;
+		while (*p != '\0' && !isspace((unsigned char) *p))
+			p++;
+		if (*p != '\0')
+			*p++ = '\0';
+	}
+
+	if (nfields == 1)
+	{
+		int 	i;
+		int 	j;
+
+		for (i = 0; cron_macros[i].name != NULL; i++)
+			if (strcmp(fields[0], cron_macros[i].name) == 0)
+				break;
+		if (cron_macros[i].name == NULL)
+			goto done;
+		for (j = 0; j < CRON_FIELDS; j++)
+			fields[j] = cron_macros[i].fields[j];
+	}
+	else if (nfields == CRON_FIELDS_SECONDS)
+	{
+		int 	j;
+
+		seconds = fields[0];
+		for (j = 0; j < CRON_FIELDS; j++)
+			fields[j] = fields[j + 1];
+	}
+	else if (nfields != CRON_FIELDS)
+		goto done;
+
+	/* if any entry is unknown, the crontab is invalid */
+	if (!parse_cronfield_bits(seconds, CRON_SECOND_MIN, CRON_SECOND_MAX, &second_bits) ||
+		!parse_cronfield_bits(fields[0], CRON_MINUTE_MIN, CRON_MINUTE_MAX, &bits[0]) ||
+		!parse_cronfield_bits(fields[1], CRON_HOUR_MIN, CRON_HOUR_MAX, &bits[1]) ||
+		!parse_cronfield_bits(fields[2], CRON_DOM_MIN, CRON_DOM_MAX, &bits[2]) ||
+		!parse_cronfield_bits(fields[3], CRON_MONTH_MIN, CRON_MONTH_MAX, &bits[3]) ||
+		!parse_cronfield_bits(fields[4], CRON_DOW_MIN, CRON_DOW_MAX, &bits[4]))
+		goto done;
+
+	cron->second = second_bits;
+	cron->minute = bits[0];
+	cron->hour = (uint32) bits[1];
+	cron->dom = (uint32) bits[2];
+	cron->month = (uint32) bits[3];
+	/* Convert day 7 to day 0 (Sunday) */
+	cron->dow = (uint32) ((bits[4] | (bits[4] >> 7)) & 0x7F);
+
+	/*
+	 * To model the logic of cron, we empty one of the dow or dom masks
+	 * Logic (man 5 crontab):
+	 * If both fields are restricted (ie, are not *), the command will be run when
+	 *     either field matches the current time.
+	 */
+	if (strcmp(fields[4], "*") == 0 && strcmp(fields[2], "*") != 0)
+		cron->dow = 0;
+	if (strcmp(fields[2], "*") == 0 && strcmp(fields[4], "*") != 0)
+		cron->dom = 0;
+	cron_normalize_days(cron);
+
+	result = true;
+
+done:
+	pfree(copy);
+	return result;
+}
+
+/*
+ * Check a broken down local time, as returned by pg_localtime, against the
+ * schedule. Only the minute is checked, the seconds field is not.
+ */
+bool
+cron_schedule_matches(const CronSchedule *cron, const struct pg_tm *tm)
+{
+	return (cron->minute & (UINT64CONST(1) << tm->tm_min)) != 0 &&
+		   (cron->hour & (1U << tm->tm_hour)) != 0 &&
+		   (cron->month & (1U << (tm->tm_mon + 1))) != 0 &&
+		   ((cron->dom & (1U << tm->tm_mday)) != 0 ||
+			(cron->dow & (1U << tm->tm_wday)) != 0);
+}
+
+static int
+compare_time(const void *a, const void *b)
+{
+	pg_time_t 	ta = *(const pg_time_t *) a;
+	pg_time_t 	tb = *(const pg_time_t *) b;
+
+	return (ta > tb) ? 1 : ((ta < tb) ? -1 : 0);
+}
+
+/* Truncate a moment to the start of its minute, also for moments before the epoch */
+static pg_time_t
+truncate_to_minute(pg_time_t t)
+{
+	pg_time_t 	r = t % SECS_PER_MINUTE;
+
+	return (r < 0) ? t - r - SECS_PER_MINUTE : t - r;
+}
+
+/* Sort the moments and remove the duplicates, returns the number left */
+static int
+sort_unique_times(pg_time_t *times, int ntimes)
+{
+	int 	i;
+	int 	n = 0;
+
+	if (ntimes == 0)
+		return 0;
+
+	qsort(times, ntimes, sizeof(pg_time_t), compare_time);
+	for (i = 1; i < ntimes; i++)
+		if (times[i] != times[n])
+			times[++n] = times[i];
+	return n + 1;
+}
+
+static Schedule *
+make_timestamps_schedule(pg_time_t *times, int ntimes)
+{
+	Schedule   *result;
+	int 		i;
+
+	for (i = 0; i < ntimes; i++)
+		times[i] = truncate_to_minute(times[i]);
+	ntimes = sort_unique_times(times, ntimes);
+
+	result = palloc0(SCHEDULE_TIMESTAMPS_SIZE(ntimes));
+	SET_VARSIZE(result, SCHEDULE_TIMESTAMPS_SIZE(ntimes));
+	result->kind = SCHEDULE_TIMESTAMPS;
+	for (i = 0; i < ntimes; i++)
+		result->data.timestamps[i] = (int64) times[i];
+	return result;
+}
+
+/*
+ * Parse the interval of an "@every" schedule: one or more numbers, each followed
+ * by a unit of d, h, m or s, for example "1h30m". Returns the interval in seconds.
+ */
+static int64
+parse_interval_string(const char *str, const char *schedule)
+{
+	const char *p = str;
+	int64 		result = 0;
+	int 		nparts = 0;
+
+	for (;;)
+	{
+		int64 		value = 0;
+		int 		digits = 0;
+
+		while (isspace((unsigned char) *p))
+			p++;
+		if (*p == '\0')
+			break;
+
+		while (isdigit((unsigned char) *p) && digits < 9)
+		{
+			value = value * 10 + (*p - '0');
+			digits++;
+			p++;
+		}
+		if (digits == 0 || isdigit((unsigned char) *p))
+			break;
+
+		switch (*p++)
+		{
+			case 'd':
+				value *= SECS_PER_DAY;
+				break;
+			case 'h':
+				value *= SECS_PER_HOUR;
+				break;
+			case 'm':
+				value *= SECS_PER_MINUTE;
+				break;
+			case 's':
+				break;
+			default:
+				p = NULL;
+				break;
+		}
+		if (p == NULL)
+			break;
+		result += value;
+		nparts++;
+	}
+
+	if (p == NULL || *p != '\0' || nparts == 0)
+		ereport(ERROR,
+				(errcode(ERRCODE_INVALID_TEXT_REPRESENTATION),
+				 errmsg("invalid input syntax for type schedule: \"%s\"", schedule),
+				 errhint("An interval schedule looks like \"@every 1h30m\", the units are d, h, m and s.")));
+	if (result <= 0)
+		ereport(ERROR,
+				(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+				 errmsg("the interval of a schedule must be at least one second: \"%s\"", schedule)));
+
+	return result;
+}
+
+/*
+ * Convert the textual form of a schedule, either a crontab entry, an interval
+ * or a (n array of) timestamp(s), into its on-disk form. Raises an error if it
+ * is none of them.
+ */
+Schedule *
+schedule_from_string(const char *str)
+{
+	Schedule   *result;
+	CronSchedule cron;
+	Datum 	   *elems;
+	pg_time_t  *times;
+	int 		nelems;
+	int 		i;
+
+	if (strncmp(str, SCHEDULE_EVERY, strlen(SCHEDULE_EVERY)) == 0)
+	{
+		result = palloc0(SCHEDULE_INTERVAL_SIZE);
+		SET_VARSIZE(result, SCHEDULE_INTERVAL_SIZE);
+		result->kind = SCHEDULE_INTERVAL;
+		result->data.interval = parse_interval_string(str + strlen(SCHEDULE_EVERY), str);
+		return result;
+	}
+
+	if (parse_crontab_string(str, &cron))
+	{
+		result = palloc0(SCHEDULE_CRONTAB_SIZE);
+		SET_VARSIZE(result, SCHEDULE_CRONTAB_SIZE);
+		result->kind = SCHEDULE_CRONTAB;
+		result->data.cron = cron;
+		return result;
+	}
+
+	if (str[0] == '{')
+	{
+		ArrayType  *arr;
+
+		arr = DatumGetArrayTypeP(DirectFunctionCall3(array_in,
+													 CStringGetDatum(str),
+													 ObjectIdGetDatum(TIMESTAMPTZOID),
+													 Int32GetDatum(-1)));
+		deconstruct_array(arr, TIMESTAMPTZOID, sizeof(TimestampTz), FLOAT8PASSBYVAL, 'd',
+						  &elems, NULL, &nelems);
+	}
+	else
+	{
+		elems = palloc(sizeof(Datum));
+		elems[0] = DirectFunctionCall3(timestamptz_in,
+									   CStringGetDatum(str),
+									   ObjectIdGetDatum(InvalidOid),
+									   Int32GetDatum(-1));
+		nelems = 1;
+	}
+
+	times = palloc(sizeof(pg_time_t) * Max(nelems, 1));
+	for (i = 0; i < nelems; i++)
+	{
+		TimestampTz 	ts = DatumGetTimestampTz(elems[i]);
+
+		if (TIMESTAMP_NOT_FINITE(ts))
+			ereport(ERROR,
+					(errcode(ERRCODE_INVALID_TEXT_REPRESENTATION),
+					 errmsg("invalid input syntax for type schedule: \"%s\"", str),
+					 errdetail("A schedule cannot contain infinite timestamps.")));
+		times[i] = timestamptz_to_time_t(ts);
+		if (pg_gmtime(&times[i])->tm_year + 1900 < 1)
+			ereport(ERROR,
+					(errcode(ERRCODE_DATETIME_VALUE_OUT_OF_RANGE),
+					 errmsg("schedule timestamp out of range: \"%s\"", str)));
+	}
+
+	result = make_timestamps_schedule(times, nelems);
+	pfree(times);
+	pfree(elems);
+	return result;
+}
+
+/*
+ * Compile the schedule of a job for matching, this requires no parsing.
+ * The list of timestamps is allocated in the given memory context.
+ */
+void
+compile_schedule(const Schedule *schedule, CompiledSchedule *result, MemoryContext cxt)
+{
+	int 		i;
+
+	memset(result, 0, sizeof(CompiledSchedule));
+
+	if (schedule == NULL)
+	{
+		result->kind = SCHEDULE_NONE;
+		return;
+	}
+	if (schedule->kind == SCHEDULE_CRONTAB)
+	{
+		result->kind = SCHEDULE_CRONTAB;
+		result->cron = schedule->data.cron;
+		return;
+	}
+	if (schedule->kind == SCHEDULE_INTERVAL)
+	{
+		result->kind = SCHEDULE_INTERVAL;
+		result->interval = schedule->data.interval;
+		return;
+	}
+
+	result->kind = SCHEDULE_TIMESTAMPS;
+	result->ntimestamps = SCHEDULE_NTIMESTAMPS(schedule);
+	result->timestamps = MemoryContextAlloc(cxt, sizeof(pg_time_t) * Max(result->ntimestamps, 1));
+	for (i = 0; i < result->ntimestamps; i++)
+		result->timestamps[i] = (pg_time_t) schedule->data.timestamps[i];
+}
+
+void
+free_compiled_schedule(CompiledSchedule *schedule)
+{
+	if (schedule->timestamps != NULL)
+		pfree(schedule->timestamps);
+	schedule->timestamps = NULL;
+	schedule->ntimestamps = 0;
+	schedule->kind = SCHEDULE_NONE;
+}
+
+/* The first multiple of the interval after the given moment */
+static pg_time_t
+interval_next_fire(int64 interval, pg_time_t after)
+{
+	pg_time_t 	r = after % interval;
+
+	if (r < 0)
+		r += interval;
+	return after - r + interval;
+}
+
+/*
+ * Check whether the schedule fires in the given minute, tm is the same moment
+ * broken down in the local time zone.
+ */
+bool
+compiled_schedule_matches(const CompiledSchedule *schedule, pg_time_t minute, const struct pg_tm *tm)
+{
+	switch (schedule->kind)
+	{
+		case SCHEDULE_CRONTAB:
+			return cron_schedule_matches(&schedule->cron, tm);
+		case SCHEDULE_TIMESTAMPS:
+			return bsearch(&minute, schedule->timestamps, schedule->ntimestamps,
+						   sizeof(pg_time_t), compare_time) != NULL;
+		case SCHEDULE_INTERVAL:
+			return interval_next_fire(schedule->interval, minute - 1) < minute + SECS_PER_MINUTE;
+		default:
+			return false;
+	}
+}
+
+/*
+ * Whether the schedule may fire at another moment than the start of a minute.
+ * Such schedules cannot be evaluated a minute at a time.
+ */
+bool
+schedule_has_seconds(const CompiledSchedule *schedule)
+{
+	switch (schedule->kind)
+	{
+		case SCHEDULE_CRONTAB:
+			return schedule->cron.second != UINT64CONST(1);
+		case SCHEDULE_INTERVAL:
+			return schedule->interval % SECS_PER_MINUTE != 0;
+		default:
+			return false;
+	}
+}
+
+/*
+ * The start of the next local day, given a moment and the seconds elapsed in its
+ * day. A day lasts 23 or 25 hours when daylight saving time starts or ends: from
+ * a moment past midnight we go back to midnight, a moment before midnight is
+ * looked at once more by the caller.
+ */
+static pg_time_t
+cron_next_day(pg_time_t t, int elapsed_in_day)
+{
+	pg_time_t 	next = t + SECS_PER_DAY - elapsed_in_day;
+	struct pg_tm *tm = pg_localtime(&next, session_timezone);
+	pg_time_t 	midnight = next - (tm->tm_hour * SECS_PER_HOUR + tm->tm_min * SECS_PER_MINUTE + tm->tm_sec);
+
+	/* A day without a midnight starts at the first moment past it */
+	return (midnight > t) ? midnight : next;
+}
+
+/*
+ * Find the first second after the given moment at which the crontab fires,
+ * in the local time zone. Instead of probing every second we skip over whole
+ * days, hours and minutes which cannot match.
+ */
+static pg_time_t
+cron_next_fire(const CronSchedule *cron, pg_time_t after)
+{
+	pg_time_t 	t = after + 1;
+	pg_time_t 	limit = t + (pg_time_t) CRON_SEARCH_DAYS * SECS_PER_DAY;
+
+	while (t < limit)
+	{
+		struct pg_tm *tm = pg_localtime(&t, session_timezone);
+		int 		elapsed_in_hour = tm->tm_min * SECS_PER_MINUTE + tm->tm_sec;
+
+		if ((cron->month & (1U << (tm->tm_mon + 1))) == 0 ||
+			((cron->dom & (1U << tm->tm_mday)) == 0 &&
+			 (cron->dow & (1U << tm->tm_wday)) == 0))
+			t = cron_next_day(t, tm->tm_hour * SECS_PER_HOUR + elapsed_in_hour);
+		else if ((cron->hour & (1U << tm->tm_hour)) == 0)
+			t += SECS_PER_HOUR - elapsed_in_hour;
+		else if ((cron->minute & (UINT64CONST(1) << tm->tm_min)) == 0)
+			t += SECS_PER_MINUTE - tm->tm_sec;
+		else
+		{
+			/* The seconds of this minute from the current one on */
+			uint64 	later = cron->second >> tm->tm_sec;
+
+			if (later == 0)
+				t += SECS_PER_MINUTE - tm->tm_sec;
+			else
+			{
+				while ((later & 1) == 0)
+				{
+					later >>= 1;
+					t++;
+				}
+				return t;
+			}
+		}
+	}
+	return SCHEDULE_NEVER;
+}
+
+/*
+ * Return the first moment strictly after the given one at which the schedule
+ * fires, or SCHEDULE_NEVER.
+ */
+pg_time_t
+schedule_next_fire(const CompiledSchedule *schedule, pg_time_t after)
+{
+	int 	low;
+	int 	high;
+
+	switch (schedule->kind)
+	{
+		case SCHEDULE_CRONTAB:
+			return cron_next_fire(&schedule->cron, after);
+		case SCHEDULE_INTERVAL:
+			return interval_next_fire(schedule->interval, after);
+		case SCHEDULE_TIMESTAMPS:
+			/* binary search for the first timestamp past the given moment */
+			low = 0;
+			high = schedule->ntimestamps;
+			while (low < high)
+			{
+				int 	mid = (low + high) / 2;
+
+				if (schedule->timestamps[mid] <= after)
+					low = mid + 1;
+				else
+					high = mid;
+			}
+			return (low < schedule->ntimestamps) ? schedule->timestamps[low] : SCHEDULE_NEVER;
+		default:
+			return SCHEDULE_NEVER;
+	}
+}
+
+/* Expand a bitmask into the sorted int[] representation used by the SQL api */
+static ArrayType *
+bits_to_int_array(uint64 bits)
+{
+	Datum 		values[64];
+	int 		n = 0;
+	int 		i;
+
+	if (bits == 0)
+		return construct_empty_array(INT4OID);
+
+	for (i = 0; i < 64; i++)
+		if (bits & (UINT64CONST(1) << i))
+			values[n++] = Int32GetDatum(i);
+
+	return construct_array(values, n, INT4OID, sizeof(int32), true, 'i');
+}
+
+Datum
+parse_cronfield(PG_FUNCTION_ARGS)
+{
+	char 	   *field = text_to_cstring(PG_GETARG_TEXT_PP(0));
+	int32 		minvalue = PG_GETARG_INT32(1);
+	int32 		maxvalue = PG_GETARG_INT32(2);
+	uint64 		bits;
+
+	if (minvalue < 0 || maxvalue > 63)
+		ereport(ERROR,
+				(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+				 errmsg("crontab field bounds must be within 0 and 63")));
+
+	if (!parse_cronfield_bits(field, minvalue, maxvalue, &bits) || bits == 0)
+		PG_RETURN_NULL();
+
+	PG_RETURN_ARRAYTYPE_P(bits_to_int_array(bits));
+}
+
+Datum
+parse_crontab(PG_FUNCTION_ARGS)
+{
+	TupleDesc 	tupdesc;
+	Datum 		values[CRON_FIELDS];
+	bool 		nulls[CRON_FIELDS];
+	CronSchedule cron;
+
+	if (get_call_result_type(fcinfo, NULL, &tupdesc) != TYPEFUNC_COMPOSITE)
+		elog(ERROR, "return type must be a row type");
+	tupdesc = BlessTupleDesc(tupdesc);
+
+	/* Non-crontab schedules return a row of nulls */
+	if (PG_ARGISNULL(0) ||
+		!parse_crontab_string(text_to_cstring(PG_GETARG_TEXT_PP(0)), &cron))
+	{
+		memset(nulls, true, sizeof(nulls));
+		memset(values, 0, sizeof(values));
+	}
+	else
+	{
+		memset(nulls, false, sizeof(nulls));
+		values[0] = PointerGetDatum(bits_to_int_array(cron.minute));
+		values[1] = PointerGetDatum(bits_to_int_array(cron.hour));
+		values[2] = PointerGetDatum(bits_to_int_array(cron.dom));
+		values[3] = PointerGetDatum(bits_to_int_array(cron.month));
+		values[4] = PointerGetDatum(bits_to_int_array(cron.dow));
+	}
+
+	PG_RETURN_DATUM(HeapTupleGetDatum(heap_form_tuple(tupdesc, values, nulls)));
+}
+
+/*
+ * Append a crontab field in its shortest usual form: a star, a stepped range or
+ * a list of values and ranges. A full field is only written as a star if
+ * allow_star is set, as a star in the dom or dow field changes the meaning of
+ * the other one.
+ */
+static void
+append_cronfield(StringInfo buf, uint64 bits, int minvalue, int maxvalue, bool allow_star)
+{
+	int 	values[64];
+	int 	n = 0;
+	int 	step;
+	int 	i;
+
+	if (bits == cron_range_bits(minvalue, maxvalue))
+	{
+		if (allow_star)
+			appendStringInfoChar(buf, '*');
+		else
+			appendStringInfo(buf, "%d-%d", minvalue, maxvalue);
+		return;
+	}
+
+	for (i = minvalue; i <= maxvalue; i++)
+		if (bits & (UINT64CONST(1) << i))
+			values[n++] = i;
+
+	/* An arithmetic progression of at least 3 values is written with a step */
+	if (n >= 3)
+	{
+		step = values[1] - values[0];
+		for (i = 2; i < n; i++)
+			if (values[i] - values[i - 1] != step)
+				break;
+		if (i == n && step > 1)
+		{
+			if (values[0] == minvalue && values[n - 1] + step > maxvalue)
+				appendStringInfo(buf, "*/%d", step);
+			else
+				appendStringInfo(buf, "%d-%d/%d", values[0], values[n - 1], step);
+			return;
+		}
+	}
+
+	for (i = 0; i < n; i++)
+	{
+		int 	last = i;
+
+		while (last + 1 < n && values[last + 1] == values[last] + 1)
+			last++;
+
+		if (i > 0)
+			appendStringInfoChar(buf, ',');
+		if (last - i >= 2)
+		{
+			appendStringInfo(buf, "%d-%d", values[i], values[last]);
+			i = last;
+		}
+		else
+			appendStringInfo(buf, "%d", values[i]);
+	}
+}
+
+static char *
+cron_schedule_to_string(const CronSchedule *cron)
+{
+	StringInfoData 	buf;
+	uint64 			all_dom = cron_range_bits(CRON_DOM_MIN, CRON_DOM_MAX);
+	uint64 			all_dow = cron_range_bits(CRON_DOW_MIN, CRON_DOW_MAX - 1);
+
+	initStringInfo(&buf);
+	/* The seconds field is only written when it is not just second 0 */
+	if (cron->second != UINT64CONST(1))
+	{
+		append_cronfield(&buf, cron->second, CRON_SECOND_MIN, CRON_SECOND_MAX, true);
+		appendStringInfoChar(&buf, ' ');
+	}
+	append_cronfield(&buf, cron->minute, CRON_MINUTE_MIN, CRON_MINUTE_MAX, true);
+	appendStringInfoChar(&buf, ' ');
+	append_cronfield(&buf, cron->hour, CRON_HOUR_MIN, CRON_HOUR_MAX, true);
+	appendStringInfoChar(&buf, ' ');
+	/* An empty dom or dow mask was a star, see parse_crontab_string */
+	if (cron->dom == 0)
+		appendStringInfoChar(&buf, '*');
+	else
+		append_cronfield(&buf, cron->dom, CRON_DOM_MIN, CRON_DOM_MAX,
+						 cron->dow == 0 || cron->dow == all_dow);
+	appendStringInfoChar(&buf, ' ');
+	append_cronfield(&buf, cron->month, CRON_MONTH_MIN, CRON_MONTH_MAX, true);
+	appendStringInfoChar(&buf, ' ');
+	if (cron->dow == 0)
+		appendStringInfoChar(&buf, '*');
+	else
+		append_cronfield(&buf, cron->dow, CRON_DOW_MIN, CRON_DOW_MAX - 1,
+						 cron->dom == 0 || cron->dom == all_dom);
+
+	return buf.data;
+}
+
+/* An interval in days, hours, minutes and seconds, for example "@every 1h30m" */
+static char *
+interval_schedule_to_string(int64 interval)
+{
+	StringInfoData 	buf;
+	static const struct
+	{
+		int 	seconds;
+		char 	unit;
+	} 				units[] = {{SECS_PER_DAY, 'd'}, {SECS_PER_HOUR, 'h'}, {SECS_PER_MINUTE, 'm'}, {1, 's'}};
+	int 			i;
+
+	initStringInfo(&buf);
+	appendStringInfoString(&buf, SCHEDULE_EVERY " ");
+	for (i = 0; i < lengthof(units); i++)
+	{
+		if (interval < units[i].seconds)
+			continue;
+		appendStringInfo(&buf, INT64_FORMAT "%c", interval / units[i].seconds, units[i].unit);
+		interval %= units[i].seconds;
+	}
+
+	return buf.data;
+}
+
+/* The same format as the job triggers used to store: '{"YYYY-MM-DD HH24:MI +00",...}' */
+static char *
+timestamps_schedule_to_string(const Schedule *schedule)
+{
+	StringInfoData 	buf;
+	int 			i;
+
+	initStringInfo(&buf);
+	appendStringInfoChar(&buf, '{');
+	for (i = 0; i < SCHEDULE_NTIMESTAMPS(schedule); i++)
+	{
+		pg_time_t 		t = (pg_time_t) schedule->data.timestamps[i];
+		struct pg_tm   *tm = pg_gmtime(&t);
+
+		if (i > 0)
+			appendStringInfoChar(&buf, ',');
+		appendStringInfo(&buf, "\"%04d-%02d-%02d %02d:%02d +00\"",
+						 tm->tm_year + 1900, tm->tm_mon + 1, tm->tm_mday,
+						 tm->tm_hour, tm->tm_min);
+	}
+	appendStringInfoChar(&buf, '}');
+
+	return buf.data;
+}
+
+Datum
+schedule_in(PG_FUNCTION_ARGS)
+{
+	char 	   *str = PG_GETARG_CSTRING(0);
+
+	PG_RETURN_SCHEDULE_P(schedule_from_string(str));
+}
+
+Datum
+schedule_out(PG_FUNCTION_ARGS)
+{
+	Schedule   *schedule = PG_GETARG_SCHEDULE_P(0);
+
+	if (schedule->kind == SCHEDULE_CRONTAB)
+		PG_RETURN_CSTRING(cron_schedule_to_string(&schedule->data.cron));
+	if (schedule->kind == SCHEDULE_INTERVAL)
+		PG_RETURN_CSTRING(interval_schedule_to_string(schedule->data.interval));
+	PG_RETURN_CSTRING(timestamps_schedule_to_string(schedule));
+}
+
+/*
+ * Binary input: the kind, followed by either the five crontab masks and the
+ * seconds mask, the interval in seconds, or the number of timestamps and the
+ * timestamps themselves, in seconds since the epoch.
+ */
+Datum
+schedule_recv(PG_FUNCTION_ARGS)
+{
+	StringInfo 	buf = (StringInfo) PG_GETARG_POINTER(0);
+	int32 		kind = pq_getmsgint(buf, 4);
+
+	if (kind == SCHEDULE_CRONTAB)
+	{
+		Schedule   *result = palloc0(SCHEDULE_CRONTAB_SIZE);
+		CronSchedule *cron = &result->data.cron;
+
+		SET_VARSIZE(result, SCHEDULE_CRONTAB_SIZE);
+		result->kind = SCHEDULE_CRONTAB;
+		cron->minute = pq_getmsgint64(buf);
+		cron->hour = pq_getmsgint(buf, 4);
+		cron->dom = pq_getmsgint(buf, 4);
+		cron->month = pq_getmsgint(buf, 4);
+		cron->dow = pq_getmsgint(buf, 4);
+		cron->second = pq_getmsgint64(buf);
+
+		if (cron->second == 0 || (cron->second & ~cron_range_bits(CRON_SECOND_MIN, CRON_SECOND_MAX)) != 0 ||
+			cron->minute == 0 || (cron->minute & ~cron_range_bits(CRON_MINUTE_MIN, CRON_MINUTE_MAX)) != 0 ||
+			cron->hour == 0 || (cron->hour & ~cron_range_bits(CRON_HOUR_MIN, CRON_HOUR_MAX)) != 0 ||
+			cron->month == 0 || (cron->month & ~cron_range_bits(CRON_MONTH_MIN, CRON_MONTH_MAX)) != 0 ||
+			(cron->dom & ~cron_range_bits(CRON_DOM_MIN, CRON_DOM_MAX)) != 0 ||
+			(cron->dow & ~cron_range_bits(CRON_DOW_MIN, CRON_DOW_MAX - 1)) != 0 ||
+			(cron->dom == 0 && cron->dow == 0))
+			ereport(ERROR,
+					(errcode(ERRCODE_INVALID_BINARY_REPRESENTATION),
+					 errmsg("invalid crontab masks in external \"schedule\" value")));
+		cron_normalize_days(cron);
+
+		PG_RETURN_SCHEDULE_P(result);
+	}
+	else if (kind == SCHEDULE_INTERVAL)
+	{
+		Schedule   *result = palloc0(SCHEDULE_INTERVAL_SIZE);
+
+		SET_VARSIZE(result, SCHEDULE_INTERVAL_SIZE);
+		result->kind = SCHEDULE_INTERVAL;
+		result->data.interval = pq_getmsgint64(buf);
+		if (result->data.interval <= 0)
+			ereport(ERROR,
+					(errcode(ERRCODE_INVALID_BINARY_REPRESENTATION),
+					 errmsg("invalid interval in external \"schedule\" value")));
+
+		PG_RETURN_SCHEDULE_P(result);
+	}
+	else if (kind == SCHEDULE_TIMESTAMPS)
+	{
+		Schedule   *result;
+		pg_time_t  *times;
+		int32 		ntimes = pq_getmsgint(buf, 4);
+		int 		i;
+
+		if (ntimes < 0 || ntimes > (buf->len - buf->cursor) / sizeof(int64))
+			ereport(ERROR,
+					(errcode(ERRCODE_INVALID_BINARY_REPRESENTATION),
+					 errmsg("invalid number of timestamps in external \"schedule\" value")));
+
+		times = palloc(sizeof(pg_time_t) * Max(ntimes, 1));
+		for (i = 0; i < ntimes; i++)
+			times[i] = (pg_time_t) pq_getmsgint64(buf);
+		result = make_timestamps_schedule(times, ntimes);
+		pfree(times);
+
+		PG_RETURN_SCHEDULE_P(result);
+	}
+
+	ereport(ERROR,
+			(errcode(ERRCODE_INVALID_BINARY_REPRESENTATION),
+			 errmsg("invalid kind %d in external \"schedule\" value", kind)));
+	PG_RETURN_NULL();
+}
+
+Datum
+schedule_send(PG_FUNCTION_ARGS)
+{
+	Schedule   *schedule = PG_GETARG_SCHEDULE_P(0);
+	StringInfoData 	buf;
+	int 		i;
+
+	pq_begintypsend(&buf);
+	pq_sendint(&buf, schedule->kind, 4);
+	if (schedule->kind == SCHEDULE_CRONTAB)
+	{
+		pq_sendint64(&buf, schedule->data.cron.minute);
+		pq_sendint(&buf, schedule->data.cron.hour, 4);
+		pq_sendint(&buf, schedule->data.cron.dom, 4);
+		pq_sendint(&buf, schedule->data.cron.month, 4);
+		pq_sendint(&buf, schedule->data.cron.dow, 4);
+		pq_sendint64(&buf, schedule->data.cron.second);
+	}
+	else if (schedule->kind == SCHEDULE_INTERVAL)
+		pq_sendint64(&buf, schedule->data.interval);
+	else
+	{
+		pq_sendint(&buf, SCHEDULE_NTIMESTAMPS(schedule), 4);
+		for (i = 0; i < SCHEDULE_NTIMESTAMPS(schedule); i++)
+			pq_sendint64(&buf, schedule->data.timestamps[i]);
+	}
+
+	PG_RETURN_BYTEA_P(pq_endtypsend(&buf));
+}
+
+/* The on-disk form is canonical, equal schedules have the same bytes */
+static bool
+schedules_equal(Schedule *a, Schedule *b)
+{
+	return VARSIZE(a) == VARSIZE(b) &&
+		   memcmp(VARDATA(a), VARDATA(b), VARSIZE(a) - VARHDRSZ) == 0;
+}
+
+Datum
+schedule_eq(PG_FUNCTION_ARGS)
+{
+	PG_RETURN_BOOL(schedules_equal(PG_GETARG_SCHEDULE_P(0), PG_GETARG_SCHEDULE_P(1)));
+}
+
+Datum
+schedule_ne(PG_FUNCTION_ARGS)
+{
+	PG_RETURN_BOOL(!schedules_equal(PG_GETARG_SCHEDULE_P(0), PG_GETARG_SCHEDULE_P(1)));
+}
+
+/* Does the schedule fire in the minute of the given moment, in the session time zone */
+Datum
+schedule_matches(PG_FUNCTION_ARGS)
+{
+	Schedule   *schedule = PG_GETARG_SCHEDULE_P(0);
+	TimestampTz moment = PG_GETARG_TIMESTAMPTZ(1);
+	pg_time_t 	minute;
+	CompiledSchedule compiled;
+	bool 		result;
+
+	if (TIMESTAMP_NOT_FINITE(moment))
+		PG_RETURN_BOOL(false);
+
+	minute = truncate_to_minute(timestamptz_to_time_t(moment));
+	compile_schedule(schedule, &compiled, CurrentMemoryContext);
+	result = compiled_schedule_matches(&compiled, minute, pg_localtime(&minute, session_timezone));
+	free_compiled_schedule(&compiled);
+
+	PG_RETURN_BOOL(result);
+}
+
+/*
+ * The first moment after the given one at which the schedule fires, or null if
+ * it never fires again. Schedules without seconds fire at the start of a minute,
+ * so for them this is the first minute after the one holding the given moment.
+ * Crontab schedules are evaluated in the session time zone.
+ */
+Datum
+schedule_next_run(PG_FUNCTION_ARGS)
+{
+	Schedule   *schedule = PG_GETARG_SCHEDULE_P(0);
+	TimestampTz after = PG_GETARG_TIMESTAMPTZ(1);
+	CompiledSchedule compiled;
+	pg_time_t 	next;
+
+	if (TIMESTAMP_IS_NOBEGIN(after))
+		after = SetEpochTimestamp();
+	else if (TIMESTAMP_IS_NOEND(after))
+		PG_RETURN_NULL();
+
+	compile_schedule(schedule, &compiled, CurrentMemoryContext);
+	next = schedule_next_fire(&compiled, timestamptz_to_time_t(after));
+	free_compiled_schedule(&compiled);
+
+	if (next == SCHEDULE_NEVER)
+		PG_RETURN_NULL();
+	PG_RETURN_TIMESTAMPTZ(time_t_to_timestamptz(next));
+}
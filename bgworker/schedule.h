@@ -0,0 +1,126 @@
+/* ------------------------------------------------------------------------
+ * schedule.h
+ *  	Compiled representation of job schedules.
+ *
+ * Copyright (c) 2014, Zalando SE.
+ * Portions Copyright (C) 2013-2014, PostgreSQL Global Development Group
+ * ------------------------------------------------------------------------
+ */
+
+#ifndef _SCHEDULE_H
+#define _SCHEDULE_H
+
+#include "postgres.h"
+#include "fmgr.h"
+#include "pgtime.h"
+
+#define CRON_FIELDS 	5
+/* An optional sixth field, in front of the others, gives the seconds */
+#define CRON_FIELDS_SECONDS 	6
+
+/* Allowed values for every crontab field, see man 5 crontab */
+#define CRON_SECOND_MIN 0
+#define CRON_SECOND_MAX 59
+#define CRON_MINUTE_MIN 0
+#define CRON_MINUTE_MAX 59
+#define CRON_HOUR_MIN 	0
+#define CRON_HOUR_MAX 	23
+#define CRON_DOM_MIN 	1
+#define CRON_DOM_MAX 	31
+#define CRON_MONTH_MIN 	1
+#define CRON_MONTH_MAX 	12
+#define CRON_DOW_MIN 	0
+#define CRON_DOW_MAX 	7
+
+/*
+ * How far ahead we look for the next moment a crontab schedule fires. February
+ * 29th may be 8 years apart, as 2100 is not a leap year.
+ */
+#define CRON_SEARCH_DAYS 	(8 * 366 + 1)
+
+/* Returned when a schedule will never fire again */
+#define SCHEDULE_NEVER 		((pg_time_t) 0)
+
+/* The prefix of an interval schedule, for example "@every 1m30s" */
+#define SCHEDULE_EVERY 		"@every"
+
+/*
+ * A crontab entry compiled into bitmasks, bit n is set when value n matches.
+ * Day of week 7 is folded into 0 (Sunday). Following man 5 crontab, when only
+ * one of dom and dow is restricted the other one is left empty, so that a
+ * moment matches when minute, hour and month match and either dom or dow does.
+ * A crontab entry without a seconds field fires at second 0.
+ */
+typedef struct CronSchedule
+{
+	uint64 	second;
+	uint64 	minute;
+	uint32 	hour;
+	uint32 	dom;
+	uint32 	month;
+	uint32 	dow;
+} CronSchedule;
+
+typedef enum ScheduleKind
+{
+	SCHEDULE_NONE,
+	SCHEDULE_CRONTAB,
+	SCHEDULE_TIMESTAMPS,
+	SCHEDULE_INTERVAL
+} ScheduleKind;
+
+/*
+ * A schedule as stored in the job table, compiled for fast matching: either
+ * a crontab entry, a sorted list of moments truncated to the minute, or an
+ * interval in seconds. An interval schedule fires at every multiple of the
+ * interval since the epoch, so it does not drift and needs no state.
+ */
+typedef struct CompiledSchedule
+{
+	ScheduleKind kind;
+	CronSchedule cron;
+	int64 		interval;
+	int 		ntimestamps;
+	pg_time_t  *timestamps;
+} CompiledSchedule;
+
+/*
+ * The on-disk form of the schedule type. It holds either the crontab bitmasks,
+ * the sorted, distinct moments (seconds since the epoch, truncated to the
+ * minute) of a list of timestamps or the interval in seconds, so that no text
+ * has to be parsed to use it.
+ */
+typedef struct Schedule
+{
+	int32 		vl_len_;		/* varlena header (do not touch directly!) */
+	int32 		kind;			/* a ScheduleKind */
+	union
+	{
+		CronSchedule cron;
+		int64 		interval;
+		int64 		timestamps[1];	/* VARIABLE LENGTH ARRAY */
+	} 			data;
+} Schedule;
+
+#define SCHEDULE_HDRSZ 			offsetof(Schedule, data)
+#define SCHEDULE_CRONTAB_SIZE 	(SCHEDULE_HDRSZ + sizeof(CronSchedule))
+#define SCHEDULE_INTERVAL_SIZE 	(SCHEDULE_HDRSZ + sizeof(int64))
+#define SCHEDULE_TIMESTAMPS_SIZE(n) (SCHEDULE_HDRSZ + sizeof(int64) * (n))
+#define SCHEDULE_NTIMESTAMPS(s) ((int) ((VARSIZE(s) - SCHEDULE_HDRSZ) / sizeof(int64)))
+
+#define DatumGetScheduleP(X) 	((Schedule *) PG_DETOAST_DATUM(X))
+#define PG_GETARG_SCHEDULE_P(n) DatumGetScheduleP(PG_GETARG_DATUM(n))
+#define PG_RETURN_SCHEDULE_P(x) PG_RETURN_POINTER(x)
+
+bool parse_cronfield_bits(const char *field, int minvalue, int maxvalue, uint64 *bits);
+bool parse_crontab_string(const char *schedule, CronSchedule *cron);
+bool cron_schedule_matches(const CronSchedule *cron, const struct pg_tm *tm);
+
+Schedule *schedule_from_string(const char *str);
+void compile_schedule(const Schedule *schedule, CompiledSchedule *result, MemoryContext cxt);
+void free_compiled_schedule(CompiledSchedule *schedule);
+bool compiled_schedule_matches(const CompiledSchedule *schedule, pg_time_t minute, const struct pg_tm *tm);
+bool schedule_has_seconds(const CompiledSchedule *schedule);
+pg_time_t schedule_next_fire(const CompiledSchedule *schedule, pg_time_t after);
+
+#endif /* _SCHEDULE_H */
@@ -0,0 +1,567 @@
+/* ------------------------------------------------------------------------
+ * shared.c
+ *  	Shared memory state of the extension, the triggers notifying
+ * 		the launcher about changes in the job table and about enqueued
+ * 		tasks, and trigger_job, asking the launcher to run a job right away.
+ *
+ * Copyright (c) 2014, Zalando SE.
+ * Portions Copyright (C) 2013-2014, PostgreSQL Global Development Group
+ * ------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+
+#include "access/htup_details.h"
+#include "access/xact.h"
+#include "catalog/pg_type.h"
+#include "commands/trigger.h"
+#include "executor/spi.h"
+#include "fmgr.h"
+#include "lib/stringinfo.h"
+#include "miscadmin.h"
+#include "nodes/pg_list.h"
+#include "storage/ipc.h"
+#include "storage/proc.h"
+#include "storage/shmem.h"
+#include "utils/builtins.h"
+#include "utils/lsyscache.h"
+#include "utils/memutils.h"
+#include "utils/rel.h"
+
+/* Our own include files */
+#include "commons.h"
+#include "counters.h"
+#include "shared.h"
+
+PG_FUNCTION_INFO_V1(notify_job_change);
+PG_FUNCTION_INFO_V1(trigger_job);
+PG_FUNCTION_INFO_V1(notify_task_enqueued);
+
+Datum notify_job_change(PG_FUNCTION_ARGS);
+Datum trigger_job(PG_FUNCTION_ARGS);
+Datum notify_task_enqueued(PG_FUNCTION_ARGS);
+
+SharedState *shared_state = NULL;
+
+static shmem_startup_hook_type prev_shmem_startup_hook = NULL;
+static int 	requested_launchers = 1;
+static int 	requested_job_slots = 0;
+
+/* The number of the launcher running in this process, -1 in any other process */
+static int 	my_launcher = -1;
+
+/* Jobs changed by the current transaction, published to the launcher on commit */
+static List    *pending_job_changes = NIL;
+static bool 	pending_job_reload = false;
+/*
+ * Jobs triggered by the current transaction, handed to the launcher on commit,
+ * with the nesting level of the (sub)transaction which triggered each of them
+ */
+static List    *pending_job_triggers = NIL;
+static List    *pending_trigger_levels = NIL;
+/* Whether the current transaction has enqueued tasks */
+static bool 	pending_tasks = false;
+static bool 	xact_callback_registered = false;
+
+
+static Size
+shared_state_size(int njob_slots)
+{
+	return add_size(offsetof(SharedState, job_slots),
+					mul_size(sizeof(JobSlot), njob_slots));
+}
+
+static void
+shared_state_startup(void)
+{
+	bool 	found;
+	int 	i;
+
+	if (prev_shmem_startup_hook)
+		prev_shmem_startup_hook();
+
+	LWLockAcquire(AddinShmemInitLock, LW_EXCLUSIVE);
+	shared_state = ShmemInitStruct(EXTENSION_NAME, shared_state_size(requested_job_slots), &found);
+	if (!found)
+	{
+		shared_state->lock = LWLockAssign();
+		shared_state->counters_lock = LWLockAssign();
+		shared_state->nlaunchers = requested_launchers;
+		for (i = 0; i < MAX_LAUNCHERS; i++)
+		{
+			LauncherEntry *entry = &shared_state->launchers[i];
+
+			entry->latch = NULL;
+			entry->dboid = InvalidOid;
+			entry->changes_overflowed = false;
+			entry->nchanged = 0;
+			entry->ntriggered = 0;
+			entry->tasks_enqueued = false;
+		}
+		shared_state->njob_slots = requested_job_slots;
+		memset(shared_state->job_slots, 0, sizeof(JobSlot) * requested_job_slots);
+	}
+	job_counters_shmem_init();
+	LWLockRelease(AddinShmemInitLock);
+}
+
+/*
+ * Reserve our shared memory, including the launcher directory, a job slot for
+ * every worker the launchers may run and the job counters. Must be called from
+ * _PG_init.
+ */
+void
+request_shared_state(int nlaunchers, int njob_slots)
+{
+	Assert(nlaunchers >= 1 && nlaunchers <= MAX_LAUNCHERS);
+
+	requested_launchers = nlaunchers;
+	requested_job_slots = njob_slots;
+	RequestAddinShmemSpace(MAXALIGN(shared_state_size(njob_slots)));
+	RequestAddinShmemSpace(job_counters_shmem_size());
+	RequestAddinLWLocks(2);
+
+	prev_shmem_startup_hook = shmem_startup_hook;
+	shmem_startup_hook = shared_state_startup;
+}
+
+/* The job slot with the given index, as passed by the launcher to a worker */
+JobSlot *
+get_job_slot(int index)
+{
+	if (shared_state == NULL || index < 0 || index >= shared_state->njob_slots)
+		elog(ERROR, "invalid job slot %d", index);
+	return &shared_state->job_slots[index];
+}
+
+/*
+ * The launcher owning a job or a task. The ids are handed out by sequences,
+ * so the modulo spreads them evenly and can be evaluated in SQL as well.
+ */
+int
+job_launcher(uint64 id)
+{
+	if (shared_state == NULL || shared_state->nlaunchers <= 1)
+		return 0;
+	return (int) (id % (uint64) shared_state->nlaunchers);
+}
+
+/* Whether the launcher running in this process owns the given job */
+bool
+launcher_owns_job(uint32 job_id)
+{
+	return job_launcher(job_id) == my_launcher;
+}
+
+/*
+ * A condition restricting a query on the job, task or job run queue tables to
+ * the rows owned by the launcher running in this process, to be appended to
+ * its WHERE clause. Empty if there is only one launcher.
+ */
+char *
+launcher_partition_filter(const char *column)
+{
+	if (shared_state->nlaunchers <= 1)
+		return "";
+	return psprintf(" AND %s %% %d = %d", column, shared_state->nlaunchers, my_launcher);
+}
+
+static void
+launcher_detach_shared_state(int code, Datum arg)
+{
+	LauncherEntry *entry = &shared_state->launchers[my_launcher];
+
+	LWLockAcquire(shared_state->lock, LW_EXCLUSIVE);
+	entry->latch = NULL;
+	entry->dboid = InvalidOid;
+	LWLockRelease(shared_state->lock);
+}
+
+/*
+ * Advertise the launcher, so that backends know whom to wake up. Any change
+ * queued before that is irrelevant, the launcher loads all jobs at startup.
+ * The triggered jobs are kept, they were accepted for the previous launcher.
+ */
+void
+launcher_attach_shared_state(int launcher)
+{
+	LauncherEntry *entry;
+
+	if (launcher < 0 || launcher >= shared_state->nlaunchers)
+		elog(ERROR, "invalid launcher number %d", launcher);
+
+	my_launcher = launcher;
+	entry = &shared_state->launchers[launcher];
+
+	LWLockAcquire(shared_state->lock, LW_EXCLUSIVE);
+	entry->latch = &MyProc->procLatch;
+	entry->dboid = MyDatabaseId;
+	entry->changes_overflowed = false;
+	entry->nchanged = 0;
+	LWLockRelease(shared_state->lock);
+
+	before_shmem_exit(launcher_detach_shared_state, (Datum) 0);
+}
+
+/*
+ * Fetch and clear the ids of the jobs changed since the last call.
+ * Returns the number of ids, or -1 if too many jobs changed and the launcher
+ * should reload all of them. job_ids must hold JOB_CHANGE_QUEUE_SIZE entries.
+ */
+int
+fetch_job_changes(uint32 *job_ids)
+{
+	LauncherEntry *entry = &shared_state->launchers[my_launcher];
+	int 	result;
+
+	LWLockAcquire(shared_state->lock, LW_EXCLUSIVE);
+	if (entry->changes_overflowed)
+		result = -1;
+	else
+	{
+		result = entry->nchanged;
+		memcpy(job_ids, entry->changed_jobs, sizeof(uint32) * result);
+	}
+	entry->changes_overflowed = false;
+	entry->nchanged = 0;
+	LWLockRelease(shared_state->lock);
+
+	return result;
+}
+
+/*
+ * Fetch and clear the ids of the jobs triggered since the last call. Returns
+ * the number of ids, job_ids must hold JOB_TRIGGER_QUEUE_SIZE entries.
+ */
+int
+fetch_job_triggers(uint32 *job_ids)
+{
+	LauncherEntry *entry = &shared_state->launchers[my_launcher];
+	int 	result;
+
+	LWLockAcquire(shared_state->lock, LW_EXCLUSIVE);
+	result = entry->ntriggered;
+	memcpy(job_ids, entry->triggered_jobs, sizeof(uint32) * result);
+	entry->ntriggered = 0;
+	LWLockRelease(shared_state->lock);
+
+	return result;
+}
+
+/* Whether tasks have been enqueued since the last call */
+bool
+fetch_tasks_enqueued(void)
+{
+	LauncherEntry *entry = &shared_state->launchers[my_launcher];
+	bool 	result;
+
+	LWLockAcquire(shared_state->lock, LW_EXCLUSIVE);
+	result = entry->tasks_enqueued;
+	entry->tasks_enqueued = false;
+	LWLockRelease(shared_state->lock);
+
+	return result;
+}
+
+/*
+ * Hand over the changes, the triggered jobs and the enqueued tasks to the
+ * launchers owning them. This is done only after commit, when the launchers
+ * are able to see the new version of the rows.
+ */
+static void
+publish_job_changes(void)
+{
+	ListCell   *lc;
+	Latch 	   *latches[MAX_LAUNCHERS];
+	bool 		wake[MAX_LAUNCHERS];
+	int 		nlaunchers;
+	int 		ndropped = 0;
+	int 		i;
+
+	if (shared_state == NULL)
+		return;
+
+	nlaunchers = shared_state->nlaunchers;
+	memset(wake, 0, sizeof(wake));
+
+	LWLockAcquire(shared_state->lock, LW_EXCLUSIVE);
+	foreach(lc, pending_job_changes)
+	{
+		uint32 			job_id = (uint32) lfirst_int(lc);
+		LauncherEntry  *entry = &shared_state->launchers[job_launcher(job_id)];
+
+		if (entry->dboid != MyDatabaseId)
+			continue;
+		wake[job_launcher(job_id)] = true;
+		if (entry->changes_overflowed)
+			continue;
+		if (entry->nchanged >= JOB_CHANGE_QUEUE_SIZE)
+			entry->changes_overflowed = true;
+		else
+			entry->changed_jobs[entry->nchanged++] = job_id;
+	}
+	/* trigger_job checked for room, but other transactions may have committed since */
+	foreach(lc, pending_job_triggers)
+	{
+		uint32 			job_id = (uint32) lfirst_int(lc);
+		LauncherEntry  *entry = &shared_state->launchers[job_launcher(job_id)];
+
+		if (entry->dboid != MyDatabaseId)
+			continue;
+		wake[job_launcher(job_id)] = true;
+		if (entry->ntriggered >= JOB_TRIGGER_QUEUE_SIZE)
+			ndropped++;
+		else
+			entry->triggered_jobs[entry->ntriggered++] = job_id;
+	}
+	/*
+	 * A reload and the tasks concern every launcher. Only the launchers running
+	 * in our database hold the jobs we changed, the others are left alone.
+	 */
+	for (i = 0; i < nlaunchers; i++)
+	{
+		LauncherEntry  *entry = &shared_state->launchers[i];
+
+		latches[i] = NULL;
+		if (entry->dboid != MyDatabaseId)
+			continue;
+		if (pending_job_reload)
+			entry->changes_overflowed = true;
+		if (pending_tasks)
+			entry->tasks_enqueued = true;
+		if (pending_job_reload || pending_tasks)
+			wake[i] = true;
+		latches[i] = entry->latch;
+	}
+	LWLockRelease(shared_state->lock);
+
+	for (i = 0; i < nlaunchers; i++)
+		if (wake[i] && latches[i] != NULL)
+			SetLatch(latches[i]);
+	if (ndropped > 0)
+		elog(WARNING, "%d triggered jobs were dropped, too many jobs are waiting for the launcher", ndropped);
+}
+
+/*
+ * Hand the pending changes to the launchers when the transaction commits. There
+ * is no callback when a prepared transaction is committed later on, in another
+ * session, so just like NOTIFY a transaction which has changed jobs or enqueued
+ * tasks cannot be prepared: the launcher would never learn about the changes.
+ */
+static void
+job_change_xact_callback(XactEvent event, void *arg)
+{
+	switch (event)
+	{
+		case XACT_EVENT_PRE_PREPARE:
+			if (pending_job_changes != NIL || pending_job_reload || pending_job_triggers != NIL ||
+				pending_tasks)
+				ereport(ERROR,
+						(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+						 errmsg("cannot PREPARE a transaction that has changed, triggered or enqueued jobs")));
+			break;
+		case XACT_EVENT_COMMIT:
+			if (pending_job_changes != NIL || pending_job_reload || pending_job_triggers != NIL ||
+				pending_tasks)
+				publish_job_changes();
+			/* fall through */
+		case XACT_EVENT_ABORT:
+		case XACT_EVENT_PREPARE:
+			/* the lists themselves live in the transaction memory context */
+			pending_job_changes = NIL;
+			pending_job_reload = false;
+			pending_job_triggers = NIL;
+			pending_trigger_levels = NIL;
+			pending_tasks = false;
+			break;
+		default:
+			break;
+	}
+}
+
+/*
+ * The jobs triggered by a subtransaction which is rolled back are not run, like
+ * the notifications it sent. When it commits, they pass to its parent.
+ */
+static void
+job_change_subxact_callback(SubXactEvent event, SubTransactionId mySubid,
+							SubTransactionId parentSubid, void *arg)
+{
+	int 			nestlevel = GetCurrentTransactionNestLevel();
+	List 		   *triggers = NIL;
+	List 		   *levels = NIL;
+	ListCell 	   *lc1;
+	ListCell 	   *lc2;
+	MemoryContext 	oldcxt;
+
+	if (pending_job_triggers == NIL ||
+		(event != SUBXACT_EVENT_COMMIT_SUB && event != SUBXACT_EVENT_ABORT_SUB))
+		return;
+
+	oldcxt = MemoryContextSwitchTo(TopTransactionContext);
+	forboth(lc1, pending_job_triggers, lc2, pending_trigger_levels)
+	{
+		int 	level = lfirst_int(lc2);
+
+		if (level >= nestlevel)
+		{
+			if (event == SUBXACT_EVENT_ABORT_SUB)
+				continue;
+			level = nestlevel - 1;
+		}
+		triggers = lappend_int(triggers, lfirst_int(lc1));
+		levels = lappend_int(levels, level);
+	}
+	MemoryContextSwitchTo(oldcxt);
+
+	list_free(pending_job_triggers);
+	list_free(pending_trigger_levels);
+	pending_job_triggers = triggers;
+	pending_trigger_levels = levels;
+}
+
+static void
+register_job_change_callbacks(void)
+{
+	if (xact_callback_registered)
+		return;
+	RegisterXactCallback(job_change_xact_callback, NULL);
+	RegisterSubXactCallback(job_change_subxact_callback, NULL);
+	xact_callback_registered = true;
+}
+
+/*
+ * Trigger on the job table, remembering which jobs have changed. The launcher is
+ * notified at commit time and refreshes only those jobs in its cache. Fired for
+ * a statement, as on the maintenance windows, or by a truncate, the launcher
+ * reloads all jobs.
+ */
+Datum
+notify_job_change(PG_FUNCTION_ARGS)
+{
+	TriggerData    *trigdata = (TriggerData *) fcinfo->context;
+	MemoryContext 	oldcxt;
+
+	if (!CALLED_AS_TRIGGER(fcinfo))
+		elog(ERROR, "notify_job_change: not called by trigger manager");
+
+	register_job_change_callbacks();
+
+	if (TRIGGER_FIRED_BY_TRUNCATE(trigdata->tg_event) ||
+		TRIGGER_FIRED_FOR_STATEMENT(trigdata->tg_event))
+		pending_job_reload = true;
+	else if (!pending_job_reload)
+	{
+		TupleDesc 	tupdesc = trigdata->tg_relation->rd_att;
+		bool 		isnull;
+		int32 		job_id;
+
+		/* The job_id cannot be updated, so the old tuple will do for all operations */
+		job_id = DatumGetInt32(heap_getattr(trigdata->tg_trigtuple,
+											SPI_fnumber(tupdesc, "job_id"),
+											tupdesc, &isnull));
+		Assert(!isnull);
+
+		if (list_length(pending_job_changes) >= JOB_CHANGE_QUEUE_SIZE)
+			pending_job_reload = true;
+		else
+		{
+			oldcxt = MemoryContextSwitchTo(TopTransactionContext);
+			pending_job_changes = lappend_int(pending_job_changes, job_id);
+			MemoryContextSwitchTo(oldcxt);
+		}
+	}
+
+	return PointerGetDatum(NULL);
+}
+
+/*
+ * Ask the launcher to run a job in a background worker right away, without
+ * waiting for its schedule. The request is handed to the launcher when the
+ * transaction commits, so the job sees the changes made by the transaction.
+ */
+Datum
+trigger_job(PG_FUNCTION_ARGS)
+{
+	int32 			job_id = PG_GETARG_INT32(0);
+	Oid 			argtypes[1] = {INT4OID};
+	Datum 			values[1];
+	StringInfoData 	buf;
+	MemoryContext 	oldcxt;
+	LauncherEntry  *entry;
+	Oid 			launcher_dboid;
+	int 			ntriggered;
+	bool 			enabled;
+	bool 			isnull;
+
+	if (shared_state == NULL)
+		ereport(ERROR,
+				(errcode(ERRCODE_OBJECT_NOT_IN_PREREQUISITE_STATE),
+				 errmsg("%s must be loaded via shared_preload_libraries", EXTENSION_NAME)));
+
+	/* Like in the forecast, only the jobs of the roles of the session user are visible */
+	initStringInfo(&buf);
+	appendStringInfo(&buf, "SELECT enabled "
+							 "FROM %s.job "
+							"WHERE job_id = $1 "
+							  "AND pg_has_role(session_user, roloid, 'MEMBER')",
+							 quote_identifier(get_namespace_name(get_func_namespace(fcinfo->flinfo->fn_oid))));
+	values[0] = Int32GetDatum(job_id);
+
+	SPI_connect();
+	if (SPI_execute_with_args(buf.data, 1, argtypes, values, NULL, true, 1) != SPI_OK_SELECT)
+		elog(ERROR, "cannot look up job %d", job_id);
+	if (SPI_processed == 0)
+		ereport(ERROR,
+				(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+				 errmsg("job %d does not exist", job_id)));
+	enabled = DatumGetBool(SPI_getbinval(SPI_tuptable->vals[0], SPI_tuptable->tupdesc, 1, &isnull));
+	SPI_finish();
+	pfree(buf.data);
+
+	if (!enabled)
+		ereport(ERROR,
+				(errcode(ERRCODE_OBJECT_NOT_IN_PREREQUISITE_STATE),
+				 errmsg("job %d is disabled", job_id)));
+
+	LWLockAcquire(shared_state->lock, LW_SHARED);
+	entry = &shared_state->launchers[job_launcher((uint32) job_id)];
+	launcher_dboid = entry->dboid;
+	ntriggered = entry->ntriggered;
+	LWLockRelease(shared_state->lock);
+
+	if (launcher_dboid != MyDatabaseId)
+		ereport(ERROR,
+				(errcode(ERRCODE_OBJECT_NOT_IN_PREREQUISITE_STATE),
+				 errmsg("the launcher is not running in this database")));
+	if (ntriggered + list_length(pending_job_triggers) >= JOB_TRIGGER_QUEUE_SIZE)
+		ereport(ERROR,
+				(errcode(ERRCODE_CONFIGURATION_LIMIT_EXCEEDED),
+				 errmsg("too many triggered jobs are waiting for the launcher"),
+				 errhint("Try again later.")));
+
+	register_job_change_callbacks();
+
+	oldcxt = MemoryContextSwitchTo(TopTransactionContext);
+	pending_job_triggers = lappend_int(pending_job_triggers, job_id);
+	pending_trigger_levels = lappend_int(pending_trigger_levels, GetCurrentTransactionNestLevel());
+	MemoryContextSwitchTo(oldcxt);
+
+	PG_RETURN_VOID();
+}
+
+/*
+ * Statement trigger on the task table. The launcher is woken up at commit time
+ * and reads the tasks which are due, a single flag does for any number of tasks.
+ */
+Datum
+notify_task_enqueued(PG_FUNCTION_ARGS)
+{
+	if (!CALLED_AS_TRIGGER(fcinfo))
+		elog(ERROR, "notify_task_enqueued: not called by trigger manager");
+
+	register_job_change_callbacks();
+	pending_tasks = true;
+
+	return PointerGetDatum(NULL);
+}
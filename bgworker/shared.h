@@ -0,0 +1,75 @@
+/* ------------------------------------------------------------------------
+ * shared.h
+ *  	Shared memory state used to communicate between the launcher
+ * 		and regular backends.
+ *
+ * Copyright (c) 2014, Zalando SE.
+ * Portions Copyright (C) 2013-2014, PostgreSQL Global Development Group
+ * ------------------------------------------------------------------------
+ */
+
+#ifndef _SHARED_H
+#define _SHARED_H
+
+#include "postgres.h"
+
+#include "storage/latch.h"
+#include "storage/lwlock.h"
+
+#include "jobs.h"
+
+/* Number of changed job ids remembered before the launcher has to reload all jobs */
+#define JOB_CHANGE_QUEUE_SIZE 	1024
+
+/* Number of runs requested by trigger_job which may wait for the launcher */
+#define JOB_TRIGGER_QUEUE_SIZE 	1024
+
+/* The maximum value of elephant_worker.launchers */
+#define MAX_LAUNCHERS 			16
+
+/*
+ * The entry of a launcher in the launcher directory. Every launcher owns the
+ * jobs whose job_id modulo the number of launchers equals its number.
+ */
+typedef struct LauncherEntry
+{
+	/* Latch and database of the launcher, NULL and InvalidOid if not running */
+	Latch 	   *latch;
+	Oid 		dboid;
+	/* Jobs changed by committed transactions, not yet seen by the launcher */
+	bool 		changes_overflowed;
+	int 		nchanged;
+	uint32 		changed_jobs[JOB_CHANGE_QUEUE_SIZE];
+	/* Jobs triggered by committed transactions, not yet queued by the launcher */
+	int 		ntriggered;
+	uint32 		triggered_jobs[JOB_TRIGGER_QUEUE_SIZE];
+	/* Tasks have been enqueued since the launcher last read the task table */
+	bool 		tasks_enqueued;
+} LauncherEntry;
+
+typedef struct SharedState
+{
+	/* Protects the launcher directory */
+	LWLock 	   *lock;
+	/* Protects the job counters hash, see counters.c */
+	LWLock 	   *counters_lock;
+	int 		nlaunchers;
+	LauncherEntry launchers[MAX_LAUNCHERS];
+	/* Jobs handed to the workers, a range of slots per launcher */
+	int 		njob_slots;
+	JobSlot 	job_slots[FLEXIBLE_ARRAY_MEMBER];
+} SharedState;
+
+extern SharedState *shared_state;
+
+void request_shared_state(int nlaunchers, int njob_slots);
+JobSlot *get_job_slot(int index);
+void launcher_attach_shared_state(int launcher);
+int job_launcher(uint64 id);
+bool launcher_owns_job(uint32 job_id);
+char *launcher_partition_filter(const char *column);
+int fetch_job_changes(uint32 *job_ids);
+int fetch_job_triggers(uint32 *job_ids);
+bool fetch_tasks_enqueued(void);
+
+#endif /* _SHARED_H */
@@ -0,0 +1,252 @@
+/* ------------------------------------------------------------------------
+ * taskqueue.c
+ *  	Holds the one-shot tasks which are due until the launcher hands
+ * 		them to a worker. Tasks are enqueued by inserting them into the task
+ * 		table, which has no triggers besides the one waking up the launcher
+ * 		and a single index, so enqueueing is cheap.
+ *
+ * 		The launcher is the only consumer of the table. It reads the due
+ * 		tasks in batches of at most TASK_BATCH_SIZE, in the order they are
+ * 		due, and deletes them once they have been started, in the same
+ * 		transaction as the job run queue. A task left in the table by a
+ * 		launcher which stopped before that is started again.
+ *
+ * Copyright (c) 2014, Zalando SE.
+ * Portions Copyright (C) 2013-2014, PostgreSQL Global Development Group
+ * ------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+
+#include "catalog/pg_type.h"
+#include "executor/spi.h"
+#include "lib/stringinfo.h"
+#include "utils/array.h"
+#include "utils/builtins.h"
+#include "utils/hsearch.h"
+#include "utils/memutils.h"
+
+/* Our own include files */
+#include "taskqueue.h"
+#include "shared.h"
+
+static MemoryContext 	task_queue_context = NULL;
+/* The tasks read from the table which have not been deleted yet */
+static HTAB 		   *held_tasks = NULL;
+static int 				nwaiting = 0;
+/* The ids of the tasks started since the last write */
+static List 		   *started_tasks = NIL;
+
+/* More due tasks may be in the table than we have read, initially we know nothing */
+static bool 			tasks_pending = true;
+/* The moment the first task in the table which is not due yet becomes due, 0 if none */
+static TimestampTz 		next_due = 0;
+
+
+static void
+task_queue_init(void)
+{
+	HASHCTL 	ctl;
+
+	task_queue_context = AllocSetContextCreate(TopMemoryContext,
+											   "elephant task queue",
+											   ALLOCSET_DEFAULT_MINSIZE,
+											   ALLOCSET_DEFAULT_INITSIZE,
+											   ALLOCSET_DEFAULT_MAXSIZE);
+
+	memset(&ctl, 0, sizeof(ctl));
+	ctl.keysize = sizeof(uint64);
+	ctl.entrysize = sizeof(Task);
+	ctl.hash = tag_hash;
+	ctl.hcxt = task_queue_context;
+	held_tasks = hash_create("elephant held tasks", TASK_BATCH_SIZE, &ctl,
+							 HASH_ELEM | HASH_FUNCTION | HASH_CONTEXT);
+}
+
+/* Tasks have been enqueued by a committed transaction */
+void
+task_queue_notify(void)
+{
+	tasks_pending = true;
+}
+
+/*
+ * Whether the task table should be read: tasks have been enqueued or have
+ * become due since the last read, and fewer than a batch of tasks is waiting.
+ */
+bool
+task_queue_wanted(TimestampTz now)
+{
+	if (nwaiting >= TASK_BATCH_SIZE)
+		return false;
+	return tasks_pending || (next_due != 0 && next_due <= now);
+}
+
+/*
+ * Read the due tasks which are not held yet, up to a batch. Returns the tasks
+ * read, the caller should hand them to the dispatch queue.
+ * Must be called inside a transaction with SPI connected.
+ */
+List *
+task_queue_load(const char *schema)
+{
+	ArrayBuildState *held = NULL;
+	HASH_SEQ_STATUS status;
+	StringInfoData 	buf;
+	MemoryContext 	oldcxt;
+	Oid 			argtypes[2];
+	Datum 			values[2];
+	Task 		   *task;
+	List 		   *result = NIL;
+	Datum 			first_due;
+	bool 			isnull;
+	int 			limit;
+	int 			i;
+
+	if (task_queue_context == NULL)
+		task_queue_init();
+
+	/* The started tasks are held as well, until they have been deleted. Task ids start at 1. */
+	held = accumArrayResult(held, Int64GetDatum(0), false, INT8OID, CurrentMemoryContext);
+	hash_seq_init(&status, held_tasks);
+	while ((task = hash_seq_search(&status)) != NULL)
+		held = accumArrayResult(held, Int64GetDatum((int64) task->task_id), false, INT8OID, CurrentMemoryContext);
+
+	limit = TASK_BATCH_SIZE - nwaiting;
+	argtypes[0] = INT8ARRAYOID;
+	argtypes[1] = INT4OID;
+	values[0] = makeArrayResult(held, CurrentMemoryContext);
+	values[1] = Int32GetDatum(limit);
+
+	initStringInfo(&buf);
+	appendStringInfo(&buf, "SELECT task_id, datname, rolname, task_command "
+							 "FROM %s.%s "
+							"WHERE not_before <= now() "
+							  "AND task_id <> ALL($1)%s "
+							"ORDER BY not_before, task_id "
+							"LIMIT $2",
+							quote_identifier(schema), TASK_RELNAME, launcher_partition_filter("task_id"));
+	if (SPI_execute_with_args(buf.data, 2, argtypes, values, NULL, true, 0) != SPI_OK_SELECT)
+		elog(ERROR, "could not read the task queue");
+
+	tasks_pending = (SPI_processed == limit);
+
+	oldcxt = MemoryContextSwitchTo(task_queue_context);
+	for (i = 0; i < SPI_processed; i++)
+	{
+		HeapTuple 	tuple = SPI_tuptable->vals[i];
+		TupleDesc 	tupdesc = SPI_tuptable->tupdesc;
+		uint64 		task_id;
+
+		task_id = (uint64) DatumGetInt64(SPI_getbinval(tuple, tupdesc, 1, &isnull));
+		task = hash_search(held_tasks, &task_id, HASH_ENTER, NULL);
+		task->started = false;
+		snprintf(task->datname, NAMEDATALEN, "%s", SPI_getvalue(tuple, tupdesc, 2));
+		snprintf(task->rolname, NAMEDATALEN, "%s", SPI_getvalue(tuple, tupdesc, 3));
+		task->command = pstrdup(SPI_getvalue(tuple, tupdesc, 4));
+		nwaiting++;
+		result = lappend(result, task);
+	}
+	MemoryContextSwitchTo(oldcxt);
+
+	/* The tasks which are not due yet are read when they are */
+	resetStringInfo(&buf);
+	appendStringInfo(&buf, "SELECT min(not_before) FROM %s.%s WHERE not_before > now()%s",
+					 quote_identifier(schema), TASK_RELNAME, launcher_partition_filter("task_id"));
+	if (SPI_execute(buf.data, true, 1) != SPI_OK_SELECT || SPI_processed != 1)
+		elog(ERROR, "could not read the task queue");
+	first_due = SPI_getbinval(SPI_tuptable->vals[0], SPI_tuptable->tupdesc, 1, &isnull);
+	next_due = isnull ? 0 : DatumGetTimestampTz(first_due);
+	pfree(buf.data);
+
+	elog(DEBUG1, "read %d tasks, %d tasks are waiting", list_length(result), nwaiting);
+	return result;
+}
+
+/* The held task with the given id, NULL if it is unknown */
+Task *
+task_queue_lookup(uint64 task_id)
+{
+	if (task_queue_context == NULL)
+		return NULL;
+	return hash_search(held_tasks, &task_id, HASH_FIND, NULL);
+}
+
+/* A task has been handed to a worker, it is deleted from the table on the next write */
+void
+task_queue_started(uint64 task_id)
+{
+	Task 		   *task = task_queue_lookup(task_id);
+	MemoryContext 	oldcxt;
+
+	if (task == NULL || task->started)
+		return;
+
+	task->started = true;
+	pfree(task->command);
+	task->command = NULL;
+	nwaiting--;
+
+	oldcxt = MemoryContextSwitchTo(task_queue_context);
+	started_tasks = lappend(started_tasks, &task->task_id);
+	MemoryContextSwitchTo(oldcxt);
+}
+
+/* Whether started tasks have to be deleted from the task table */
+bool
+task_queue_changed(void)
+{
+	return started_tasks != NIL;
+}
+
+/*
+ * Delete the tasks started since the previous call from the task table.
+ * Must be called inside a transaction with SPI connected.
+ */
+void
+task_queue_write(const char *schema)
+{
+	ArrayBuildState *task_ids = NULL;
+	StringInfoData 	buf;
+	Oid 			argtype = INT8ARRAYOID;
+	Datum 			value;
+	ListCell 	   *lc;
+
+	if (started_tasks == NIL)
+		return;
+
+	foreach(lc, started_tasks)
+		task_ids = accumArrayResult(task_ids, Int64GetDatum(*(int64 *) lfirst(lc)), false,
+									INT8OID, CurrentMemoryContext);
+	value = makeArrayResult(task_ids, CurrentMemoryContext);
+
+	initStringInfo(&buf);
+	appendStringInfo(&buf, "DELETE FROM %s.%s WHERE task_id = ANY($1)",
+					 quote_identifier(schema), TASK_RELNAME);
+	if (SPI_execute_with_args(buf.data, 1, &argtype, &value, NULL, false, 0) != SPI_OK_DELETE)
+		elog(ERROR, "could not delete %d started tasks", list_length(started_tasks));
+	pfree(buf.data);
+
+	elog(DEBUG1, "deleted %d started tasks", list_length(started_tasks));
+
+	/* The list points into the hash entries, so the entries go last */
+	foreach(lc, started_tasks)
+	{
+		uint64 	task_id = *(uint64 *) lfirst(lc);
+
+		hash_search(held_tasks, &task_id, HASH_REMOVE, NULL);
+	}
+	list_free(started_tasks);
+	started_tasks = NIL;
+}
+
+/* The moment the launcher has to read the task table for tasks becoming due, 0 if never */
+TimestampTz
+task_queue_next_due(void)
+{
+	if (nwaiting >= TASK_BATCH_SIZE)
+		return 0;
+	if (tasks_pending)
+		return GetCurrentTimestamp();
+	return next_due;
+}
@@ -0,0 +1,47 @@
+/* ------------------------------------------------------------------------
+ * taskqueue.h
+ *  	The one-shot tasks from the task table which are due, held by the
+ * 		launcher until they are handed to a worker.
+ *
+ * Copyright (c) 2014, Zalando SE.
+ * Portions Copyright (C) 2013-2014, PostgreSQL Global Development Group
+ * ------------------------------------------------------------------------
+ */
+
+#ifndef _TASKQUEUE_H
+#define _TASKQUEUE_H
+
+#include "postgres.h"
+
+#include "nodes/pg_list.h"
+#include "utils/timestamp.h"
+
+#include "jobs.h"
+
+#define TASK_RELNAME 		"task"
+
+/* At most this many due tasks are held by the launcher at a time */
+#define TASK_BATCH_SIZE 	1024
+
+/* Tasks have no timeout of their own, they get the default timeout of a job */
+#define TASK_TIMEOUT 		(6 * 60 * 60)
+
+typedef struct Task
+{
+	uint64 		task_id; 		/* hash key, must be first */
+	bool 		started; 		/* handed to a worker, not deleted from the table yet */
+	char 		datname[NAMEDATALEN];
+	char 		rolname[NAMEDATALEN];
+	char 	   *command;
+} Task;
+
+void task_queue_notify(void);
+bool task_queue_wanted(TimestampTz now);
+List *task_queue_load(const char *schema);
+Task *task_queue_lookup(uint64 task_id);
+void task_queue_started(uint64 task_id);
+bool task_queue_changed(void);
+void task_queue_write(const char *schema);
+TimestampTz task_queue_next_due(void);
+
+#endif /* _TASKQUEUE_H */
@@ -0,0 +1,242 @@
+/* ------------------------------------------------------------------------
+ * window.c
+ *  	The launcher's copy of the maintenance windows. A window opens
+ * 		whenever its schedule fires and stays open for its duration. The
+ * 		runs of a job referencing a window are only released while it is
+ * 		open. For every opening of a window a plan is kept with the moment
+ * 		each worker slot becomes free: a run is given the slot which is
+ * 		free first and released at that moment, if its predicted duration
+ * 		lets it finish before the window closes, or else planned in the
+ * 		next opening. Windows are few and change rarely, they are reloaded
+ * 		with all jobs.
+ *
+ * Copyright (c) 2014, Zalando SE.
+ * Portions Copyright (C) 2013-2014, PostgreSQL Global Development Group
+ * ------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+
+#include "executor/spi.h"
+#include "lib/stringinfo.h"
+#include "nodes/pg_list.h"
+#include "utils/builtins.h"
+#include "utils/hsearch.h"
+#include "utils/memutils.h"
+
+/* Our own include files */
+#include "window.h"
+
+/* The number of openings looked at to plan a run, a year of daily windows */
+#define WINDOW_MAX_OPENINGS 	366
+/* How late after the opening a run longer than the window may start, in seconds */
+#define WINDOW_START_GRACE 		60
+
+/* The slots of an opening of a window */
+typedef struct WindowPlan
+{
+	pg_time_t 	opens;
+	pg_time_t 	closes;
+	pg_time_t  *slot_free; 		/* the moment every worker slot becomes free */
+} WindowPlan;
+
+typedef struct WindowEntry
+{
+	uint32 		window_id; 		/* hash key, must be first */
+	CompiledSchedule opens;
+	uint32 		duration; 		/* in seconds */
+	List 	   *plans; 			/* of the openings which have not closed yet */
+} WindowEntry;
+
+static MemoryContext 	window_context = NULL;
+static HTAB 		   *windows = NULL;
+static int 				window_slots = 1;
+
+
+/*
+ * (Re)load all maintenance windows, forgetting the plans. The runs planned
+ * already keep their release moment. nslots is the number of worker slots.
+ * Must be called inside a transaction with SPI connected.
+ */
+void
+window_cache_load(const char *schema, int nslots)
+{
+	HASHCTL 		ctl;
+	StringInfoData 	buf;
+	int 			i;
+
+	if (window_context == NULL)
+		window_context = AllocSetContextCreate(TopMemoryContext,
+											   "elephant maintenance windows",
+											   ALLOCSET_DEFAULT_MINSIZE,
+											   ALLOCSET_DEFAULT_INITSIZE,
+											   ALLOCSET_DEFAULT_MAXSIZE);
+	else
+		MemoryContextReset(window_context);
+
+	memset(&ctl, 0, sizeof(ctl));
+	ctl.keysize = sizeof(uint32);
+	ctl.entrysize = sizeof(WindowEntry);
+	ctl.hash = tag_hash;
+	ctl.hcxt = window_context;
+	windows = hash_create("elephant maintenance windows", 16, &ctl,
+						  HASH_ELEM | HASH_FUNCTION | HASH_CONTEXT);
+	window_slots = Max(nslots, 1);
+
+	initStringInfo(&buf);
+	appendStringInfo(&buf, "SELECT window_id, opens, extract(epoch from duration)::integer FROM %s.%s",
+					 quote_identifier(schema), WINDOW_RELNAME);
+	if (SPI_execute(buf.data, true, 0) != SPI_OK_SELECT)
+		elog(ERROR, "cannot load the maintenance windows");
+
+	for (i = 0; i < SPI_processed; i++)
+	{
+		HeapTuple 		tuple = SPI_tuptable->vals[i];
+		TupleDesc 		tupdesc = SPI_tuptable->tupdesc;
+		WindowEntry    *entry;
+		uint32 			window_id;
+		bool 			isnull;
+
+		window_id = DatumGetInt32(SPI_getbinval(tuple, tupdesc, 1, &isnull));
+		entry = hash_search(windows, &window_id, HASH_ENTER, NULL);
+		compile_schedule(DatumGetScheduleP(SPI_getbinval(tuple, tupdesc, 2, &isnull)),
+						 &entry->opens, window_context);
+		entry->duration = DatumGetInt32(SPI_getbinval(tuple, tupdesc, 3, &isnull));
+		entry->plans = NIL;
+	}
+	pfree(buf.data);
+
+	elog(DEBUG1, "loaded %ld maintenance windows", hash_get_num_entries(windows));
+}
+
+/*
+ * The first opening of the window which has not closed at the given moment,
+ * SCHEDULE_NEVER if there is none. An opening which is under way counts.
+ */
+static pg_time_t
+window_next_opening(WindowEntry *entry, pg_time_t after)
+{
+	return schedule_next_fire(&entry->opens, after - entry->duration);
+}
+
+/* The plan of the opening of the window at the given moment */
+static WindowPlan *
+window_get_plan(WindowEntry *entry, pg_time_t opens, pg_time_t now)
+{
+	MemoryContext 	oldcxt;
+	WindowPlan 	   *plan;
+	ListCell 	   *lc;
+	ListCell 	   *prev = NULL;
+	ListCell 	   *next;
+	int 			i;
+
+	/* Forget the plans of the openings which have closed */
+	for (lc = list_head(entry->plans); lc != NULL; lc = next)
+	{
+		next = lnext(lc);
+		plan = lfirst(lc);
+		if (plan->closes <= now)
+		{
+			entry->plans = list_delete_cell(entry->plans, lc, prev);
+			pfree(plan->slot_free);
+			pfree(plan);
+			continue;
+		}
+		if (plan->opens == opens)
+			return plan;
+		prev = lc;
+	}
+
+	oldcxt = MemoryContextSwitchTo(window_context);
+	plan = palloc(sizeof(WindowPlan));
+	plan->opens = opens;
+	plan->closes = opens + entry->duration;
+	plan->slot_free = palloc(sizeof(pg_time_t) * window_slots);
+	for (i = 0; i < window_slots; i++)
+		plan->slot_free[i] = opens;
+	entry->plans = lappend(entry->plans, plan);
+	MemoryContextSwitchTo(oldcxt);
+
+	return plan;
+}
+
+/*
+ * Plan a run of a job in the given window, returns the moment it should be
+ * released. The run gets the worker slot which is free first in the first
+ * opening in which it finishes in time, according to its predicted duration.
+ * A run which is predicted to take longer than the window is open only starts
+ * at the opening of the window. A run of an unknown window is released now.
+ */
+pg_time_t
+window_plan_run(uint32 window_id, uint32 predicted, pg_time_t now)
+{
+	WindowEntry    *entry = NULL;
+	pg_time_t 		after = now;
+	pg_time_t 		first_opening = SCHEDULE_NEVER;
+	int 			n;
+
+	if (windows != NULL)
+		entry = hash_search(windows, &window_id, HASH_FIND, NULL);
+	if (entry == NULL)
+		return now;
+
+	for (n = 0; n < WINDOW_MAX_OPENINGS; n++)
+	{
+		pg_time_t 	opens = window_next_opening(entry, after);
+		WindowPlan *plan;
+		pg_time_t 	start;
+		int 		best = 0;
+		int 		i;
+
+		if (opens == SCHEDULE_NEVER)
+			break;
+		if (first_opening == SCHEDULE_NEVER)
+			first_opening = opens;
+
+		plan = window_get_plan(entry, opens, now);
+		for (i = 1; i < window_slots; i++)
+			if (plan->slot_free[i] < plan->slot_free[best])
+				best = i;
+		start = Max(plan->slot_free[best], now);
+
+		if (start + (pg_time_t) predicted <= plan->closes ||
+			(predicted > entry->duration && start <= opens + WINDOW_START_GRACE))
+		{
+			plan->slot_free[best] = start + predicted;
+			return start;
+		}
+		after = plan->closes;
+	}
+
+	/* The window does not open anymore, or it is fully booked for a long time */
+	if (first_opening == SCHEDULE_NEVER)
+	{
+		elog(WARNING, "maintenance window %u does not open anymore, its jobs run right away", window_id);
+		return now;
+	}
+	return Max(first_opening, now);
+}
+
+/*
+ * Whether a run of a job in the given window may start now, the window must be
+ * open long enough for the run to finish, as far as it can be predicted. A run
+ * longer than the window may only start right after the opening.
+ */
+bool
+window_allows_run(uint32 window_id, uint32 predicted, pg_time_t now)
+{
+	WindowEntry    *entry = NULL;
+	pg_time_t 		opens;
+
+	if (windows != NULL)
+		entry = hash_search(windows, &window_id, HASH_FIND, NULL);
+	if (entry == NULL)
+		return true;
+
+	opens = window_next_opening(entry, now);
+	if (opens == SCHEDULE_NEVER || opens > now)
+		return false;
+	if (predicted > entry->duration)
+		return now <= opens + WINDOW_START_GRACE;
+	return now + (pg_time_t) predicted <= opens + entry->duration;
+}
@@ -0,0 +1,24 @@
+/* ------------------------------------------------------------------------
+ * window.h
+ *  	Maintenance windows, the periods in which the heavy jobs
+ * 		referencing them may run, and the packing of their runs.
+ *
+ * Copyright (c) 2014, Zalando SE.
+ * Portions Copyright (C) 2013-2014, PostgreSQL Global Development Group
+ * ------------------------------------------------------------------------
+ */
+
+#ifndef _WINDOW_H
+#define _WINDOW_H
+
+#include "postgres.h"
+
+#include "schedule.h"
+
+#define WINDOW_RELNAME 		"maintenance_window"
+
+void window_cache_load(const char *schema, int nslots);
+pg_time_t window_plan_run(uint32 window_id, uint32 predicted, pg_time_t now);
+bool window_allows_run(uint32 window_id, uint32 predicted, pg_time_t now);
+
+#endif /* _WINDOW_H */
@@ -2,7 +2,10 @@
  * worker.c
  *  	Implementation of the worker process, running a single cron job.
  * 		The process is responsible for getting the job definition from
- *		launcher, execution and logging the results in a database table.
+ *		launcher, execution and reporting the outcome back to the launcher,
+ *		which writes it to the job log.
+ *		In pool mode a worker stays alive, receiving jobs for its database
+ *		and role from the launcher over a shared memory queue.
  *
  * Copyright (c) 2014, Zalando SE.
  * Portions Copyright (C) 2013-2014, PostgreSQL Global Development Group
@@ -22,29 +25,37 @@
 
  /* these headers are used by this particular worker's code */
 #include "access/xact.h"
+#include "catalog/pg_type.h"
 #include "executor/spi.h"
 #include "fmgr.h"
 #include "lib/stringinfo.h"
 #include "pgstat.h"
+#include "storage/barrier.h"
 #include "storage/dsm.h"
+#include "storage/shm_mq.h"
+#include "storage/shm_toc.h"
 #include "utils/builtins.h"
 #include "utils/memutils.h"
+#include "utils/resowner.h"
 #include "utils/snapmgr.h"
+#include "utils/timestamp.h"
 #include "tcop/utility.h"
 
  /* Our own include files */
 #include "commons.h"
 #include "jobs.h"
+#include "pool.h"
+#include "shared.h"
+#include "worker.h"
 
 #define PROCESS_NAME "elephant worker"
+#define POOL_PROCESS_NAME "elephant pool worker"
 
 static volatile sig_atomic_t got_sighup = false;
 static volatile sig_atomic_t got_sigterm = false;
 
 static JobDesc *job;
 
-static db_object_data  job_run_function;
-
 
 /* Signal handler for SIGHUP
  *		Set a flag to tell the main loop to reread the config file, and set
@@ -79,41 +90,190 @@ worker_sigterm(SIGNAL_ARGS)
 	errno = save_errno;
 }
 
-/* attach worker to the shared memory segment, read the job structure */
+/* read the job structure from the job slot the launcher has given us */
 static void
-initialize_worker(uint32 segment)
+initialize_worker(int slot_index)
 {
-	dsm_segment   *seg;
-	/* Connect to dynamic shared memory segment.
-	 *
-	 * In order to attach a dynamic shared memory segment, we need a
-	 * resource owner.
-	 */
-/*	 CurrentResourceOwner = ResourceOwnerCreate(NULL, PROCESS_NAME);*/
-
-	 seg = dsm_attach(segment);
-	 if (seg == NULL)
-	 	ereport(ERROR,
-	 			(errcode(ERRCODE_OBJECT_NOT_IN_PREREQUISITE_STATE),
-	 			 errmsg("unable to map dynamic shared memory segment")));
-
-	 job_run_function.schema = quote_identifier(job->schemaname);
-	 job_run_function.name = quote_identifier("run_job");
+	JobSlot 	  *slot;
 
+	 slot = get_job_slot(slot_index);
 	 job = palloc(sizeof(JobDesc));
-	 /* copy the arguments from shared memory segment */
-	 memcpy(job, dsm_segment_address(seg), sizeof(JobDesc));
+	 /* copy the arguments from shared memory */
+	 memcpy(job, &slot->job, sizeof(JobDesc));
 
-	 /* and detach it right away */
-	 dsm_detach(seg);
+	 /* let the launcher know we are running */
+	 pg_write_barrier();
+	 slot->attached = true;
+}
 
+static void
+copy_result_field(char *dest, const char *src)
+{
+	strlcpy(dest, src != NULL ? src : "", JOB_RESULT_FIELD_LEN);
+}
+
+/*
+ * Sleep for the given number of milliseconds between two batches. The latch is
+ * also set by the job queue of a pooled worker, so we may have to go back to
+ * sleep. We stop sleeping when we are asked to terminate.
+ */
+static void
+batch_delay(uint32 delay)
+{
+	TimestampTz 	wakeup = TimestampTzPlusMilliseconds(GetCurrentTimestamp(), delay);
+
+	while (!got_sigterm)
+	{
+		long 	secs;
+		int 	microsecs;
+		int 	rc;
+
+		TimestampDifference(GetCurrentTimestamp(), wakeup, &secs, &microsecs);
+		if (secs == 0 && microsecs == 0)
+			return;
+
+		rc = WaitLatch(&MyProc->procLatch,
+					   WL_LATCH_SET | WL_TIMEOUT | WL_POSTMASTER_DEATH,
+					   secs * 1000 + (microsecs + 999) / 1000);
+		ResetLatch(&MyProc->procLatch);
+
+		/* Emergency exit */
+		if (rc & WL_POSTMASTER_DEATH)
+			proc_exit(1);
+	}
+}
+
+/*
+ * Run the command of the job once, in a transaction of its own. The batch size,
+ * if any, is passed as $1. Returns the number of rows processed.
+ */
+static uint64
+execute_command(JobDesc *job)
+{
+	Oid 		argtypes[1] = {INT4OID};
+	Datum 		values[1];
+	uint64 		rows;
+	int 		ret;
+
+	SetCurrentStatementStartTimestamp();
+	StartTransactionCommand();
+	SPI_connect();
+	PushActiveSnapshot(GetTransactionSnapshot());
+	pgstat_report_activity(STATE_RUNNING, job->command);
+
+	if (job->batch_size > 0)
+	{
+		values[0] = Int32GetDatum(job->batch_size);
+		ret = SPI_execute_with_args(job->command, 1, argtypes, values, NULL, false, 0);
+	}
+	else
+		ret = SPI_execute(job->command, false, 0);
+	if (ret < 0)
+		elog(ERROR, "errors while executing job %d", job->job_id);
+	rows = SPI_processed;
+
+	/* Commmit the transaction */
+	SPI_finish();
+	PopActiveSnapshot();
+	CommitTransactionCommand();
+
+	return rows;
+}
+
+/*
+ * Run the given job and fill in its outcome. A job is run in a transaction of
+ * its own, a batch job runs its command again in a new transaction until it
+ * processes no rows, sleeping batch_delay in between, or longer if the batch
+ * has spent more than its cost budget. Errors raised by the job
+ * do not propagate, they are reported in the result, which the launcher writes
+ * to the job log. The batches committed before an error stay committed.
+ */
+static void
+execute_job(JobDesc *job, JobResult *result)
+{
+	MemoryContext 	oldcxt = CurrentMemoryContext;
+
+	memset(result, 0, sizeof(JobResult));
+	result->job_id = job->job_id;
+	result->started = GetCurrentTimestamp();
+
+	PG_TRY();
+	{
+		if (job->batch_size <= 0)
+			result->rows = execute_command(job);
+		else
+		{
+			for (;;)
+			{
+				uint64 	rows;
+				uint32 	delay = job->batch_delay;
+
+				/* The buffer manager charges the batch like vacuum, see vacuum_delay_point */
+				VacuumCostBalance = 0;
+				VacuumCostActive = (job->cost_delay > 0);
+				rows = execute_command(job);
+				VacuumCostActive = false;
+
+				if (result->nbatches < JOB_RESULT_MAX_BATCHES)
+					result->batch_rows[result->nbatches] = rows;
+				result->nbatches++;
+				result->rows += rows;
+				if (rows == 0)
+					break;
+
+				/*
+				 * Sleep cost_delay for every cost_limit the batch has spent, so that
+				 * the job stays within its budget on average. Unlike vacuum we do
+				 * not sleep halfway, the job would hold on to its locks meanwhile.
+				 */
+				if (job->cost_delay > 0)
+					delay = Max(delay, (uint32) Min((double) job->cost_delay * VacuumCostBalance / job->cost_limit,
+													(double) INT_MAX));
+
+				pgstat_report_activity(STATE_IDLE, NULL);
+				if (delay > 0)
+					batch_delay(delay);
+				if (got_sigterm)
+					ereport(ERROR,
+							(errcode(ERRCODE_ADMIN_SHUTDOWN),
+							 errmsg("job %d was terminated after %u batches", job->job_id, result->nbatches)));
+			}
+		}
+
+		strlcpy(result->sqlstate, "00000", sizeof(result->sqlstate));
+	}
+	PG_CATCH();
+	{
+		ErrorData  *edata;
+
+		HOLD_INTERRUPTS();
+		VacuumCostActive = false;
+		MemoryContextSwitchTo(oldcxt);
+		edata = CopyErrorData();
+		FlushErrorState();
+		AbortOutOfAnyTransaction();
+		RESUME_INTERRUPTS();
+
+		strlcpy(result->sqlstate, unpack_sql_state(edata->sqlerrcode), sizeof(result->sqlstate));
+		copy_result_field(result->message, edata->message);
+		copy_result_field(result->detail, edata->detail);
+		copy_result_field(result->hint, edata->hint);
+		copy_result_field(result->context, edata->context);
+		FreeErrorData(edata);
+
+		elog(LOG, "job %d failed with sqlstate %s: %s", job->job_id, result->sqlstate, result->message);
+	}
+	PG_END_TRY();
+
+	result->stopped = GetCurrentTimestamp();
+	result->finished = true;
+	pgstat_report_activity(STATE_IDLE, NULL);
 }
 
 void worker_main(Datum arg)
 {
-	int 			ret;
-	StringInfoData 	buf;
-	uint32 			segment = UInt32GetDatum(arg);
+	int 			slot_index = DatumGetInt32(arg);
+	JobResult 		result;
 
 	/* Setup signal handlers */
 	pqsignal(SIGHUP, worker_sighup);
@@ -122,7 +282,7 @@ void worker_main(Datum arg)
 	/* Allow signals */
 	BackgroundWorkerUnblockSignals();
 
-	initialize_worker(segment);
+	initialize_worker(slot_index);
 
 	/* Connect to the database */
 	BackgroundWorkerInitializeConnection(job->datname, job->rolname);
@@ -130,33 +290,111 @@ void worker_main(Datum arg)
 	elog(LOG, "%s initialized running job id %d", MyBgworkerEntry->bgw_name, job->job_id);
 	pgstat_report_appname(MyBgworkerEntry->bgw_name);
 
-	/* Initialize the query text */
-	initStringInfo(&buf);
-	appendStringInfo(&buf,
-					"SELECT * FROM %s.%s(%d, NULL)",
-					job_run_function.schema,
-					job_run_function.name,
-					job->job_id);
+	execute_job(job, &result);
 
-	/* Initialize the SPI subsystem */
-	SetCurrentStatementStartTimestamp();
-	StartTransactionCommand();
-	SPI_connect();
-	PushActiveSnapshot(GetTransactionSnapshot());
-	pgstat_report_activity(STATE_RUNNING, buf.data);
+	/* Leave the outcome in our slot, the launcher picks it up once we have exited */
+	memcpy(&get_job_slot(slot_index)->result, &result, sizeof(JobResult));
 
-	SetCurrentStatementStartTimestamp();
+	proc_exit(0);
+}
 
-	/* And run the query */
-	ret = SPI_execute(buf.data, true, 0);
-	if (ret < 0)
-		elog(FATAL, "errors while executing %s", buf.data);
+/*
+ * Main entry point of a pooled worker. The launcher passes the handle of a
+ * shared memory segment, holding the database and role to connect to and
+ * two queues: one delivering the jobs, the other one reporting the results.
+ * The worker exits when the launcher detaches from the queues or terminates us.
+ */
+void pool_worker_main(Datum arg)
+{
+	dsm_segment    *seg;
+	shm_toc 	   *toc;
+	PoolHeader 	   *hdr;
+	shm_mq 		   *mq;
+	shm_mq_handle  *job_queue;
+	shm_mq_handle  *result_queue;
 
-	/* Commmit the transaction */
-	SPI_finish();
-	PopActiveSnapshot();
-	CommitTransactionCommand();
-	pgstat_report_activity(STATE_IDLE, NULL);
+	/* Setup signal handlers */
+	pqsignal(SIGHUP, worker_sighup);
+	pqsignal(SIGTERM, worker_sigterm);
+
+	/* Allow signals */
+	BackgroundWorkerUnblockSignals();
+
+	/* The segment lives as long as we do, keep it mapped beyond any transaction */
+	CurrentResourceOwner = ResourceOwnerCreate(NULL, POOL_PROCESS_NAME);
+	seg = dsm_attach(DatumGetUInt32(arg));
+	if (seg == NULL)
+		ereport(ERROR,
+				(errcode(ERRCODE_OBJECT_NOT_IN_PREREQUISITE_STATE),
+				 errmsg("unable to map dynamic shared memory segment")));
+	dsm_pin_mapping(seg);
+
+	toc = shm_toc_attach(POOL_SHM_MAGIC, dsm_segment_address(seg));
+	if (toc == NULL)
+		ereport(ERROR,
+				(errcode(ERRCODE_OBJECT_NOT_IN_PREREQUISITE_STATE),
+				 errmsg("bad magic number in dynamic shared memory segment")));
+
+	hdr = shm_toc_lookup(toc, POOL_KEY_HEADER);
+
+	mq = shm_toc_lookup(toc, POOL_KEY_JOB_QUEUE);
+	shm_mq_set_receiver(mq, MyProc);
+	job_queue = shm_mq_attach(mq, seg, NULL);
+
+	mq = shm_toc_lookup(toc, POOL_KEY_RESULT_QUEUE);
+	shm_mq_set_sender(mq, MyProc);
+	result_queue = shm_mq_attach(mq, seg, NULL);
+
+	/* Connect to the database */
+	BackgroundWorkerInitializeConnection(hdr->datname, hdr->rolname);
+
+	elog(LOG, "%s initialized for database %s and role %s",
+		 MyBgworkerEntry->bgw_name, hdr->datname, hdr->rolname);
+	pgstat_report_appname(MyBgworkerEntry->bgw_name);
+
+	while (!got_sigterm)
+	{
+		shm_mq_result 	res;
+		Size 			nbytes;
+		void 		   *data;
+		int 			rc;
+
+		res = shm_mq_receive(job_queue, &nbytes, &data, true);
+		if (res == SHM_MQ_DETACHED)
+			break;
+
+		if (res == SHM_MQ_SUCCESS)
+		{
+			JobDesc 		pooled_job;
+			JobResult 		result;
+
+			if (nbytes != sizeof(JobDesc))
+				elog(FATAL, "invalid job description received by a pooled worker");
+			memcpy(&pooled_job, data, sizeof(JobDesc));
+
+			execute_job(&pooled_job, &result);
+
+			if (shm_mq_send(result_queue, sizeof(JobResult), &result, false) != SHM_MQ_SUCCESS)
+				break;
+			continue;
+		}
+
+		/* Nothing to do, wait for the launcher to hand us a job */
+		rc = WaitLatch(&MyProc->procLatch,
+					   WL_LATCH_SET | WL_POSTMASTER_DEATH,
+					   0);
+		ResetLatch(&MyProc->procLatch);
+
+		/* Emergency exit */
+		if (rc & WL_POSTMASTER_DEATH)
+			proc_exit(1);
+
+		if (got_sighup)
+		{
+			got_sighup = false;
+			ProcessConfigFile(PGC_SIGHUP);
+		}
+	}
 
 	proc_exit(0);
 }
@@ -1,6 +1,6 @@
 /* ------------------------------------------------------------------------
  * worker.h
- *  	Function exports from the worker process.
+ *  	Function exports from the worker processes.
  *
  * Copyright (c) 2014, Zalando SE.
  * Portions Copyright (C) 2013-2014, PostgreSQL Global Development Group
@@ -13,4 +13,5 @@
  #include 	"postgres.h"
 
  void		worker__main(Datum) __attribute__((noreturn));
+ void		pool_worker_main(Datum) __attribute__((noreturn));
  #endif
\ No newline at end of file
@@ -29,6 +29,7 @@ relocatable = false
 superuser   = true
 comment 	= 'Job Scheduler using background workers'
 default_version = unstable
+module_pathname = '\$libdir/${EXTNAME}'
 __EOF__
 
 ## Testvariables
@@ -3,6 +3,13 @@
 \set dummy dummy
 drop extension if exists :extname cascade;
 create extension :extname with schema :extschema;
+SELECT * FROM :extschema.parse_crontab('7-55/9 */6 * 1,6-8 *');
+SELECT * FROM :extschema.parse_crontab('0 0 13 * 5');
+SELECT * FROM :extschema.parse_crontab('0 0 * * 7');
+SELECT * FROM :extschema.parse_crontab('@hourly');
+SELECT * FROM :extschema.parse_crontab('{"2042-12-05 13:37 +00"}');
+SELECT :extschema.parse_cronfield('*/12,30-40/3', 0, 59);
+SELECT :extschema.parse_cronfield('x', 0, 59);
 SELECT oid AS datoid FROM pg_database WHERE datname=current_catalog;
 \gset
 INSERT INTO :extschema.my_job (job_command, datoid, schedule) VALUES
@@ -13,3 +20,77 @@ INSERT INTO :extschema.my_job (job_command, datoid, schedule) VALUES
 ('SELECT 1', :datoid, '*/12,30-40/3 0 * 11 0'),
 ('SELECT 1', :datoid, '@hourly'),
 ('SELECT 1', :datoid, '1-59/7 1 * 1 1');
+SELECT '7-55/9 */6 * 1,6-8 *':::extschema.schedule, '@daily':::extschema.schedule, '1-31 * * * 1':::extschema.schedule;
+SELECT '{"2042-12-05 13:37:42 +00","2014-01-01 12:31 +02","2042-12-05 13:37 +00"}':::extschema.schedule;
+SELECT '0 0 * * 7':::extschema.schedule OPERATOR(:extschema.=) '0 0 * * 0':::extschema.schedule;
+SELECT '* * 1-31 * *':::extschema.schedule OPERATOR(:extschema.=) '* * * * *':::extschema.schedule,
+       '* * * * 0-6':::extschema.schedule OPERATOR(:extschema.=) ('* * * * 0-6':::extschema.schedule)::text:::extschema.schedule;
+SELECT :extschema.schedule_matches('*/15 12 * * *', '2014-06-01 12:45:30'),
+       :extschema.schedule_matches('*/15 12 * * *', '2014-06-01 12:46');
+SELECT 'x':::extschema.schedule;
+SELECT '0,30 * * * * *':::extschema.schedule, '0 */5 * * * *':::extschema.schedule,
+       '@every 90s':::extschema.schedule, '@every 1d2h':::extschema.schedule;
+SELECT '@every 10':::extschema.schedule;
+SELECT '@every 0s':::extschema.schedule;
+SELECT :extschema.schedule_next_run('*/20 * * * * *', '2014-06-01 12:00:20'),
+       :extschema.schedule_next_run('@every 15s', '2014-06-01 12:00:31'),
+       :extschema.schedule_matches('@every 1h', '2014-06-01 12:00:30'),
+       :extschema.schedule_matches('@every 1h', '2014-06-01 12:01');
+SELECT :extschema.schedule_next_run('{"2042-12-05 13:37 +00"}', '2042-01-01 00:00 +00'),
+       :extschema.schedule_next_run('{"2042-12-05 13:37 +00"}', '2042-12-05 13:37 +00'),
+       :extschema.schedule_next_run('0 12 * * *', '2014-06-01 12:00:30');
+SELECT :extschema.schedule_next_run('0 0 29 2 *', '2096-03-01 00:00');
+SELECT count(*) AS without_next_run FROM :extschema.my_job WHERE next_run_at IS NULL;
+SELECT * FROM :extschema.schedule_forecast_counts('2014-01-06 00:00', '2014-01-06 00:10');
+SELECT count(*) FROM :extschema.schedule_forecast('2014-01-01', '2014-02-01');
+SET search_path TO pg_catalog;
+SELECT schedule FROM :extschema.insert_job('SELECT ''outside the search_path''', current_catalog, schedule := '@weekly');
+SELECT (:extschema.update_job(job_id, schedule := '@monthly')).schedule
+  FROM :extschema.my_job WHERE job_command = 'SELECT ''outside the search_path''';
+RESET search_path;
+-- A one-shot job whose minute has come keeps its schedule when the launcher writes next_run_at
+ALTER TABLE :extschema.job DISABLE TRIGGER validate_job_definition;
+INSERT INTO :extschema.my_job (job_command, datoid, schedule)
+VALUES ('SELECT ''one-shot''', :datoid, date_trunc('minute', clock_timestamp())::text:::extschema.schedule)
+RETURNING job_id AS one_shot_id, schedule::text AS one_shot_schedule
+\gset
+ALTER TABLE :extschema.job ENABLE TRIGGER validate_job_definition;
+UPDATE :extschema.job SET next_run_at = NULL WHERE job_id = :one_shot_id;
+UPDATE :extschema.job SET success_count = success_count + 1 WHERE job_id = :one_shot_id;
+SELECT schedule::text = :'one_shot_schedule' AS schedule_unchanged FROM :extschema.job WHERE job_id = :one_shot_id;
+SELECT :extschema.maintain_job_log_partitions('30 days');
+SELECT count(*) AS partitions FROM pg_catalog.pg_inherits WHERE inhparent = (:'extschema' || '.job_log')::regclass;
+SELECT :extschema.create_job_log_partition('2014-01-01');
+SELECT :extschema.maintain_job_log_partitions('30 days', 0);
+SELECT count(*) AS partitions FROM pg_catalog.pg_inherits WHERE inhparent = (:'extschema' || '.job_log')::regclass;
+SELECT :extschema.enqueue('SELECT 1') > 0 AS enqueued;
+SELECT :extschema.enqueue('SELECT 2', current_catalog, current_user, now() + interval '1 hour') > 0 AS enqueued;
+SELECT task_command, not_before > now() AS later FROM :extschema.task ORDER BY task_id;
+SELECT :extschema.enqueue('SELECT 3', 'no_such_database');
+INSERT INTO :extschema.my_job (job_command, datoid) VALUES ('SELECT ''extract''', :datoid) RETURNING job_id AS extract_id
+\gset
+INSERT INTO :extschema.my_job (job_command, datoid) VALUES ('SELECT ''load''', :datoid) RETURNING job_id AS load_id
+\gset
+SELECT job_id = :load_id AS downstream, depends_on = :extract_id AS upstream FROM :extschema.add_job_dependency(:load_id, :extract_id);
+SELECT :extschema.add_job_dependency(:extract_id, :load_id);
+SELECT :extschema.add_job_dependency(:load_id, :load_id);
+SELECT count(*) AS dependencies FROM :extschema.member_job_dependency WHERE job_id = :load_id;
+SELECT job_id = :extract_id AS deleted FROM :extschema.delete_job(:extract_id);
+SELECT count(*) AS dependencies FROM :extschema.member_job_dependency WHERE job_id = :load_id;
+SELECT batch_size, batch_delay FROM :extschema.insert_job('SELECT generate_series(1, $1) LIMIT 0', current_catalog, batch_size := 1000, batch_delay := '1 second');
+SELECT batch_size, batch_delay FROM :extschema.insert_job('SELECT 1', current_catalog);
+SELECT :extschema.insert_job('SELECT 2', current_catalog, batch_size := 0);
+SELECT cost_limit, cost_delay FROM :extschema.insert_job('SELECT 3 LIMIT $1', current_catalog, batch_size := 100, cost_limit := 500, cost_delay := '20 ms');
+SELECT (:extschema.update_job(job_id, cost_delay := '0')).cost_delay FROM :extschema.my_job WHERE job_command = 'SELECT 3 LIMIT $1';
+SELECT :extschema.insert_job('SELECT 4', current_catalog, cost_limit := 0);
+SELECT deferrable FROM :extschema.insert_job('SELECT ''deferrable''', current_catalog, deferrable := true);
+SELECT deferrable FROM :extschema.insert_job('SELECT ''not deferrable''', current_catalog);
+SELECT (:extschema.update_job(job_id, deferrable := false)).deferrable FROM :extschema.my_job WHERE job_command = 'SELECT ''deferrable''';
+INSERT INTO :extschema.maintenance_window (window_name, opens, duration) VALUES ('nightly', '0 2 * * *', '3 hours');
+INSERT INTO :extschema.maintenance_window (window_name, opens, duration) VALUES ('empty', '0 3 * * *', '0');
+SELECT window_id IS NOT NULL FROM :extschema.insert_job('ANALYZE', current_catalog, schedule := '@daily',
+       window_id := (SELECT window_id FROM :extschema.maintenance_window WHERE window_name = 'nightly'));
+SELECT :extschema.insert_job('SELECT ''no window''', current_catalog, window_id := -1);
+SELECT (:extschema.update_job(job_id, window_id := (SELECT window_id FROM :extschema.maintenance_window WHERE window_name = 'nightly'))).window_id IS NOT NULL
+  FROM :extschema.my_job WHERE job_command = 'SELECT ''deferrable''';
+UPDATE :extschema.maintenance_window SET duration = '4 hours' WHERE window_name = 'nightly';
@@ -17,54 +17,13 @@ BEGIN
     END LOOP;
 END;
 $$;
+-- The crontab parsers are implemented in C, they share their code with the input
+-- function of the schedule type.
 CREATE FUNCTION @extschema@.parse_cronfield (cronfield text, minvalue int, maxvalue int)
 RETURNS int []
 RETURNS NULL ON NULL INPUT
-LANGUAGE plpgsql
-AS
-$BODY$
-DECLARE
-    entry text;
-    cronvalues int [] := ARRAY[]::int[];
-    -- Example entries : 0-4,5-9/3,8   */3    11-12
-    entry_regexp text := '^(\*|(\d{1,2})(-(\d{1,2}))?)(\/(\d{1,2}))?$';
-    entry_groups text [];
-    min int;
-    max int;
-    step int;
-    result int[];
-BEGIN
-    FOREACH entry IN ARRAY string_to_array(cronfield, ',')
-    LOOP
-        entry_groups := regexp_matches(entry, entry_regexp);
-        min := entry_groups[2];
-        step := coalesce(entry_groups[6]::int,1);
-        IF entry_groups[1] = '*' THEN
-            min := minvalue;
-            max := maxvalue;
-        ELSE
-            max := coalesce(entry_groups[4]::int,min);
-        END IF;
-
-        IF max < min OR max > maxvalue OR min < minvalue THEN
-            RAISE SQLSTATE '22023' USING
-                MESSAGE = 'Invalid crontab parameter.',
-                DETAIL  = format('Range start: %s (%s), End range: %s (%s), Step: %s for crontab field: %s', min, minvalue, max, maxvalue, step, cronfield),
-                HINT    = 'Ensure range is ascending and that the ranges is within allowed bounds';
-        END IF;
-
-        cronvalues := cronvalues || array(SELECT generate_series(min, max, step));
-    END LOOP;
-
-    result := array(SELECT DISTINCT * FROM unnest(cronvalues) ORDER BY 1);
-    IF result = '{}'::int[] THEN
-        RETURN null;
-    END IF;
-
-    RETURN result;
-END;
-$BODY$
-SECURITY INVOKER
+LANGUAGE C
+AS 'MODULE_PATHNAME', 'parse_cronfield'
 IMMUTABLE;
 
 COMMENT ON FUNCTION @extschema@.parse_cronfield (text, int, int) IS
@@ -75,69 +34,8 @@ COMMENT ON FUNCTION @extschema@.parse_cronfield (text, int, int) IS
 -- valid entries in the job table.
 -- Main source for decicions is man 5 crontab
 CREATE FUNCTION @extschema@.parse_crontab (schedule text, OUT minute int [], OUT hour int [], OUT dom int[], OUT month int[], OUT dow int[])
-LANGUAGE plpgsql
-AS
-$BODY$
-DECLARE
-    entries text [] := regexp_split_to_array(schedule, '\s+');
-    entry   text;
-    empty int[] := '{}'::int[];
-BEGIN
-    -- Allow some named entries, we transform them into the documented equivalent
-    IF array_length (entries, 1) <> 5 THEN
-        IF array_length (entries, 1) = 1 THEN
-            IF entries[1] = '@yearly' OR entries[1] = '@annually' THEN
-                entries := ARRAY['0','0','1','1','*'];
-            ELSIF entries[1] = '@monthly' THEN
-                entries := ARRAY['0','0','1','*','*'];
-            ELSIF entries[1] = '@weekly' THEN
-                entries := ARRAY['0','0','*','*','0'];
-            ELSIF entries[1] = '@daily' OR entries[1] = '@midnight' THEN
-                entries := ARRAY['0','0','*','*','*'];
-            ELSIF entries[1] = '@hourly' THEN
-                entries := ARRAY['0','*','*','*','*'];
-            ELSE
-                RETURN ;
-            END IF;
-        ELSE
-            RETURN;
-        END IF;
-    END IF;
-
-    minute := @extschema@.parse_cronfield(entries[1],0,59);
-    hour   := @extschema@.parse_cronfield(entries[2],0,23);
-    dom    := @extschema@.parse_cronfield(entries[3],1,31);
-    month  := @extschema@.parse_cronfield(entries[4],1,12);
-    dow    := @extschema@.parse_cronfield(entries[5],0,7);
-
-    -- if any entry is null, the crontab is invalid
-    IF minute IS NULL OR hour IS NULL OR month IS NULL OR dom IS NULL or dow IS NULL THEN
-        minute := null;
-        hour   := null;
-        month  := null;
-        dom    := null;
-        dow    := null;
-        RETURN;
-    END IF;
-
-    -- Convert day 7 to day 0 (Sunday)
-    dow :=  array(SELECT DISTINCT unnest(dow)%7 ORDER BY 1);
-
-    -- To model the logic of cron, we empty on of the dow or dom arrays
-    -- Logic (man 5 crontab):
-    -- If both fields are restricted (ie, are not *), the command will be run when
-    --     either field matches the current time.
-    IF entries[5] = '*' AND entries[3] != '*' THEN
-        dow := '{}'::int[];
-    END IF;
-    IF entries[3] = '*' AND entries[5] != '*' THEN
-        dom := '{}'::int[];
-    END IF;
-
-    RETURN;
-END;
-$BODY$
-SECURITY INVOKER
+LANGUAGE C
+AS 'MODULE_PATHNAME', 'parse_crontab'
 IMMUTABLE;
 
 COMMENT ON FUNCTION @extschema@.parse_crontab (schedule text) IS
@@ -191,19 +89,91 @@ COMMENT ON FUNCTION @extschema@.parse_truncate_timestamps(text) IS
 Truncates given timestamp(s) on the minute.
 
 Useful as a structure for indexing.';
-CREATE DOMAIN @extschema@.schedule AS TEXT
-CONSTRAINT is_valid_schedule CHECK (
-    parse_crontab(VALUE) IS NOT NULL
-    OR
-    parse_truncate_timestamps(VALUE) IS NOT NULL
+-- The schedule is a base type implemented in C. It stores the compiled crontab
+-- bitmasks or the sorted timestamps, so checking a new schedule parses it only
+-- once and the launcher can read the schedules without parsing any text.
+CREATE TYPE @extschema@.schedule;
+
+CREATE FUNCTION @extschema@.schedule_in(cstring)
+RETURNS @extschema@.schedule
+LANGUAGE C
+AS 'MODULE_PATHNAME', 'schedule_in'
+IMMUTABLE STRICT;
+
+CREATE FUNCTION @extschema@.schedule_out(@extschema@.schedule)
+RETURNS cstring
+LANGUAGE C
+AS 'MODULE_PATHNAME', 'schedule_out'
+IMMUTABLE STRICT;
+
+CREATE FUNCTION @extschema@.schedule_recv(internal)
+RETURNS @extschema@.schedule
+LANGUAGE C
+AS 'MODULE_PATHNAME', 'schedule_recv'
+IMMUTABLE STRICT;
+
+CREATE FUNCTION @extschema@.schedule_send(@extschema@.schedule)
+RETURNS bytea
+LANGUAGE C
+AS 'MODULE_PATHNAME', 'schedule_send'
+IMMUTABLE STRICT;
+
+CREATE TYPE @extschema@.schedule (
+    INPUT          = @extschema@.schedule_in,
+    OUTPUT         = @extschema@.schedule_out,
+    RECEIVE        = @extschema@.schedule_recv,
+    SEND           = @extschema@.schedule_send,
+    INTERNALLENGTH = VARIABLE,
+    ALIGNMENT      = double,
+    STORAGE        = extended
 );
 
-COMMENT ON DOMAIN @extschema@.schedule IS
+COMMENT ON TYPE @extschema@.schedule IS
 'A schedule can contain either:
 - a valid crontab schedule, examples: "0 0 1 1 3", "*/3 12-22/5 * * *", "@daily"
-- a (n array of) timestamp(s), as a text representation at UTC, examples: 
+- a crontab schedule with a leading seconds field, example: "*/10 * * * * *"
+- an interval, firing at every multiple of it since the epoch, examples: "@every 10s", "@every 1h30m"
+- a (n array of) timestamp(s), as a text representation at UTC, examples:
     ''{"2042-12-05 13:37 +00","2014-01-01 12:31 +00"}''
-    ''1982-08-06 09:30 +02''';
+    ''1982-08-06 09:30 +02''
+
+Crontab schedules are shown in their canonical form, "@daily" is shown as "0 0 * * *".
+Timestamps are truncated to the minute and shown at UTC.';
+
+CREATE FUNCTION @extschema@.schedule_eq(@extschema@.schedule, @extschema@.schedule)
+RETURNS boolean
+LANGUAGE C
+AS 'MODULE_PATHNAME', 'schedule_eq'
+IMMUTABLE STRICT;
+
+CREATE FUNCTION @extschema@.schedule_ne(@extschema@.schedule, @extschema@.schedule)
+RETURNS boolean
+LANGUAGE C
+AS 'MODULE_PATHNAME', 'schedule_ne'
+IMMUTABLE STRICT;
+
+CREATE OPERATOR @extschema@.= (
+    LEFTARG    = @extschema@.schedule,
+    RIGHTARG   = @extschema@.schedule,
+    PROCEDURE  = @extschema@.schedule_eq,
+    COMMUTATOR = OPERATOR(@extschema@.=),
+    NEGATOR    = OPERATOR(@extschema@.<>),
+    RESTRICT   = eqsel,
+    JOIN       = eqjoinsel
+);
+
+CREATE OPERATOR @extschema@.<> (
+    LEFTARG    = @extschema@.schedule,
+    RIGHTARG   = @extschema@.schedule,
+    PROCEDURE  = @extschema@.schedule_ne,
+    COMMUTATOR = OPERATOR(@extschema@.<>),
+    NEGATOR    = OPERATOR(@extschema@.=),
+    RESTRICT   = neqsel,
+    JOIN       = neqjoinsel
+);
+
+CREATE CAST (text AS @extschema@.schedule) WITH INOUT AS ASSIGNMENT;
+CREATE CAST (@extschema@.schedule AS text) WITH INOUT AS ASSIGNMENT;
 -- Casts
 CREATE TYPE @extschema@.schedule_matcher AS (
     minute int [],
@@ -246,6 +216,34 @@ SECURITY INVOKER;
 CREATE CAST (@extschema@.schedule_matcher AS timestamptz[])
     WITH FUNCTION @extschema@.timestamptz(@extschema@.schedule_matcher)
     AS IMPLICIT;
+CREATE TABLE @extschema@.maintenance_window (
+    window_id           serial primary key,
+    window_name         text not null unique,
+    opens               @extschema@.schedule not null,
+    duration            interval not null check ( duration > '0'::interval ),
+    window_description  text
+);
+COMMENT ON TABLE @extschema@.maintenance_window IS
+'A maintenance window is a recurring period of low traffic in which heavy jobs may run.
+It opens whenever its schedule fires and stays open for its duration.
+
+The runs of a job referencing a window wait for the window to open. The launcher spreads
+them over the window and its worker slots, according to the duration of their recent
+runs, so that every run is predicted to finish before the window closes.';
+COMMENT ON COLUMN @extschema@.maintenance_window.window_id IS
+'Surrogate primary key to uniquely identify this window.';
+COMMENT ON COLUMN @extschema@.maintenance_window.window_name IS
+'The name of the window for human reading.';
+COMMENT ON COLUMN @extschema@.maintenance_window.opens IS
+E'The schedule on which the window opens, Hint: \\dT+ @extschema@.schedule';
+COMMENT ON COLUMN @extschema@.maintenance_window.duration IS
+'How long the window stays open, at a resolution of seconds.';
+COMMENT ON COLUMN @extschema@.maintenance_window.window_description IS
+'The description of the window for human reading or filtering.';
+SELECT pg_catalog.pg_extension_config_dump('maintenance_window', '');
+
+GRANT SELECT ON @extschema@.maintenance_window TO job_scheduler;
+GRANT SELECT ON @extschema@.maintenance_window TO job_monitor;
 CREATE TABLE @extschema@.job (
     job_id              serial primary key,
     datoid              oid not null,
@@ -255,17 +253,29 @@ CREATE TABLE @extschema@.job (
     failure_count       integer not null default 0 check ( failure_count>=0 ),
     success_count       integer not null default 0 check ( success_count>=0 ),
     parallel            boolean not null default false,
-    job_command         text not null,
+    priority            smallint not null default 0,
+    misfire             text not null default 'once' check ( misfire IN ('once', 'all', 'skip') ),
+    job_command         text not null check ( octet_length(job_command) < 8192 ),
     job_description     text,
     job_timeout         interval not null default '6 hours'::interval,
-    last_executed       timestamptz
+    batch_size          integer check ( batch_size > 0 ),
+    batch_delay         interval not null default '0'::interval check ( batch_delay >= '0'::interval ),
+    cost_limit          integer check ( cost_limit BETWEEN 1 AND 10000 ),
+    cost_delay          interval check ( cost_delay >= '0'::interval ),
+    deferrable          boolean not null default false,
+    window_id           integer references @extschema@.maintenance_window (window_id),
+    last_executed       timestamptz,
+    next_run_at         timestamptz
 );
-CREATE UNIQUE INDEX job_unique_definition_and_schedule ON @extschema@.job(datoid, roloid, coalesce(schedule,''::text), job_command);
+CREATE UNIQUE INDEX job_unique_definition_and_schedule ON @extschema@.job(datoid, roloid, coalesce(schedule::text,''), job_command);
+CREATE INDEX job_next_run_at ON @extschema@.job(next_run_at) WHERE enabled;
 COMMENT ON TABLE @extschema@.job IS
 'This table holds all the job definitions.
 
-The schedule indexes on this table are used to
-quickly identify which jobs should be running on a specific moment.';
+The launcher keeps the compiled schedules of the enabled jobs in memory
+to quickly identify which jobs should be running on a specific moment.
+It maintains next_run_at, so the jobs which are due can be found in SQL
+using an index range scan.';
 SELECT pg_catalog.pg_extension_config_dump('job', '');
 
 
@@ -305,7 +315,7 @@ BEGIN
             COMMENT ON COLUMN %1$I.%2$I.roloid IS
                     'The oid of the user who should run this job.';
             COMMENT ON COLUMN %1$I.%2$I.schedule IS
-                    E'The schedule for this job, Hint: \\dD+ @extschema@.schedule';
+                    E'The schedule for this job, Hint: \\dT+ @extschema@.schedule';
             COMMENT ON COLUMN %1$I.%2$I.enabled IS
                     'Whether or not this job is enabled';
             COMMENT ON COLUMN %1$I.%2$I.failure_count IS
@@ -314,14 +324,36 @@ BEGIN
                     'The number of times this job has run succesfully.';
             COMMENT ON COLUMN %1$I.%2$I.parallel IS
                     'If true, allows multiple job instances to be active at the same time.';
+            COMMENT ON COLUMN %1$I.%2$I.priority IS
+                    'Jobs of the same database waiting for a worker are started in order of descending priority.';
+            COMMENT ON COLUMN %1$I.%2$I.misfire IS
+                    E'What to do with the runs missed while the launcher was not running:\n'
+                    'once: run the job once, all: run every missed run, skip: do not run it.';
             COMMENT ON COLUMN %1$I.%2$I.job_command IS
                     'The list of commands to execute. This will be a single transaction.';
             COMMENT ON COLUMN %1$I.%2$I.job_description IS
                     'The description of the job for human reading or filtering.';
             COMMENT ON COLUMN %1$I.%2$I.job_timeout IS
                     'The maximum amount of time this job will be allowed to run before it is killed.';
+            COMMENT ON COLUMN %1$I.%2$I.batch_size IS
+                    E'If set, the command is run in batches, each in a transaction of its own, until it affects no rows.\n'
+                    'The batch size is passed to the command as $1, for example in a LIMIT clause.';
+            COMMENT ON COLUMN %1$I.%2$I.batch_delay IS
+                    'The time to wait between two batches, to throttle the locks and WAL generated by a batch job.';
+            COMMENT ON COLUMN %1$I.%2$I.cost_limit IS
+                    E'The cost of the buffer accesses of a batch, weighted like vacuum_cost_limit, which is worth cost_delay of sleep.\n'
+                    'If NULL, elephant_worker.job_cost_limit applies. Only a job with a batch_size is throttled.';
+            COMMENT ON COLUMN %1$I.%2$I.cost_delay IS
+                    E'The time to sleep after a batch for every cost_limit it has spent, 0 disables the cost-based throttling.\n'
+                    'If NULL, elephant_worker.job_cost_delay applies. Only a job with a batch_size is throttled.';
+            COMMENT ON COLUMN %1$I.%2$I.deferrable IS
+                    'If true, the start of the job is held while the cluster is busy, for at most elephant_worker.max_defer_time.';
+            COMMENT ON COLUMN %1$I.%2$I.window_id IS
+                    'The maintenance window the job runs in, if any. A run waits for the window to open.';
             COMMENT ON COLUMN %1$I.%2$I.last_executed IS
                     'The last time this job was started.';
+            COMMENT ON COLUMN %1$I.%2$I.next_run_at IS
+                    'The next time this job will be started, null if never. Maintained by the launcher.';
 
 
                    $format$,
@@ -346,14 +378,81 @@ $$;
 GRANT SELECT, DELETE, INSERT, UPDATE ON @extschema@.my_job TO job_scheduler;
 GRANT SELECT, DELETE, INSERT, UPDATE ON @extschema@.member_job TO job_scheduler;
 GRANT SELECT ON @extschema@.job TO job_monitor;
+CREATE TABLE @extschema@.job_dependency (
+    job_id              integer not null references @extschema@.job (job_id) ON DELETE CASCADE,
+    depends_on          integer not null references @extschema@.job (job_id) ON DELETE CASCADE,
+    primary key (job_id, depends_on),
+    check ( job_id <> depends_on )
+);
+CREATE INDEX job_dependency_depends_on ON @extschema@.job_dependency(depends_on);
+COMMENT ON TABLE @extschema@.job_dependency IS
+'A job which depends on other jobs runs as soon as all of them have succeeded since
+it last ran because of them, on top of its own schedule. A job without a schedule
+only runs because of the jobs it depends on. The dependencies cannot form a cycle.';
+COMMENT ON COLUMN @extschema@.job_dependency.job_id IS
+'The job which depends on another job.';
+COMMENT ON COLUMN @extschema@.job_dependency.depends_on IS
+'The job which has to succeed first.';
+SELECT pg_catalog.pg_extension_config_dump('job_dependency', '');
+
+CREATE VIEW @extschema@.member_job_dependency WITH (security_barrier) AS
+SELECT *
+  FROM @extschema@.job_dependency jd
+ WHERE pg_has_role(current_user, (SELECT roloid FROM @extschema@.job j WHERE j.job_id=jd.job_id), 'MEMBER')
+   AND pg_has_role(current_user, (SELECT roloid FROM @extschema@.job j WHERE j.job_id=jd.depends_on), 'MEMBER')
+  WITH CASCADED CHECK OPTION;
+COMMENT ON VIEW @extschema@.member_job_dependency IS
+'This view shows the dependencies between the jobs of the roles of which the current_user is a member.';
 
-CREATE INDEX schedule_crontab_minute ON @extschema@.job USING GIN (((parse_crontab(schedule)).minute)) WHERE (parse_crontab(schedule)).minute IS NOT NULL;
-CREATE INDEX schedule_crontab_hour ON @extschema@.job USING GIN (((parse_crontab(schedule)).hour)) WHERE (parse_crontab(schedule)).hour IS NOT NULL;
-CREATE INDEX schedule_crontab_dom ON @extschema@.job USING GIN (((parse_crontab(schedule)).dom)) WHERE (parse_crontab(schedule)).dom IS NOT NULL;
-CREATE INDEX schedule_timestamps ON @extschema@.job USING GIN (parse_truncate_timestamps(schedule)) WHERE parse_truncate_timestamps(schedule) IS NOT NULL;
+GRANT SELECT, DELETE, INSERT ON @extschema@.member_job_dependency TO job_scheduler;
+GRANT SELECT ON @extschema@.job_dependency TO job_monitor;
+CREATE TABLE @extschema@.job_run_queue (
+    job_id              integer not null,
+    due_at              timestamptz not null,
+    primary key (job_id, due_at)
+);
+-- No foreign key referencing the job table: the launcher must never fail to write the queue because
+-- a job was deleted at the same time. The runs of deleted or disabled jobs are removed by the launcher.
+
+COMMENT ON TABLE @extschema@.job_run_queue IS
+'The runs which are due but have not been started yet, because they wait for a worker or
+for their release moment. The launcher picks them up again after a restart. Runs which
+are started right away when they are due never show up here.';
+COMMENT ON COLUMN @extschema@.job_run_queue.due_at IS
+'The moment this run of the job was scheduled at.';
+
+GRANT SELECT ON @extschema@.job_run_queue TO job_monitor;
+CREATE TABLE @extschema@.task (
+    task_id             bigserial primary key,
+    datname             name not null,
+    rolname             name not null,
+    task_command        text not null check ( octet_length(task_command) < 8192 ),
+    not_before          timestamptz not null default now(),
+    enqueued_at         timestamptz not null default now()
+);
+-- The launcher reads the due tasks in the order they are due
+CREATE INDEX task_not_before ON @extschema@.task(not_before);
+-- Enqueueing must be cheap: no foreign keys, and no row triggers. The database and the role are
+-- checked by enqueue, a task of a dropped database or role fails in the worker and is logged.
+
+COMMENT ON TABLE @extschema@.task IS
+'One-shot tasks waiting to be run by the launcher. Use enqueue to add a task, the launcher
+deletes the task once it has handed it to a worker. The outcome is written to the job log.';
+COMMENT ON COLUMN @extschema@.task.task_id IS
+'Surrogate primary key to uniquely identify this task, also shown in the job log.';
+COMMENT ON COLUMN @extschema@.task.datname IS
+'The database to run the task in.';
+COMMENT ON COLUMN @extschema@.task.rolname IS
+'The role to run the task as.';
+COMMENT ON COLUMN @extschema@.task.task_command IS
+'The command to execute.';
+COMMENT ON COLUMN @extschema@.task.not_before IS
+'The task is not started before this moment.';
+
+GRANT SELECT ON @extschema@.task TO job_monitor;
 CREATE TABLE @extschema@.job_log (
     jl_id               serial primary key,
-    job_id              integer not null,
+    job_id              integer,
     rolname             name not null,
     datname             name not null,
     job_started         timestamptz not null,
@@ -363,19 +462,20 @@ CREATE TABLE @extschema@.job_log (
     exception_message   text,
     exception_detail    text,
     exception_hint      text,
-    exception_context   text
+    exception_context   text,
+    task_id             bigint,
+    batch_rows          bigint[],
+    check ( (job_id IS NULL) <> (task_id IS NULL) )
 );
-CREATE INDEX ON @extschema@.job_log (job_started);
-CREATE INDEX ON @extschema@.job_log (job_finished);
-CREATE INDEX ON @extschema@.job_log (job_sqlstate);
 -- We decide not to add a foreign key referencing the job table, jobs may be deleted (we could use ON DELETE SET NULL)
 -- or the job log is imported somewhere else for processing
 
--- Make sure the contents of this table is dumped when pg_dump is called
-SELECT pg_catalog.pg_extension_config_dump('job_log', '');
+-- The job log is partitioned by day on job_started, see create_job_log_partition.
+-- This table itself stays empty, it holds no indexes. The partitions are created at runtime,
+-- they are not members of the extension and are dumped by pg_dump as regular tables.
 
 COMMENT ON TABLE @extschema@.job_log IS
-'All the job logs are stored in this table.';
+'All the job logs are stored in the partitions of this table, one per day (UTC).';
 
 CREATE VIEW @extschema@.my_job_log WITH (security_barrier) AS
 SELECT *
@@ -413,11 +513,15 @@ BEGIN
             COMMENT ON COLUMN %1$I.%2$I.jl_id  IS
                     'Surrogate primary key to uniquely identify this job log entry.';
             COMMENT ON COLUMN %1$I.%2$I.job_id IS
-                    'The job_id for this run.';
+                    'The job_id for this run, NULL for a task.';
+            COMMENT ON COLUMN %1$I.%2$I.task_id IS
+                    'The task_id of the task this entry is for, NULL for a job.';
             COMMENT ON COLUMN %1$I.%2$I.rolname IS
                     'The role who ran this job.';
             COMMENT ON COLUMN %1$I.%2$I.datname IS
                     'The database where this job ran.';
+            COMMENT ON COLUMN %1$I.%2$I.batch_rows IS
+                    E'The number of rows affected by every batch of a job run in batches, NULL otherwise.\n   Only the first 1024 batches are listed.';
             COMMENT ON COLUMN %1$I.%2$I.job_started IS
                     'When was this job started.';
             COMMENT ON COLUMN %1$I.%2$I.job_finished IS
@@ -439,17 +543,81 @@ BEGIN
     END LOOP;
 END;
 $$;
-CREATE FUNCTION @extschema@.schedule_matches(schedule @extschema@.schedule, matcher @extschema@.schedule_matcher)
+CREATE FUNCTION @extschema@.job_pending_counters(OUT job_id integer, OUT succeeded bigint, OUT failed bigint, OUT last_executed timestamptz)
+RETURNS SETOF record
+LANGUAGE C
+AS 'MODULE_PATHNAME', 'job_pending_counters';
+
+COMMENT ON FUNCTION @extschema@.job_pending_counters() IS
+$$The runs of the jobs which the launcher has accounted for in shared memory,
+but not yet written to the counters in the @extschema@.job table.$$;
+
+CREATE VIEW @extschema@.job_counters WITH (security_barrier) AS
+SELECT mj.job_id,
+       mj.success_count + coalesce(pc.succeeded, 0) AS success_count,
+       mj.failure_count + coalesce(pc.failed, 0) AS failure_count,
+       greatest(mj.last_executed, pc.last_executed) AS last_executed
+  FROM @extschema@.member_job mj
+  LEFT JOIN @extschema@.job_pending_counters() pc ON (mj.job_id = pc.job_id);
+COMMENT ON VIEW @extschema@.job_counters IS
+$$The live counters of the jobs of the roles of which the current_user is a member.
+
+The launcher keeps the counters in shared memory and writes them to the @extschema@.job table
+every elephant_worker.counter_flush_interval, this view shows the sum of both.$$;
+
+GRANT SELECT ON @extschema@.job_counters TO job_scheduler;
+GRANT SELECT ON @extschema@.job_counters TO job_monitor;
+GRANT EXECUTE ON FUNCTION @extschema@.job_pending_counters() TO job_monitor;
+CREATE FUNCTION @extschema@.schedule_matches(schedule @extschema@.schedule, runtime timestamptz)
 RETURNS BOOLEAN
 RETURNS NULL ON NULL INPUT
-LANGUAGE SQL
-AS
-$BODY$
-    
-    SELECT true;
-$BODY$
-SECURITY INVOKER
-IMMUTABLE;
+LANGUAGE C
+AS 'MODULE_PATHNAME', 'schedule_matches'
+STABLE;
+
+COMMENT ON FUNCTION @extschema@.schedule_matches(@extschema@.schedule, timestamptz) IS
+'Returns true if the schedule fires in the minute of runtime. Crontab schedules
+are evaluated in the current TimeZone, like the launcher does.';
+CREATE FUNCTION @extschema@.schedule_next_run(schedule @extschema@.schedule, after timestamptz)
+RETURNS timestamptz
+RETURNS NULL ON NULL INPUT
+LANGUAGE C
+AS 'MODULE_PATHNAME', 'schedule_next_run'
+STABLE;
+
+COMMENT ON FUNCTION @extschema@.schedule_next_run(@extschema@.schedule, timestamptz) IS
+'Returns the first moment after "after" at which the schedule fires, or null if it
+will never fire again. For schedules without seconds this is the first minute after
+the minute of "after". Crontab schedules are evaluated in the current TimeZone, like
+the launcher does.';
+CREATE FUNCTION @extschema@.schedule_forecast(from_time timestamptz, to_time timestamptz, OUT minute timestamptz, OUT job_id integer)
+RETURNS SETOF record
+RETURNS NULL ON NULL INPUT
+LANGUAGE C
+AS 'MODULE_PATHNAME', 'schedule_forecast'
+STABLE
+SECURITY DEFINER
+ROWS 1000;
+
+COMMENT ON FUNCTION @extschema@.schedule_forecast(timestamptz, timestamptz) IS
+'Returns a row for every job and every minute between from_time and to_time in which
+the job will be started according to its schedule. Only enabled jobs of roles the
+session_user is a member of are shown. Crontab schedules are evaluated in the current TimeZone.';
+
+CREATE FUNCTION @extschema@.schedule_forecast_counts(from_time timestamptz, to_time timestamptz, OUT minute timestamptz, OUT jobs integer)
+RETURNS SETOF record
+RETURNS NULL ON NULL INPUT
+LANGUAGE C
+AS 'MODULE_PATHNAME', 'schedule_forecast_counts'
+STABLE
+SECURITY DEFINER
+ROWS 1000;
+
+COMMENT ON FUNCTION @extschema@.schedule_forecast_counts(timestamptz, timestamptz) IS
+'Returns the number of jobs which will be started in every minute between from_time
+and to_time, useful to find load spikes before they happen. Example:
+
+    SELECT * FROM schedule_forecast_counts(now(), now() + interval ''1 week'') ORDER BY jobs DESC LIMIT 10;';
 CREATE FUNCTION @extschema@.insert_job(
         job_command text,
         datname name,
@@ -458,7 +626,15 @@ CREATE FUNCTION @extschema@.insert_job(
         job_description text    default null,
         enabled boolean         default true,
         job_timeout interval    default '6 hours',
-        parallel boolean        default false)
+        parallel boolean        default false,
+        priority smallint       default 0,
+        misfire text            default 'once',
+        batch_size integer      default null,
+        batch_delay interval    default '0',
+        cost_limit integer      default null,
+        cost_delay interval     default null,
+        deferrable boolean      default false,
+        window_id integer       default null)
 RETURNS @extschema@.member_job
 LANGUAGE SQL
 AS
@@ -470,6 +646,14 @@ $BODY$
         enabled,
         job_timeout,
         parallel,
+        priority,
+        misfire,
+        batch_size,
+        batch_delay,
+        cost_limit,
+        cost_delay,
+        deferrable,
+        window_id,
         roloid,
         datoid)
     VALUES (
@@ -479,13 +663,21 @@ $BODY$
         insert_job.enabled,
         insert_job.job_timeout,
         insert_job.parallel,
+        insert_job.priority,
+        insert_job.misfire,
+        insert_job.batch_size,
+        insert_job.batch_delay,
+        insert_job.cost_limit,
+        insert_job.cost_delay,
+        insert_job.deferrable,
+        insert_job.window_id,
         (SELECT oid FROM pg_catalog.pg_roles    pr WHERE pr.rolname= insert_job.rolname),
         (SELECT oid FROM pg_catalog.pg_database pd WHERE pd.datname = insert_job.datname)
     )
     RETURNING *;
 $BODY$;
 
-COMMENT ON FUNCTION @extschema@.insert_job(text, name, @extschema@.schedule, name,text, boolean,interval,boolean) IS
+COMMENT ON FUNCTION @extschema@.insert_job(text, name, @extschema@.schedule, name,text, boolean,interval,boolean,smallint,text,integer,interval,integer,interval,boolean,integer) IS
 'Creates a job entry. Returns the record containing this new job.';
 CREATE FUNCTION @extschema@.update_job(
 		job_id integer,
@@ -496,7 +688,15 @@ CREATE FUNCTION @extschema@.update_job(
         job_description text default null,
         enabled boolean default null,
         job_timeout interval default null,
-        parallel boolean default null)
+        parallel boolean default null,
+        priority smallint default null,
+        misfire text default null,
+        batch_size integer default null,
+        batch_delay interval default null,
+        cost_limit integer default null,
+        cost_delay interval default null,
+        deferrable boolean default null,
+        window_id integer default null)
 RETURNS @extschema@.member_job
 LANGUAGE SQL
 AS
@@ -508,13 +708,21 @@ $BODY$
 		enabled         = coalesce(update_job.enabled,         enabled),
 		job_timeout     = coalesce(update_job.job_timeout,     job_timeout),
 		parallel        = coalesce(update_job.parallel,        parallel),
+		priority        = coalesce(update_job.priority,        priority),
+		misfire         = coalesce(update_job.misfire,         misfire),
+		batch_size      = coalesce(update_job.batch_size,      batch_size),
+		batch_delay     = coalesce(update_job.batch_delay,     batch_delay),
+		cost_limit      = coalesce(update_job.cost_limit,      cost_limit),
+		cost_delay      = coalesce(update_job.cost_delay,      cost_delay),
+		deferrable      = coalesce(update_job.deferrable,      deferrable),
+		window_id       = coalesce(update_job.window_id,       window_id),
 		roloid          = (SELECT oid FROM pg_catalog.pg_roles    pr WHERE pr.rolname = coalesce(update_job.rolname, mj.rolname)),
 		datoid          = (SELECT oid FROM pg_catalog.pg_database pd WHERE pd.datname = coalesce(update_job.datname, mj.datname))
 	WHERE job_id     = update_job.job_id
     RETURNING *;
 $BODY$;
 
-COMMENT ON FUNCTION @extschema@.update_job(integer, text, name, schedule, name, text, boolean, interval, boolean) IS
+COMMENT ON FUNCTION @extschema@.update_job(integer, text, name, schedule, name, text, boolean, interval, boolean, smallint, text, integer, interval, integer, interval, boolean, integer) IS
 'Update a given job_id with the provided values. Returns the new (update) record.';
 CREATE FUNCTION @extschema@.delete_job(job_id integer)
 RETURNS @extschema@.member_job
@@ -529,6 +737,92 @@ $BODY$;
 
 COMMENT ON FUNCTION @extschema@.delete_job(job_id integer) IS
 'Deletes the job with the specified job_id. Returns the deleted record.';
+CREATE FUNCTION @extschema@.add_job_dependency(job_id integer, depends_on integer)
+RETURNS @extschema@.member_job_dependency
+RETURNS NULL ON NULL INPUT
+LANGUAGE SQL
+AS
+$BODY$
+    INSERT INTO @extschema@.member_job_dependency (job_id, depends_on)
+    VALUES (add_job_dependency.job_id, add_job_dependency.depends_on)
+    RETURNING *;
+$BODY$;
+
+COMMENT ON FUNCTION @extschema@.add_job_dependency(integer, integer) IS
+'Makes the job run as soon as the job it depends on, and all its other upstream jobs, have succeeded.
+Returns the new dependency.';
+
+CREATE FUNCTION @extschema@.delete_job_dependency(job_id integer, depends_on integer)
+RETURNS @extschema@.member_job_dependency
+RETURNS NULL ON NULL INPUT
+LANGUAGE SQL
+AS
+$BODY$
+    DELETE FROM @extschema@.member_job_dependency mjd
+     WHERE mjd.job_id = delete_job_dependency.job_id
+       AND mjd.depends_on = delete_job_dependency.depends_on
+    RETURNING *;
+$BODY$;
+
+COMMENT ON FUNCTION @extschema@.delete_job_dependency(integer, integer) IS
+'Deletes the dependency of the job on another job. Returns the deleted record.';
+CREATE FUNCTION @extschema@.notify_task_enqueued() RETURNS TRIGGER
+LANGUAGE C
+AS 'MODULE_PATHNAME', 'notify_task_enqueued';
+
+COMMENT ON FUNCTION @extschema@.notify_task_enqueued() IS
+$$Wakes up the launcher when the transaction commits, so that it reads the tasks which are due.$$;
+
+CREATE TRIGGER notify_task_enqueued AFTER INSERT ON @extschema@.task
+    FOR EACH STATEMENT EXECUTE PROCEDURE @extschema@.notify_task_enqueued();
+
+CREATE FUNCTION @extschema@.enqueue(
+        command text,
+        datname name            default current_catalog,
+        rolname name            default current_user,
+        not_before timestamptz  default now())
+RETURNS bigint
+LANGUAGE plpgsql
+AS
+$BODY$
+DECLARE
+    result bigint;
+BEGIN
+    IF NOT pg_catalog.pg_has_role(session_user, enqueue.rolname, 'MEMBER')
+    THEN
+        RAISE SQLSTATE '42501' USING
+        MESSAGE = 'Insufficient privileges',
+        DETAIL  = format('You are not a member of role "%s"', enqueue.rolname);
+    END IF;
+
+    PERFORM 1
+       FROM pg_catalog.pg_database pd
+      WHERE pd.datname = enqueue.datname;
+
+    IF NOT FOUND THEN
+        RAISE SQLSTATE '22023' USING
+            MESSAGE = 'Invalid parameter value',
+            DETAIL  = format('Database "%s" does not exist', enqueue.datname);
+    END IF;
+
+    INSERT INTO @extschema@.task (datname, rolname, task_command, not_before)
+    VALUES (enqueue.datname, enqueue.rolname, enqueue.command, coalesce(enqueue.not_before, now()))
+    RETURNING task_id
+    INTO result;
+
+    RETURN result;
+END;
+$BODY$
+SECURITY DEFINER;
+
+COMMENT ON FUNCTION @extschema@.enqueue(text, name, name, timestamptz) IS
+'Enqueues a one-shot task, which the launcher runs in a background worker once not_before
+has passed and the transaction has committed. Returns the task_id, under which the outcome
+is written to the job log. Tasks do not go through the job table: enqueueing takes a single
+insert into a table with one index, many thousands of tasks can be enqueued per second.
+Example:
+
+    SELECT enqueue(format(''SELECT refresh_report(%s)'', 42), not_before := now() + interval ''5 minutes'');';
 CREATE FUNCTION @extschema@.validate_job_definition() RETURNS TRIGGER AS
 $BODY$
 BEGIN
@@ -547,15 +841,22 @@ BEGIN
         DETAIL  = format('You are not a member of role "%s"', user_name);
     END IF;
 
-    IF NEW.schedule IS NOT NULL AND @extschema@.parse_crontab(NEW.schedule) IS NULL THEN
-        -- We convert the user provided timestamps into 'YYYY-MM-DD HH24:MI OF'
-        NEW.schedule := @extschema@.parse_truncate_timestamps(NEW.schedule);
+    -- The schedule type has already truncated the timestamps to the minute.
+    -- Special case: a new schedule which matches the current moment is bumped 1 minute, so
+    -- it will be executed asap. A schedule which is not changed is left alone, its minute may
+    -- have come while the job was waiting to run.
+    -- The operators of the schedule type live in our schema, which need not be on the search_path
+    IF (TG_OP = 'INSERT' OR NEW.schedule::text IS DISTINCT FROM OLD.schedule::text)
+       AND NEW.schedule OPERATOR(@extschema@.=) date_trunc('minute', clock_timestamp())::text::@extschema@.schedule THEN
+        NEW.schedule := (date_trunc('minute', clock_timestamp()) + interval '1 minute')::text::@extschema@.schedule;
+    END IF;
 
-        -- Special case: provided timestamp matches current moment, we bump it 1 minute, so
-        -- it will be executed asap.
-        IF NEW.schedule = to_char(clock_timestamp() at time zone 'utc', '{\"YYYY-MM-DD HH24:MI OF\"}') THEN
-            NEW.schedule := @extschema@.parse_truncate_timestamps((NEW.schedule::timestamptz + interval '1 minute')::text);
-        END IF;
+    -- The launcher keeps next_run_at up to date once it has loaded the job,
+    -- until then we provide the next run ourselves
+    IF TG_OP = 'INSERT' THEN
+        NEW.next_run_at := @extschema@.schedule_next_run(NEW.schedule, clock_timestamp());
+    ELSIF NEW.schedule::text IS DISTINCT FROM OLD.schedule::text THEN
+        NEW.next_run_at := @extschema@.schedule_next_run(NEW.schedule, clock_timestamp());
     END IF;
 
     IF TG_OP = 'UPDATE' AND NEW.job_id <> OLD.job_id THEN
@@ -572,29 +873,146 @@ LANGUAGE plpgsql;
 COMMENT ON FUNCTION @extschema@.validate_job_definition() IS
 $$We want to maintain some sanity on the @extschema@.job table.
 
-Many checks are taken care of by check constraints
-(on the @extschema@.schedule DOMAIN, and the @extschema@.job TABLE).
+Many checks are taken care of by check constraints on the @extschema@.job TABLE,
+the @extschema@.schedule TYPE only accepts valid schedules.
 
-We do some extra checks here and if a schedule consisting of timestamps is provided
-we convert it into timestaps at utc with a granularity of 1 minute.
+We do some extra checks here and if a new schedule consisting of only the current minute
+is provided we move it to the next minute. We also set next_run_at for new schedules.
+Updates of the columns written by the launcher only do not fire this trigger.
 $$;
 
-CREATE TRIGGER validate_job_definition BEFORE INSERT OR UPDATE ON @extschema@.job
+CREATE TRIGGER validate_job_definition BEFORE INSERT ON @extschema@.job
     FOR EACH ROW EXECUTE PROCEDURE @extschema@.validate_job_definition();
 
+-- The launcher writes next_run_at and the counters of the jobs, which need no validation
+CREATE TRIGGER validate_job_update BEFORE UPDATE ON @extschema@.job
+    FOR EACH ROW
+    WHEN (   OLD.job_id          IS DISTINCT FROM NEW.job_id
+          OR OLD.datoid          IS DISTINCT FROM NEW.datoid
+          OR OLD.roloid          IS DISTINCT FROM NEW.roloid
+          OR OLD.schedule        IS DISTINCT FROM NEW.schedule
+          OR OLD.enabled         IS DISTINCT FROM NEW.enabled
+          OR OLD.parallel        IS DISTINCT FROM NEW.parallel
+          OR OLD.priority        IS DISTINCT FROM NEW.priority
+          OR OLD.misfire         IS DISTINCT FROM NEW.misfire
+          OR OLD.job_command     IS DISTINCT FROM NEW.job_command
+          OR OLD.job_description IS DISTINCT FROM NEW.job_description
+          OR OLD.job_timeout     IS DISTINCT FROM NEW.job_timeout
+          OR OLD.batch_size      IS DISTINCT FROM NEW.batch_size
+          OR OLD.batch_delay     IS DISTINCT FROM NEW.batch_delay
+          OR OLD.cost_limit      IS DISTINCT FROM NEW.cost_limit
+          OR OLD.cost_delay      IS DISTINCT FROM NEW.cost_delay
+          OR OLD.deferrable      IS DISTINCT FROM NEW.deferrable
+          OR OLD.window_id       IS DISTINCT FROM NEW.window_id)
+    EXECUTE PROCEDURE @extschema@.validate_job_definition();
+
+CREATE FUNCTION @extschema@.notify_job_change() RETURNS TRIGGER
+LANGUAGE C
+AS 'MODULE_PATHNAME', 'notify_job_change';
+
+COMMENT ON FUNCTION @extschema@.notify_job_change() IS
+$$The launcher keeps a compiled copy of all enabled jobs in memory.
+
+This trigger remembers which jobs were changed, and when the transaction commits,
+tells the launcher to refresh only those jobs. A TRUNCATE makes the launcher reload all jobs,
+as does any change of the maintenance windows.
+$$;
+
+CREATE TRIGGER notify_job_change AFTER INSERT OR DELETE ON @extschema@.job
+    FOR EACH ROW EXECUTE PROCEDURE @extschema@.notify_job_change();
+
+-- The launcher updates the counters of the jobs it has run, which does not change their definition
+CREATE TRIGGER notify_job_update AFTER UPDATE ON @extschema@.job
+    FOR EACH ROW
+    WHEN (   OLD.datoid      IS DISTINCT FROM NEW.datoid
+          OR OLD.roloid      IS DISTINCT FROM NEW.roloid
+          OR OLD.schedule    IS DISTINCT FROM NEW.schedule
+          OR OLD.enabled     IS DISTINCT FROM NEW.enabled
+          OR OLD.parallel    IS DISTINCT FROM NEW.parallel
+          OR OLD.priority    IS DISTINCT FROM NEW.priority
+          OR OLD.misfire     IS DISTINCT FROM NEW.misfire
+          OR OLD.job_command IS DISTINCT FROM NEW.job_command
+          OR OLD.job_timeout IS DISTINCT FROM NEW.job_timeout
+          OR OLD.batch_size  IS DISTINCT FROM NEW.batch_size
+          OR OLD.batch_delay IS DISTINCT FROM NEW.batch_delay
+          OR OLD.cost_limit  IS DISTINCT FROM NEW.cost_limit
+          OR OLD.cost_delay  IS DISTINCT FROM NEW.cost_delay
+          OR OLD.deferrable  IS DISTINCT FROM NEW.deferrable
+          OR OLD.window_id   IS DISTINCT FROM NEW.window_id)
+    EXECUTE PROCEDURE @extschema@.notify_job_change();
+
+CREATE TRIGGER notify_job_truncate AFTER TRUNCATE ON @extschema@.job
+    FOR EACH STATEMENT EXECUTE PROCEDURE @extschema@.notify_job_change();
+
+-- The launcher loads the maintenance windows with all jobs, they are few and change rarely
+CREATE TRIGGER notify_window_change AFTER INSERT OR UPDATE OR DELETE OR TRUNCATE ON @extschema@.maintenance_window
+    FOR EACH STATEMENT EXECUTE PROCEDURE @extschema@.notify_job_change();
+
+CREATE FUNCTION @extschema@.validate_job_dependency() RETURNS TRIGGER AS
+$BODY$
+DECLARE
+    launchers integer;
+BEGIN
+    -- Every launcher only learns about the jobs it runs itself, see elephant_worker.launchers
+    BEGIN
+        launchers := current_setting('elephant_worker.launchers')::integer;
+    EXCEPTION WHEN undefined_object THEN
+        launchers := 1;
+    END;
+    IF NEW.job_id % launchers <> NEW.depends_on % launchers THEN
+        RAISE SQLSTATE '22023' USING
+        MESSAGE = 'Invalid parameter value',
+        DETAIL  = format('Job %s and job %s are scheduled by different launchers', NEW.job_id, NEW.depends_on),
+        HINT    = 'With elephant_worker.launchers set, a job can only depend on jobs whose job_id is equal modulo the number of launchers.';
+    END IF;
+
+    -- Only one transaction at a time may add dependencies, or two of them could close a cycle together
+    LOCK TABLE @extschema@.job_dependency IN SHARE ROW EXCLUSIVE MODE;
+
+    PERFORM 1
+       FROM (WITH RECURSIVE upstream(job_id) AS (
+                SELECT NEW.depends_on
+                 UNION
+                SELECT jd.depends_on
+                  FROM @extschema@.job_dependency jd
+                  JOIN upstream u ON (jd.job_id = u.job_id)
+             )
+             SELECT job_id FROM upstream) AS u
+      WHERE u.job_id = NEW.job_id;
+
+    IF FOUND THEN
+        RAISE SQLSTATE '22023' USING
+        MESSAGE = 'Invalid parameter value',
+        DETAIL  = format('Job %s depends on job %s already, directly or indirectly', NEW.depends_on, NEW.job_id);
+    END IF;
+
+    RETURN NEW;
+END;
+$BODY$
+LANGUAGE plpgsql
+SECURITY DEFINER;
+
+COMMENT ON FUNCTION @extschema@.validate_job_dependency() IS
+$$Refuses a dependency which would make a job depend on itself through other jobs,
+or on a job scheduled by another launcher.$$;
+
+-- Dependencies are added and deleted, they are never updated
+CREATE TRIGGER validate_job_dependency BEFORE INSERT ON @extschema@.job_dependency
+    FOR EACH ROW EXECUTE PROCEDURE @extschema@.validate_job_dependency();
+
+-- The launcher keeps the jobs a job depends on with the job itself
+CREATE TRIGGER notify_job_dependency_change AFTER INSERT OR DELETE ON @extschema@.job_dependency
+    FOR EACH ROW EXECUTE PROCEDURE @extschema@.notify_job_change();
+
+CREATE TRIGGER notify_job_dependency_truncate AFTER TRUNCATE ON @extschema@.job_dependency
+    FOR EACH STATEMENT EXECUTE PROCEDURE @extschema@.notify_job_change();
+
 CREATE FUNCTION @extschema@.job_scheduled_at(runtime timestamptz default clock_timestamp())
 RETURNS SETOF @extschema@.member_job
 RETURNS NULL ON NULL INPUT
 LANGUAGE plpgsql
 AS
 $BODY$
-DECLARE
-    minute      int[] := ARRAY[extract(minute from runtime)::int];
-    hour        int[] := ARRAY[extract(hour   from runtime)::int];
-    month       int[] := ARRAY[extract(month  from runtime)::int];
-    dom         int[] := ARRAY[extract(day    from runtime)::int];
-    dow         int[] := ARRAY[extract(dow    from runtime)::int];
-    utc_string text[] := ARRAY[to_char(runtime at time zone 'utc', 'YYYY-MM-DD HH24:MI OF')];
 BEGIN
     RETURN QUERY
     SELECT job.*,
@@ -604,18 +1022,27 @@ BEGIN
       JOIN pg_catalog.pg_roles    pr ON (job.roloid = pr.oid)
       JOIN pg_catalog.pg_database pd ON (job.datoid = pd.oid)
      WHERE pg_has_role(session_user, roloid, 'MEMBER')
-       AND (@extschema@.parse_crontab(schedule)).minute @> minute
-       AND (@extschema@.parse_crontab(schedule)).hour   @> hour
-       AND (@extschema@.parse_crontab(schedule)).month  @> month
-       AND (
-                (@extschema@.parse_crontab(schedule)).dom @> dom
-                OR
-                (@extschema@.parse_crontab(schedule)).dow @> dow
-           )
-       AND enabled = true
+       AND @extschema@.schedule_matches(schedule, runtime)
+       AND enabled = true;
+END;
+$BODY$
+SECURITY DEFINER
+ROWS 3;
 
-    UNION
+COMMENT ON FUNCTION @extschema@.job_scheduled_at(timestamptz) IS
+'Returns all the jobs that should be running this minute according to their schedule.
+When no value is provided for runtime, the clock_timestamp() will be used.
 
+This is a function accessing the @extschema@.job table directly, and therefore
+needs to be defined as a security definer function. The where clauses should however
+safely limit the output.';
+
+CREATE FUNCTION @extschema@.job_due(runtime timestamptz default clock_timestamp())
+RETURNS SETOF @extschema@.member_job
+RETURNS NULL ON NULL INPUT
+LANGUAGE SQL
+AS
+$BODY$
     SELECT job.*,
            datname,
            rolname
@@ -623,27 +1050,149 @@ BEGIN
       JOIN pg_catalog.pg_roles    pr ON (job.roloid = pr.oid)
       JOIN pg_catalog.pg_database pd ON (job.datoid = pd.oid)
      WHERE pg_has_role(session_user, roloid, 'MEMBER')
-       AND @extschema@.parse_truncate_timestamps(schedule) @> utc_string
-       AND enabled = true;
-END;
+       AND next_run_at <= runtime
+       AND enabled = true
+     ORDER BY next_run_at;
 $BODY$
 SECURITY DEFINER
 ROWS 3;
 
-COMMENT ON FUNCTION @extschema@.job_scheduled_at(timestamptz) IS
-'Returns all the jobs that should be running this minute according to their schedule.
+COMMENT ON FUNCTION @extschema@.job_due(timestamptz) IS
+'Returns all the jobs whose next run is at or before runtime, in the order they are due.
 When no value is provided for runtime, the clock_timestamp() will be used.
 
-This is a function accessing the @extschema@.job table directly, and therefore
-needs to be defined as a security definer function. The where clauses should however
-safely limit the output.';
+The launcher maintains next_run_at, this is an index range scan on the job table.';
+CREATE FUNCTION @extschema@.create_job_log_partition(day date)
+RETURNS regclass
+RETURNS NULL ON NULL INPUT
+LANGUAGE plpgsql
+AS
+$BODY$
+DECLARE
+    partition_name name := 'job_log_' || to_char(day, 'YYYYMMDD');
+    partition_oid  oid;
+BEGIN
+    SELECT pc.oid
+      INTO partition_oid
+      FROM pg_catalog.pg_class     pc
+      JOIN pg_catalog.pg_namespace pn ON (pc.relnamespace = pn.oid)
+     WHERE pn.nspname = '@extschema@'
+       AND pc.relname = partition_name;
+
+    IF FOUND THEN
+        RETURN partition_oid;
+    END IF;
+
+    BEGIN
+        EXECUTE format($format$
+            CREATE TABLE %1$I.%2$I (
+                PRIMARY KEY (jl_id),
+                CHECK ( job_started >= %3$L AND job_started < %4$L )
+            ) INHERITS (%1$I.job_log);
+            CREATE INDEX ON %1$I.%2$I (job_started);
+            CREATE INDEX ON %1$I.%2$I (job_finished);
+            CREATE INDEX ON %1$I.%2$I (job_sqlstate);
+            REVOKE ALL ON %1$I.%2$I FROM PUBLIC;
+            GRANT SELECT ON %1$I.%2$I TO job_monitor;
+                       $format$,
+                       '@extschema@',
+                       partition_name,
+                       day::timestamp at time zone 'utc',
+                       (day + 1)::timestamp at time zone 'utc');
+    EXCEPTION
+        WHEN duplicate_table THEN
+            -- Somebody else was faster
+            NULL;
+    END;
+
+    RETURN format('%I.%I', '@extschema@', partition_name)::regclass;
+END;
+$BODY$
+SECURITY DEFINER;
+
+COMMENT ON FUNCTION @extschema@.create_job_log_partition(date) IS
+$$Creates the partition of the job log holding the jobs started on the given day (UTC),
+unless it exists already. Returns the partition.$$;
+
+CREATE FUNCTION @extschema@.maintain_job_log_partitions(retention interval, premake integer default 2)
+RETURNS void
+LANGUAGE plpgsql
+AS
+$BODY$
+DECLARE
+    today     date := (clock_timestamp() at time zone 'utc')::date;
+    partition record;
+BEGIN
+    FOR i IN 0..coalesce(premake, 0)
+    LOOP
+        PERFORM @extschema@.create_job_log_partition(today + i);
+    END LOOP;
+
+    -- A retention of zero or NULL keeps the job log forever
+    IF retention IS NULL OR retention <= interval '0' THEN
+        RETURN;
+    END IF;
+
+    FOR partition IN
+        SELECT pc.relname
+          FROM pg_catalog.pg_inherits  pi
+          JOIN pg_catalog.pg_class     pc ON (pi.inhrelid = pc.oid)
+          JOIN pg_catalog.pg_namespace pn ON (pc.relnamespace = pn.oid)
+         WHERE pi.inhparent = '@extschema@.job_log'::regclass
+           AND pn.nspname = '@extschema@'
+           AND pc.relname ~ '^job_log_[0-9]{8}$'
+           -- the whole day lies beyond the retention period
+           AND (to_date(substr(pc.relname, 9), 'YYYYMMDD') + 1)::timestamp at time zone 'utc' <= clock_timestamp() - retention
+         ORDER BY pc.relname
+    LOOP
+        EXECUTE format('DROP TABLE %I.%I', '@extschema@', partition.relname);
+        RAISE LOG 'dropped expired job log partition %', partition.relname;
+    END LOOP;
+END;
+$BODY$
+SECURITY INVOKER;
+
+COMMENT ON FUNCTION @extschema@.maintain_job_log_partitions(interval, integer) IS
+$$Creates the job log partitions for today and the next premake days, and drops the partitions
+of the days which are older than retention. The launcher calls this regularly, using
+elephant_worker.log_retention.$$;
+
+CREATE FUNCTION @extschema@.route_job_log() RETURNS TRIGGER AS
+$BODY$
+BEGIN
+    EXECUTE format('INSERT INTO %s SELECT ($1).*',
+                   @extschema@.create_job_log_partition((NEW.job_started at time zone 'utc')::date))
+      USING NEW;
+    RETURN NULL;
+END;
+$BODY$
+LANGUAGE plpgsql
+SECURITY DEFINER;
+
+COMMENT ON FUNCTION @extschema@.route_job_log() IS
+$$Rows inserted into @extschema@.job_log itself are moved into the partition of their day.
+The launcher writes into the partitions directly.$$;
+
+CREATE TRIGGER route_job_log BEFORE INSERT ON @extschema@.job_log
+    FOR EACH ROW EXECUTE PROCEDURE @extschema@.route_job_log();
 CREATE FUNCTION @extschema@.create_job_log(job_id integer)
 RETURNS @extschema@.member_job_log
 RETURNS NULL ON NULL INPUT
-LANGUAGE SQL
+LANGUAGE plpgsql
 AS
 $BODY$
-     INSERT INTO @extschema@.member_job_log (
+DECLARE
+    result @extschema@.member_job_log;
+BEGIN
+    PERFORM 1
+       FROM @extschema@.member_job mj
+      WHERE mj.job_id = create_job_log.job_id;
+
+    IF NOT FOUND THEN
+        RETURN NULL;
+    END IF;
+
+    INSERT INTO @extschema@.member_job_log (
             job_id,
             rolname,
             datname,
@@ -656,8 +1205,16 @@ $BODY$
             job_command,
             clock_timestamp()
        FROM @extschema@.member_job mj
-      WHERE mj.job_id = create_job_log.job_id
-      RETURNING *
+      WHERE mj.job_id = create_job_log.job_id;
+
+    -- The row is routed into a partition of the job log, which means RETURNING yields nothing
+    SELECT *
+      INTO result
+      FROM @extschema@.member_job_log mjl
+     WHERE mjl.jl_id = currval(pg_catalog.pg_get_serial_sequence('@extschema@.job_log', 'jl_id'));
+
+    RETURN result;
+END;
 $BODY$
 SECURITY INVOKER;
 CREATE OR REPLACE FUNCTION @extschema@.run_job(job_id integer, jl_id integer default null)
@@ -735,12 +1292,29 @@ BEGIN
     UPDATE @extschema@.member_job mj
        SET failure_count = (case when job_log.job_sqlstate <> '00000' then failure_count+1 else failure_count end),
            success_count = (case when job_log.job_sqlstate =  '00000' then success_count+1 else success_count end),
-           last_executed = job_log.job_started;
+           last_executed = job_log.job_started
+     WHERE mj.job_id = job_log.job_id;
 
     RETURN job_log;
 END;
 $BODY$
 SECURITY INVOKER;
+CREATE FUNCTION @extschema@.trigger_job(job_id integer)
+RETURNS void
+RETURNS NULL ON NULL INPUT
+LANGUAGE C
+AS 'MODULE_PATHNAME', 'trigger_job'
+VOLATILE
+SECURITY DEFINER;
+
+COMMENT ON FUNCTION @extschema@.trigger_job(integer) IS
+'Asks the launcher to run the job in a background worker right away, without waiting
+for its schedule; the job may have no schedule at all. The request is handed to the
+launcher when the transaction commits, so the job sees the changes of the transaction.
+A job which is waiting for a worker slot already is not queued again. Only enabled jobs
+of roles the session_user is a member of can be triggered. Example:
+
+    SELECT trigger_job(42);';
 DO
 $$
 DECLARE
@@ -771,12 +1345,12 @@ DECLARE
          WHERE deptype='e'
            AND extname='elephant_worker';
 
-    domain_cursor CURSOR FOR
+    type_cursor CURSOR FOR
         SELECT typname
           FROM pg_catalog.pg_depend    pd
           JOIN pg_catalog.pg_extension pe ON (pd.refobjid = pe.oid)
           JOIN pg_catalog.pg_type      pt ON (pd.objid    = pt.oid)
-         WHERE typtype = 'd'
+         WHERE typtype IN ('b', 'd')
            AND extname='elephant_worker';
 BEGIN
     FOR object IN relation_cursor
@@ -796,10 +1370,10 @@ BEGIN
         EXECUTE format('GRANT EXECUTE ON FUNCTION %I.%I(%s) TO job_scheduler', '@extschema@', object.proname, object.identity_arguments);
     END LOOP;
 
-    FOR object IN domain_cursor
+    FOR object IN type_cursor
     LOOP
-        EXECUTE format('REVOKE ALL ON DOMAIN %I.%I FROM PUBLIC', '@extschema@', object.typname);
-        EXECUTE format('GRANT USAGE ON DOMAIN %I.%I TO job_scheduler', '@extschema@', object.typname);
+        EXECUTE format('REVOKE ALL ON TYPE %I.%I FROM PUBLIC', '@extschema@', object.typname);
+        EXECUTE format('GRANT USAGE ON TYPE %I.%I TO job_scheduler', '@extschema@', object.typname);
     END LOOP;
 END;
 $$;
@@ -1,13 +1,85 @@
-CREATE DOMAIN @extschema@.schedule AS TEXT
-CONSTRAINT is_valid_schedule CHECK (
-    parse_crontab(VALUE) IS NOT NULL
-    OR
-    parse_truncate_timestamps(VALUE) IS NOT NULL
+-- The schedule is a base type implemented in C. It stores the compiled crontab
+-- bitmasks or the sorted timestamps, so checking a new schedule parses it only
+-- once and the launcher can read the schedules without parsing any text.
+CREATE TYPE @extschema@.schedule;
+
+CREATE FUNCTION @extschema@.schedule_in(cstring)
+RETURNS @extschema@.schedule
+LANGUAGE C
+AS 'MODULE_PATHNAME', 'schedule_in'
+IMMUTABLE STRICT;
+
+CREATE FUNCTION @extschema@.schedule_out(@extschema@.schedule)
+RETURNS cstring
+LANGUAGE C
+AS 'MODULE_PATHNAME', 'schedule_out'
+IMMUTABLE STRICT;
+
+CREATE FUNCTION @extschema@.schedule_recv(internal)
+RETURNS @extschema@.schedule
+LANGUAGE C
+AS 'MODULE_PATHNAME', 'schedule_recv'
+IMMUTABLE STRICT;
+
+CREATE FUNCTION @extschema@.schedule_send(@extschema@.schedule)
+RETURNS bytea
+LANGUAGE C
+AS 'MODULE_PATHNAME', 'schedule_send'
+IMMUTABLE STRICT;
+
+CREATE TYPE @extschema@.schedule (
+    INPUT          = @extschema@.schedule_in,
+    OUTPUT         = @extschema@.schedule_out,
+    RECEIVE        = @extschema@.schedule_recv,
+    SEND           = @extschema@.schedule_send,
+    INTERNALLENGTH = VARIABLE,
+    ALIGNMENT      = double,
+    STORAGE        = extended
 );
 
-COMMENT ON DOMAIN @extschema@.schedule IS
+COMMENT ON TYPE @extschema@.schedule IS
 'A schedule can contain either:
 - a valid crontab schedule, examples: "0 0 1 1 3", "*/3 12-22/5 * * *", "@daily"
-- a (n array of) timestamp(s), as a text representation at UTC, examples: 
+- a crontab schedule with a leading seconds field, example: "*/10 * * * * *"
+- an interval, firing at every multiple of it since the epoch, examples: "@every 10s", "@every 1h30m"
+- a (n array of) timestamp(s), as a text representation at UTC, examples:
     ''{"2042-12-05 13:37 +00","2014-01-01 12:31 +00"}''
-    ''1982-08-06 09:30 +02''';
+    ''1982-08-06 09:30 +02''
+
+Crontab schedules are shown in their canonical form, "@daily" is shown as "0 0 * * *".
+Timestamps are truncated to the minute and shown at UTC.';
+
+CREATE FUNCTION @extschema@.schedule_eq(@extschema@.schedule, @extschema@.schedule)
+RETURNS boolean
+LANGUAGE C
+AS 'MODULE_PATHNAME', 'schedule_eq'
+IMMUTABLE STRICT;
+
+CREATE FUNCTION @extschema@.schedule_ne(@extschema@.schedule, @extschema@.schedule)
+RETURNS boolean
+LANGUAGE C
+AS 'MODULE_PATHNAME', 'schedule_ne'
+IMMUTABLE STRICT;
+
+CREATE OPERATOR @extschema@.= (
+    LEFTARG    = @extschema@.schedule,
+    RIGHTARG   = @extschema@.schedule,
+    PROCEDURE  = @extschema@.schedule_eq,
+    COMMUTATOR = OPERATOR(@extschema@.=),
+    NEGATOR    = OPERATOR(@extschema@.<>),
+    RESTRICT   = eqsel,
+    JOIN       = eqjoinsel
+);
+
+CREATE OPERATOR @extschema@.<> (
+    LEFTARG    = @extschema@.schedule,
+    RIGHTARG   = @extschema@.schedule,
+    PROCEDURE  = @extschema@.schedule_ne,
+    COMMUTATOR = OPERATOR(@extschema@.<>),
+    NEGATOR    = OPERATOR(@extschema@.=),
+    RESTRICT   = neqsel,
+    JOIN       = neqjoinsel
+);
+
+CREATE CAST (text AS @extschema@.schedule) WITH INOUT AS ASSIGNMENT;
+CREATE CAST (@extschema@.schedule AS text) WITH INOUT AS ASSIGNMENT;
@@ -0,0 +1,28 @@
+CREATE TABLE @extschema@.maintenance_window (
+    window_id           serial primary key,
+    window_name         text not null unique,
+    opens               @extschema@.schedule not null,
+    duration            interval not null check ( duration > '0'::interval ),
+    window_description  text
+);
+COMMENT ON TABLE @extschema@.maintenance_window IS
+'A maintenance window is a recurring period of low traffic in which heavy jobs may run.
+It opens whenever its schedule fires and stays open for its duration.
+
+The runs of a job referencing a window wait for the window to open. The launcher spreads
+them over the window and its worker slots, according to the duration of their recent
+runs, so that every run is predicted to finish before the window closes.';
+COMMENT ON COLUMN @extschema@.maintenance_window.window_id IS
+'Surrogate primary key to uniquely identify this window.';
+COMMENT ON COLUMN @extschema@.maintenance_window.window_name IS
+'The name of the window for human reading.';
+COMMENT ON COLUMN @extschema@.maintenance_window.opens IS
+E'The schedule on which the window opens, Hint: \\dT+ @extschema@.schedule';
+COMMENT ON COLUMN @extschema@.maintenance_window.duration IS
+'How long the window stays open, at a resolution of seconds.';
+COMMENT ON COLUMN @extschema@.maintenance_window.window_description IS
+'The description of the window for human reading or filtering.';
+SELECT pg_catalog.pg_extension_config_dump('maintenance_window', '');
+
+GRANT SELECT ON @extschema@.maintenance_window TO job_scheduler;
+GRANT SELECT ON @extschema@.maintenance_window TO job_monitor;
@@ -7,17 +7,29 @@ CREATE TABLE @extschema@.job (
     failure_count       integer not null default 0 check ( failure_count>=0 ),
     success_count       integer not null default 0 check ( success_count>=0 ),
     parallel            boolean not null default false,
-    job_command         text not null,
+    priority            smallint not null default 0,
+    misfire             text not null default 'once' check ( misfire IN ('once', 'all', 'skip') ),
+    job_command         text not null check ( octet_length(job_command) < 8192 ),
     job_description     text,
     job_timeout         interval not null default '6 hours'::interval,
-    last_executed       timestamptz
+    batch_size          integer check ( batch_size > 0 ),
+    batch_delay         interval not null default '0'::interval check ( batch_delay >= '0'::interval ),
+    cost_limit          integer check ( cost_limit BETWEEN 1 AND 10000 ),
+    cost_delay          interval check ( cost_delay >= '0'::interval ),
+    deferrable          boolean not null default false,
+    window_id           integer references @extschema@.maintenance_window (window_id),
+    last_executed       timestamptz,
+    next_run_at         timestamptz
 );
-CREATE UNIQUE INDEX job_unique_definition_and_schedule ON @extschema@.job(datoid, roloid, coalesce(schedule,''::text), job_command);
+CREATE UNIQUE INDEX job_unique_definition_and_schedule ON @extschema@.job(datoid, roloid, coalesce(schedule::text,''), job_command);
+CREATE INDEX job_next_run_at ON @extschema@.job(next_run_at) WHERE enabled;
 COMMENT ON TABLE @extschema@.job IS
 'This table holds all the job definitions.
 
-The schedule indexes on this table are used to
-quickly identify which jobs should be running on a specific moment.';
+The launcher keeps the compiled schedules of the enabled jobs in memory
+to quickly identify which jobs should be running on a specific moment.
+It maintains next_run_at, so the jobs which are due can be found in SQL
+using an index range scan.';
 SELECT pg_catalog.pg_extension_config_dump('job', '');
 
 
@@ -57,7 +69,7 @@ BEGIN
             COMMENT ON COLUMN %1$I.%2$I.roloid IS
                     'The oid of the user who should run this job.';
             COMMENT ON COLUMN %1$I.%2$I.schedule IS
-                    E'The schedule for this job, Hint: \\dD+ @extschema@.schedule';
+                    E'The schedule for this job, Hint: \\dT+ @extschema@.schedule';
             COMMENT ON COLUMN %1$I.%2$I.enabled IS
                     'Whether or not this job is enabled';
             COMMENT ON COLUMN %1$I.%2$I.failure_count IS
@@ -66,14 +78,36 @@ BEGIN
                     'The number of times this job has run succesfully.';
             COMMENT ON COLUMN %1$I.%2$I.parallel IS
                     'If true, allows multiple job instances to be active at the same time.';
+            COMMENT ON COLUMN %1$I.%2$I.priority IS
+                    'Jobs of the same database waiting for a worker are started in order of descending priority.';
+            COMMENT ON COLUMN %1$I.%2$I.misfire IS
+                    E'What to do with the runs missed while the launcher was not running:\n'
+                    'once: run the job once, all: run every missed run, skip: do not run it.';
             COMMENT ON COLUMN %1$I.%2$I.job_command IS
                     'The list of commands to execute. This will be a single transaction.';
             COMMENT ON COLUMN %1$I.%2$I.job_description IS
                     'The description of the job for human reading or filtering.';
             COMMENT ON COLUMN %1$I.%2$I.job_timeout IS
                     'The maximum amount of time this job will be allowed to run before it is killed.';
+            COMMENT ON COLUMN %1$I.%2$I.batch_size IS
+                    E'If set, the command is run in batches, each in a transaction of its own, until it affects no rows.\n'
+                    'The batch size is passed to the command as $1, for example in a LIMIT clause.';
+            COMMENT ON COLUMN %1$I.%2$I.batch_delay IS
+                    'The time to wait between two batches, to throttle the locks and WAL generated by a batch job.';
+            COMMENT ON COLUMN %1$I.%2$I.cost_limit IS
+                    E'The cost of the buffer accesses of a batch, weighted like vacuum_cost_limit, which is worth cost_delay of sleep.\n'
+                    'If NULL, elephant_worker.job_cost_limit applies. Only a job with a batch_size is throttled.';
+            COMMENT ON COLUMN %1$I.%2$I.cost_delay IS
+                    E'The time to sleep after a batch for every cost_limit it has spent, 0 disables the cost-based throttling.\n'
+                    'If NULL, elephant_worker.job_cost_delay applies. Only a job with a batch_size is throttled.';
+            COMMENT ON COLUMN %1$I.%2$I.deferrable IS
+                    'If true, the start of the job is held while the cluster is busy, for at most elephant_worker.max_defer_time.';
+            COMMENT ON COLUMN %1$I.%2$I.window_id IS
+                    'The maintenance window the job runs in, if any. A run waits for the window to open.';
             COMMENT ON COLUMN %1$I.%2$I.last_executed IS
                     'The last time this job was started.';
+            COMMENT ON COLUMN %1$I.%2$I.next_run_at IS
+                    'The next time this job will be started, null if never. Maintained by the launcher.';
 
 
                    $format$,
@@ -98,8 +132,3 @@ $$;
 GRANT SELECT, DELETE, INSERT, UPDATE ON @extschema@.my_job TO job_scheduler;
 GRANT SELECT, DELETE, INSERT, UPDATE ON @extschema@.member_job TO job_scheduler;
 GRANT SELECT ON @extschema@.job TO job_monitor;
-
-CREATE INDEX schedule_crontab_minute ON @extschema@.job USING GIN (((parse_crontab(schedule)).minute)) WHERE (parse_crontab(schedule)).minute IS NOT NULL;
-CREATE INDEX schedule_crontab_hour ON @extschema@.job USING GIN (((parse_crontab(schedule)).hour)) WHERE (parse_crontab(schedule)).hour IS NOT NULL;
-CREATE INDEX schedule_crontab_dom ON @extschema@.job USING GIN (((parse_crontab(schedule)).dom)) WHERE (parse_crontab(schedule)).dom IS NOT NULL;
-CREATE INDEX schedule_timestamps ON @extschema@.job USING GIN (parse_truncate_timestamps(schedule)) WHERE parse_truncate_timestamps(schedule) IS NOT NULL;
@@ -0,0 +1,28 @@
+CREATE TABLE @extschema@.job_dependency (
+    job_id              integer not null references @extschema@.job (job_id) ON DELETE CASCADE,
+    depends_on          integer not null references @extschema@.job (job_id) ON DELETE CASCADE,
+    primary key (job_id, depends_on),
+    check ( job_id <> depends_on )
+);
+CREATE INDEX job_dependency_depends_on ON @extschema@.job_dependency(depends_on);
+COMMENT ON TABLE @extschema@.job_dependency IS
+'A job which depends on other jobs runs as soon as all of them have succeeded since
+it last ran because of them, on top of its own schedule. A job without a schedule
+only runs because of the jobs it depends on. The dependencies cannot form a cycle.';
+COMMENT ON COLUMN @extschema@.job_dependency.job_id IS
+'The job which depends on another job.';
+COMMENT ON COLUMN @extschema@.job_dependency.depends_on IS
+'The job which has to succeed first.';
+SELECT pg_catalog.pg_extension_config_dump('job_dependency', '');
+
+CREATE VIEW @extschema@.member_job_dependency WITH (security_barrier) AS
+SELECT *
+  FROM @extschema@.job_dependency jd
+ WHERE pg_has_role(current_user, (SELECT roloid FROM @extschema@.job j WHERE j.job_id=jd.job_id), 'MEMBER')
+   AND pg_has_role(current_user, (SELECT roloid FROM @extschema@.job j WHERE j.job_id=jd.depends_on), 'MEMBER')
+  WITH CASCADED CHECK OPTION;
+COMMENT ON VIEW @extschema@.member_job_dependency IS
+'This view shows the dependencies between the jobs of the roles of which the current_user is a member.';
+
+GRANT SELECT, DELETE, INSERT ON @extschema@.member_job_dependency TO job_scheduler;
+GRANT SELECT ON @extschema@.job_dependency TO job_monitor;
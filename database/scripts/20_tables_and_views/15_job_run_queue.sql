@@ -0,0 +1,16 @@
+CREATE TABLE @extschema@.job_run_queue (
+    job_id              integer not null,
+    due_at              timestamptz not null,
+    primary key (job_id, due_at)
+);
+-- No foreign key referencing the job table: the launcher must never fail to write the queue because
+-- a job was deleted at the same time. The runs of deleted or disabled jobs are removed by the launcher.
+
+COMMENT ON TABLE @extschema@.job_run_queue IS
+'The runs which are due but have not been started yet, because they wait for a worker or
+for their release moment. The launcher picks them up again after a restart. Runs which
+are started right away when they are due never show up here.';
+COMMENT ON COLUMN @extschema@.job_run_queue.due_at IS
+'The moment this run of the job was scheduled at.';
+
+GRANT SELECT ON @extschema@.job_run_queue TO job_monitor;
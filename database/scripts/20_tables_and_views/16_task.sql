@@ -0,0 +1,28 @@
+CREATE TABLE @extschema@.task (
+    task_id             bigserial primary key,
+    datname             name not null,
+    rolname             name not null,
+    task_command        text not null check ( octet_length(task_command) < 8192 ),
+    not_before          timestamptz not null default now(),
+    enqueued_at         timestamptz not null default now()
+);
+-- The launcher reads the due tasks in the order they are due
+CREATE INDEX task_not_before ON @extschema@.task(not_before);
+-- Enqueueing must be cheap: no foreign keys, and no row triggers. The database and the role are
+-- checked by enqueue, a task of a dropped database or role fails in the worker and is logged.
+
+COMMENT ON TABLE @extschema@.task IS
+'One-shot tasks waiting to be run by the launcher. Use enqueue to add a task, the launcher
+deletes the task once it has handed it to a worker. The outcome is written to the job log.';
+COMMENT ON COLUMN @extschema@.task.task_id IS
+'Surrogate primary key to uniquely identify this task, also shown in the job log.';
+COMMENT ON COLUMN @extschema@.task.datname IS
+'The database to run the task in.';
+COMMENT ON COLUMN @extschema@.task.rolname IS
+'The role to run the task as.';
+COMMENT ON COLUMN @extschema@.task.task_command IS
+'The command to execute.';
+COMMENT ON COLUMN @extschema@.task.not_before IS
+'The task is not started before this moment.';
+
+GRANT SELECT ON @extschema@.task TO job_monitor;
@@ -1,6 +1,6 @@
 CREATE TABLE @extschema@.job_log (
     jl_id               serial primary key,
-    job_id              integer not null,
+    job_id              integer,
     rolname             name not null,
     datname             name not null,
     job_started         timestamptz not null,
@@ -10,19 +10,20 @@ CREATE TABLE @extschema@.job_log (
     exception_message   text,
     exception_detail    text,
     exception_hint      text,
-    exception_context   text
+    exception_context   text,
+    task_id             bigint,
+    batch_rows          bigint[],
+    check ( (job_id IS NULL) <> (task_id IS NULL) )
 );
-CREATE INDEX ON @extschema@.job_log (job_started);
-CREATE INDEX ON @extschema@.job_log (job_finished);
-CREATE INDEX ON @extschema@.job_log (job_sqlstate);
 -- We decide not to add a foreign key referencing the job table, jobs may be deleted (we could use ON DELETE SET NULL)
 -- or the job log is imported somewhere else for processing
 
--- Make sure the contents of this table is dumped when pg_dump is called
-SELECT pg_catalog.pg_extension_config_dump('job_log', '');
+-- The job log is partitioned by day on job_started, see create_job_log_partition.
+-- This table itself stays empty, it holds no indexes. The partitions are created at runtime,
+-- they are not members of the extension and are dumped by pg_dump as regular tables.
 
 COMMENT ON TABLE @extschema@.job_log IS
-'All the job logs are stored in this table.';
+'All the job logs are stored in the partitions of this table, one per day (UTC).';
 
 CREATE VIEW @extschema@.my_job_log WITH (security_barrier) AS
 SELECT *
@@ -60,11 +61,15 @@ BEGIN
             COMMENT ON COLUMN %1$I.%2$I.jl_id  IS
                     'Surrogate primary key to uniquely identify this job log entry.';
             COMMENT ON COLUMN %1$I.%2$I.job_id IS
-                    'The job_id for this run.';
+                    'The job_id for this run, NULL for a task.';
+            COMMENT ON COLUMN %1$I.%2$I.task_id IS
+                    'The task_id of the task this entry is for, NULL for a job.';
             COMMENT ON COLUMN %1$I.%2$I.rolname IS
                     'The role who ran this job.';
             COMMENT ON COLUMN %1$I.%2$I.datname IS
                     'The database where this job ran.';
+            COMMENT ON COLUMN %1$I.%2$I.batch_rows IS
+                    E'The number of rows affected by every batch of a job run in batches, NULL otherwise.\n   Only the first 1024 batches are listed.';
             COMMENT ON COLUMN %1$I.%2$I.job_started IS
                     'When was this job started.';
             COMMENT ON COLUMN %1$I.%2$I.job_finished IS
@@ -0,0 +1,25 @@
+CREATE FUNCTION @extschema@.job_pending_counters(OUT job_id integer, OUT succeeded bigint, OUT failed bigint, OUT last_executed timestamptz)
+RETURNS SETOF record
+LANGUAGE C
+AS 'MODULE_PATHNAME', 'job_pending_counters';
+
+COMMENT ON FUNCTION @extschema@.job_pending_counters() IS
+$$The runs of the jobs which the launcher has accounted for in shared memory,
+but not yet written to the counters in the @extschema@.job table.$$;
+
+CREATE VIEW @extschema@.job_counters WITH (security_barrier) AS
+SELECT mj.job_id,
+       mj.success_count + coalesce(pc.succeeded, 0) AS success_count,
+       mj.failure_count + coalesce(pc.failed, 0) AS failure_count,
+       greatest(mj.last_executed, pc.last_executed) AS last_executed
+  FROM @extschema@.member_job mj
+  LEFT JOIN @extschema@.job_pending_counters() pc ON (mj.job_id = pc.job_id);
+COMMENT ON VIEW @extschema@.job_counters IS
+$$The live counters of the jobs of the roles of which the current_user is a member.
+
+The launcher keeps the counters in shared memory and writes them to the @extschema@.job table
+every elephant_worker.counter_flush_interval, this view shows the sum of both.$$;
+
+GRANT SELECT ON @extschema@.job_counters TO job_scheduler;
+GRANT SELECT ON @extschema@.job_counters TO job_monitor;
+GRANT EXECUTE ON FUNCTION @extschema@.job_pending_counters() TO job_monitor;
@@ -1,11 +1,10 @@
-CREATE FUNCTION @extschema@.schedule_matches(schedule @extschema@.schedule, matcher @extschema@.schedule_matcher)
+CREATE FUNCTION @extschema@.schedule_matches(schedule @extschema@.schedule, runtime timestamptz)
 RETURNS BOOLEAN
 RETURNS NULL ON NULL INPUT
-LANGUAGE SQL
-AS
-$BODY$
-    
-    SELECT true;
-$BODY$
-SECURITY INVOKER
-IMMUTABLE;
+LANGUAGE C
+AS 'MODULE_PATHNAME', 'schedule_matches'
+STABLE;
+
+COMMENT ON FUNCTION @extschema@.schedule_matches(@extschema@.schedule, timestamptz) IS
+'Returns true if the schedule fires in the minute of runtime. Crontab schedules
+are evaluated in the current TimeZone, like the launcher does.';
@@ -0,0 +1,12 @@
+CREATE FUNCTION @extschema@.schedule_next_run(schedule @extschema@.schedule, after timestamptz)
+RETURNS timestamptz
+RETURNS NULL ON NULL INPUT
+LANGUAGE C
+AS 'MODULE_PATHNAME', 'schedule_next_run'
+STABLE;
+
+COMMENT ON FUNCTION @extschema@.schedule_next_run(@extschema@.schedule, timestamptz) IS
+'Returns the first moment after "after" at which the schedule fires, or null if it
+will never fire again. For schedules without seconds this is the first minute after
+the minute of "after". Crontab schedules are evaluated in the current TimeZone, like
+the launcher does.';
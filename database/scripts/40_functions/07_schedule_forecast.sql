@@ -0,0 +1,28 @@
+CREATE FUNCTION @extschema@.schedule_forecast(from_time timestamptz, to_time timestamptz, OUT minute timestamptz, OUT job_id integer)
+RETURNS SETOF record
+RETURNS NULL ON NULL INPUT
+LANGUAGE C
+AS 'MODULE_PATHNAME', 'schedule_forecast'
+STABLE
+SECURITY DEFINER
+ROWS 1000;
+
+COMMENT ON FUNCTION @extschema@.schedule_forecast(timestamptz, timestamptz) IS
+'Returns a row for every job and every minute between from_time and to_time in which
+the job will be started according to its schedule. Only enabled jobs of roles the
+session_user is a member of are shown. Crontab schedules are evaluated in the current TimeZone.';
+
+CREATE FUNCTION @extschema@.schedule_forecast_counts(from_time timestamptz, to_time timestamptz, OUT minute timestamptz, OUT jobs integer)
+RETURNS SETOF record
+RETURNS NULL ON NULL INPUT
+LANGUAGE C
+AS 'MODULE_PATHNAME', 'schedule_forecast_counts'
+STABLE
+SECURITY DEFINER
+ROWS 1000;
+
+COMMENT ON FUNCTION @extschema@.schedule_forecast_counts(timestamptz, timestamptz) IS
+'Returns the number of jobs which will be started in every minute between from_time
+and to_time, useful to find load spikes before they happen. Example:
+
+    SELECT * FROM schedule_forecast_counts(now(), now() + interval ''1 week'') ORDER BY jobs DESC LIMIT 10;';
@@ -6,7 +6,15 @@ CREATE FUNCTION @extschema@.insert_job(
         job_description text    default null,
         enabled boolean         default true,
         job_timeout interval    default '6 hours',
-        parallel boolean        default false)
+        parallel boolean        default false,
+        priority smallint       default 0,
+        misfire text            default 'once',
+        batch_size integer      default null,
+        batch_delay interval    default '0',
+        cost_limit integer      default null,
+        cost_delay interval     default null,
+        deferrable boolean      default false,
+        window_id integer       default null)
 RETURNS @extschema@.member_job
 LANGUAGE SQL
 AS
@@ -18,6 +26,14 @@ $BODY$
         enabled,
         job_timeout,
         parallel,
+        priority,
+        misfire,
+        batch_size,
+        batch_delay,
+        cost_limit,
+        cost_delay,
+        deferrable,
+        window_id,
         roloid,
         datoid)
     VALUES (
@@ -27,11 +43,19 @@ $BODY$
         insert_job.enabled,
         insert_job.job_timeout,
         insert_job.parallel,
+        insert_job.priority,
+        insert_job.misfire,
+        insert_job.batch_size,
+        insert_job.batch_delay,
+        insert_job.cost_limit,
+        insert_job.cost_delay,
+        insert_job.deferrable,
+        insert_job.window_id,
         (SELECT oid FROM pg_catalog.pg_roles    pr WHERE pr.rolname= insert_job.rolname),
         (SELECT oid FROM pg_catalog.pg_database pd WHERE pd.datname = insert_job.datname)
     )
     RETURNING *;
 $BODY$;
 
-COMMENT ON FUNCTION @extschema@.insert_job(text, name, @extschema@.schedule, name,text, boolean,interval,boolean) IS
+COMMENT ON FUNCTION @extschema@.insert_job(text, name, @extschema@.schedule, name,text, boolean,interval,boolean,smallint,text,integer,interval,integer,interval,boolean,integer) IS
 'Creates a job entry. Returns the record containing this new job.';
@@ -7,7 +7,15 @@ CREATE FUNCTION @extschema@.update_job(
         job_description text default null,
         enabled boolean default null,
         job_timeout interval default null,
-        parallel boolean default null)
+        parallel boolean default null,
+        priority smallint default null,
+        misfire text default null,
+        batch_size integer default null,
+        batch_delay interval default null,
+        cost_limit integer default null,
+        cost_delay interval default null,
+        deferrable boolean default null,
+        window_id integer default null)
 RETURNS @extschema@.member_job
 LANGUAGE SQL
 AS
@@ -19,11 +27,19 @@ $BODY$
 		enabled         = coalesce(update_job.enabled,         enabled),
 		job_timeout     = coalesce(update_job.job_timeout,     job_timeout),
 		parallel        = coalesce(update_job.parallel,        parallel),
+		priority        = coalesce(update_job.priority,        priority),
+		misfire         = coalesce(update_job.misfire,         misfire),
+		batch_size      = coalesce(update_job.batch_size,      batch_size),
+		batch_delay     = coalesce(update_job.batch_delay,     batch_delay),
+		cost_limit      = coalesce(update_job.cost_limit,      cost_limit),
+		cost_delay      = coalesce(update_job.cost_delay,      cost_delay),
+		deferrable      = coalesce(update_job.deferrable,      deferrable),
+		window_id       = coalesce(update_job.window_id,       window_id),
 		roloid          = (SELECT oid FROM pg_catalog.pg_roles    pr WHERE pr.rolname = coalesce(update_job.rolname, mj.rolname)),
 		datoid          = (SELECT oid FROM pg_catalog.pg_database pd WHERE pd.datname = coalesce(update_job.datname, mj.datname))
 	WHERE job_id     = update_job.job_id
     RETURNING *;
 $BODY$;
 
-COMMENT ON FUNCTION @extschema@.update_job(integer, text, name, schedule, name, text, boolean, interval, boolean) IS
+COMMENT ON FUNCTION @extschema@.update_job(integer, text, name, schedule, name, text, boolean, interval, boolean, smallint, text, integer, interval, integer, interval, boolean, integer) IS
 'Update a given job_id with the provided values. Returns the new (update) record.';
@@ -0,0 +1,29 @@
+CREATE FUNCTION @extschema@.add_job_dependency(job_id integer, depends_on integer)
+RETURNS @extschema@.member_job_dependency
+RETURNS NULL ON NULL INPUT
+LANGUAGE SQL
+AS
+$BODY$
+    INSERT INTO @extschema@.member_job_dependency (job_id, depends_on)
+    VALUES (add_job_dependency.job_id, add_job_dependency.depends_on)
+    RETURNING *;
+$BODY$;
+
+COMMENT ON FUNCTION @extschema@.add_job_dependency(integer, integer) IS
+'Makes the job run as soon as the job it depends on, and all its other upstream jobs, have succeeded.
+Returns the new dependency.';
+
+CREATE FUNCTION @extschema@.delete_job_dependency(job_id integer, depends_on integer)
+RETURNS @extschema@.member_job_dependency
+RETURNS NULL ON NULL INPUT
+LANGUAGE SQL
+AS
+$BODY$
+    DELETE FROM @extschema@.member_job_dependency mjd
+     WHERE mjd.job_id = delete_job_dependency.job_id
+       AND mjd.depends_on = delete_job_dependency.depends_on
+    RETURNING *;
+$BODY$;
+
+COMMENT ON FUNCTION @extschema@.delete_job_dependency(integer, integer) IS
+'Deletes the dependency of the job on another job. Returns the deleted record.';
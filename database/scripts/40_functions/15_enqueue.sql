@@ -0,0 +1,57 @@
+CREATE FUNCTION @extschema@.notify_task_enqueued() RETURNS TRIGGER
+LANGUAGE C
+AS 'MODULE_PATHNAME', 'notify_task_enqueued';
+
+COMMENT ON FUNCTION @extschema@.notify_task_enqueued() IS
+$$Wakes up the launcher when the transaction commits, so that it reads the tasks which are due.$$;
+
+CREATE TRIGGER notify_task_enqueued AFTER INSERT ON @extschema@.task
+    FOR EACH STATEMENT EXECUTE PROCEDURE @extschema@.notify_task_enqueued();
+
+CREATE FUNCTION @extschema@.enqueue(
+        command text,
+        datname name            default current_catalog,
+        rolname name            default current_user,
+        not_before timestamptz  default now())
+RETURNS bigint
+LANGUAGE plpgsql
+AS
+$BODY$
+DECLARE
+    result bigint;
+BEGIN
+    IF NOT pg_catalog.pg_has_role(session_user, enqueue.rolname, 'MEMBER')
+    THEN
+        RAISE SQLSTATE '42501' USING
+        MESSAGE = 'Insufficient privileges',
+        DETAIL  = format('You are not a member of role "%s"', enqueue.rolname);
+    END IF;
+
+    PERFORM 1
+       FROM pg_catalog.pg_database pd
+      WHERE pd.datname = enqueue.datname;
+
+    IF NOT FOUND THEN
+        RAISE SQLSTATE '22023' USING
+            MESSAGE = 'Invalid parameter value',
+            DETAIL  = format('Database "%s" does not exist', enqueue.datname);
+    END IF;
+
+    INSERT INTO @extschema@.task (datname, rolname, task_command, not_before)
+    VALUES (enqueue.datname, enqueue.rolname, enqueue.command, coalesce(enqueue.not_before, now()))
+    RETURNING task_id
+    INTO result;
+
+    RETURN result;
+END;
+$BODY$
+SECURITY DEFINER;
+
+COMMENT ON FUNCTION @extschema@.enqueue(text, name, name, timestamptz) IS
+'Enqueues a one-shot task, which the launcher runs in a background worker once not_before
+has passed and the transaction has committed. Returns the task_id, under which the outcome
+is written to the job log. Tasks do not go through the job table: enqueueing takes a single
+insert into a table with one index, many thousands of tasks can be enqueued per second.
+Example:
+
+    SELECT enqueue(format(''SELECT refresh_report(%s)'', 42), not_before := now() + interval ''5 minutes'');';
@@ -16,15 +16,22 @@ BEGIN
         DETAIL  = format('You are not a member of role "%s"', user_name);
     END IF;
 
-    IF NEW.schedule IS NOT NULL AND @extschema@.parse_crontab(NEW.schedule) IS NULL THEN
-        -- We convert the user provided timestamps into 'YYYY-MM-DD HH24:MI OF'
-        NEW.schedule := @extschema@.parse_truncate_timestamps(NEW.schedule);
-
-        -- Special case: provided timestamp matches current moment, we bump it 1 minute, so
-        -- it will be executed asap.
-        IF NEW.schedule = to_char(clock_timestamp() at time zone 'utc', '{\"YYYY-MM-DD HH24:MI OF\"}') THEN
-            NEW.schedule := @extschema@.parse_truncate_timestamps((NEW.schedule::timestamptz + interval '1 minute')::text);
-        END IF;
+    -- The schedule type has already truncated the timestamps to the minute.
+    -- Special case: a new schedule which matches the current moment is bumped 1 minute, so
+    -- it will be executed asap. A schedule which is not changed is left alone, its minute may
+    -- have come while the job was waiting to run.
+    -- The operators of the schedule type live in our schema, which need not be on the search_path
+    IF (TG_OP = 'INSERT' OR NEW.schedule::text IS DISTINCT FROM OLD.schedule::text)
+       AND NEW.schedule OPERATOR(@extschema@.=) date_trunc('minute', clock_timestamp())::text::@extschema@.schedule THEN
+        NEW.schedule := (date_trunc('minute', clock_timestamp()) + interval '1 minute')::text::@extschema@.schedule;
+    END IF;
+
+    -- The launcher keeps next_run_at up to date once it has loaded the job,
+    -- until then we provide the next run ourselves
+    IF TG_OP = 'INSERT' THEN
+        NEW.next_run_at := @extschema@.schedule_next_run(NEW.schedule, clock_timestamp());
+    ELSIF NEW.schedule::text IS DISTINCT FROM OLD.schedule::text THEN
+        NEW.next_run_at := @extschema@.schedule_next_run(NEW.schedule, clock_timestamp());
     END IF;
 
     IF TG_OP = 'UPDATE' AND NEW.job_id <> OLD.job_id THEN
@@ -41,12 +48,136 @@ LANGUAGE plpgsql;
 COMMENT ON FUNCTION @extschema@.validate_job_definition() IS
 $$We want to maintain some sanity on the @extschema@.job table.
 
-Many checks are taken care of by check constraints
-(on the @extschema@.schedule DOMAIN, and the @extschema@.job TABLE).
+Many checks are taken care of by check constraints on the @extschema@.job TABLE,
+the @extschema@.schedule TYPE only accepts valid schedules.
 
-We do some extra checks here and if a schedule consisting of timestamps is provided
-we convert it into timestaps at utc with a granularity of 1 minute.
+We do some extra checks here and if a new schedule consisting of only the current minute
+is provided we move it to the next minute. We also set next_run_at for new schedules.
+Updates of the columns written by the launcher only do not fire this trigger.
 $$;
 
-CREATE TRIGGER validate_job_definition BEFORE INSERT OR UPDATE ON @extschema@.job
+CREATE TRIGGER validate_job_definition BEFORE INSERT ON @extschema@.job
     FOR EACH ROW EXECUTE PROCEDURE @extschema@.validate_job_definition();
+
+-- The launcher writes next_run_at and the counters of the jobs, which need no validation
+CREATE TRIGGER validate_job_update BEFORE UPDATE ON @extschema@.job
+    FOR EACH ROW
+    WHEN (   OLD.job_id          IS DISTINCT FROM NEW.job_id
+          OR OLD.datoid          IS DISTINCT FROM NEW.datoid
+          OR OLD.roloid          IS DISTINCT FROM NEW.roloid
+          OR OLD.schedule        IS DISTINCT FROM NEW.schedule
+          OR OLD.enabled         IS DISTINCT FROM NEW.enabled
+          OR OLD.parallel        IS DISTINCT FROM NEW.parallel
+          OR OLD.priority        IS DISTINCT FROM NEW.priority
+          OR OLD.misfire         IS DISTINCT FROM NEW.misfire
+          OR OLD.job_command     IS DISTINCT FROM NEW.job_command
+          OR OLD.job_description IS DISTINCT FROM NEW.job_description
+          OR OLD.job_timeout     IS DISTINCT FROM NEW.job_timeout
+          OR OLD.batch_size      IS DISTINCT FROM NEW.batch_size
+          OR OLD.batch_delay     IS DISTINCT FROM NEW.batch_delay
+          OR OLD.cost_limit      IS DISTINCT FROM NEW.cost_limit
+          OR OLD.cost_delay      IS DISTINCT FROM NEW.cost_delay
+          OR OLD.deferrable      IS DISTINCT FROM NEW.deferrable
+          OR OLD.window_id       IS DISTINCT FROM NEW.window_id)
+    EXECUTE PROCEDURE @extschema@.validate_job_definition();
+
+CREATE FUNCTION @extschema@.notify_job_change() RETURNS TRIGGER
+LANGUAGE C
+AS 'MODULE_PATHNAME', 'notify_job_change';
+
+COMMENT ON FUNCTION @extschema@.notify_job_change() IS
+$$The launcher keeps a compiled copy of all enabled jobs in memory.
+
+This trigger remembers which jobs were changed, and when the transaction commits,
+tells the launcher to refresh only those jobs. A TRUNCATE makes the launcher reload all jobs,
+as does any change of the maintenance windows.
+$$;
+
+CREATE TRIGGER notify_job_change AFTER INSERT OR DELETE ON @extschema@.job
+    FOR EACH ROW EXECUTE PROCEDURE @extschema@.notify_job_change();
+
+-- The launcher updates the counters of the jobs it has run, which does not change their definition
+CREATE TRIGGER notify_job_update AFTER UPDATE ON @extschema@.job
+    FOR EACH ROW
+    WHEN (   OLD.datoid      IS DISTINCT FROM NEW.datoid
+          OR OLD.roloid      IS DISTINCT FROM NEW.roloid
+          OR OLD.schedule    IS DISTINCT FROM NEW.schedule
+          OR OLD.enabled     IS DISTINCT FROM NEW.enabled
+          OR OLD.parallel    IS DISTINCT FROM NEW.parallel
+          OR OLD.priority    IS DISTINCT FROM NEW.priority
+          OR OLD.misfire     IS DISTINCT FROM NEW.misfire
+          OR OLD.job_command IS DISTINCT FROM NEW.job_command
+          OR OLD.job_timeout IS DISTINCT FROM NEW.job_timeout
+          OR OLD.batch_size  IS DISTINCT FROM NEW.batch_size
+          OR OLD.batch_delay IS DISTINCT FROM NEW.batch_delay
+          OR OLD.cost_limit  IS DISTINCT FROM NEW.cost_limit
+          OR OLD.cost_delay  IS DISTINCT FROM NEW.cost_delay
+          OR OLD.deferrable  IS DISTINCT FROM NEW.deferrable
+          OR OLD.window_id   IS DISTINCT FROM NEW.window_id)
+    EXECUTE PROCEDURE @extschema@.notify_job_change();
+
+CREATE TRIGGER notify_job_truncate AFTER TRUNCATE ON @extschema@.job
+    FOR EACH STATEMENT EXECUTE PROCEDURE @extschema@.notify_job_change();
+
+-- The launcher loads the maintenance windows with all jobs, they are few and change rarely
+CREATE TRIGGER notify_window_change AFTER INSERT OR UPDATE OR DELETE OR TRUNCATE ON @extschema@.maintenance_window
+    FOR EACH STATEMENT EXECUTE PROCEDURE @extschema@.notify_job_change();
+
+CREATE FUNCTION @extschema@.validate_job_dependency() RETURNS TRIGGER AS
+$BODY$
+DECLARE
+    launchers integer;
+BEGIN
+    -- Every launcher only learns about the jobs it runs itself, see elephant_worker.launchers
+    BEGIN
+        launchers := current_setting('elephant_worker.launchers')::integer;
+    EXCEPTION WHEN undefined_object THEN
+        launchers := 1;
+    END;
+    IF NEW.job_id % launchers <> NEW.depends_on % launchers THEN
+        RAISE SQLSTATE '22023' USING
+        MESSAGE = 'Invalid parameter value',
+        DETAIL  = format('Job %s and job %s are scheduled by different launchers', NEW.job_id, NEW.depends_on),
+        HINT    = 'With elephant_worker.launchers set, a job can only depend on jobs whose job_id is equal modulo the number of launchers.';
+    END IF;
+
+    -- Only one transaction at a time may add dependencies, or two of them could close a cycle together
+    LOCK TABLE @extschema@.job_dependency IN SHARE ROW EXCLUSIVE MODE;
+
+    PERFORM 1
+       FROM (WITH RECURSIVE upstream(job_id) AS (
+                SELECT NEW.depends_on
+                 UNION
+                SELECT jd.depends_on
+                  FROM @extschema@.job_dependency jd
+                  JOIN upstream u ON (jd.job_id = u.job_id)
+             )
+             SELECT job_id FROM upstream) AS u
+      WHERE u.job_id = NEW.job_id;
+
+    IF FOUND THEN
+        RAISE SQLSTATE '22023' USING
+        MESSAGE = 'Invalid parameter value',
+        DETAIL  = format('Job %s depends on job %s already, directly or indirectly', NEW.depends_on, NEW.job_id);
+    END IF;
+
+    RETURN NEW;
+END;
+$BODY$
+LANGUAGE plpgsql
+SECURITY DEFINER;
+
+COMMENT ON FUNCTION @extschema@.validate_job_dependency() IS
+$$Refuses a dependency which would make a job depend on itself through other jobs,
+or on a job scheduled by another launcher.$$;
+
+-- Dependencies are added and deleted, they are never updated
+CREATE TRIGGER validate_job_dependency BEFORE INSERT ON @extschema@.job_dependency
+    FOR EACH ROW EXECUTE PROCEDURE @extschema@.validate_job_dependency();
+
+-- The launcher keeps the jobs a job depends on with the job itself
+CREATE TRIGGER notify_job_dependency_change AFTER INSERT OR DELETE ON @extschema@.job_dependency
+    FOR EACH ROW EXECUTE PROCEDURE @extschema@.notify_job_change();
+
+CREATE TRIGGER notify_job_dependency_truncate AFTER TRUNCATE ON @extschema@.job_dependency
+    FOR EACH STATEMENT EXECUTE PROCEDURE @extschema@.notify_job_change();
@@ -0,0 +1,113 @@
+CREATE FUNCTION @extschema@.create_job_log_partition(day date)
+RETURNS regclass
+RETURNS NULL ON NULL INPUT
+LANGUAGE plpgsql
+AS
+$BODY$
+DECLARE
+    partition_name name := 'job_log_' || to_char(day, 'YYYYMMDD');
+    partition_oid  oid;
+BEGIN
+    SELECT pc.oid
+      INTO partition_oid
+      FROM pg_catalog.pg_class     pc
+      JOIN pg_catalog.pg_namespace pn ON (pc.relnamespace = pn.oid)
+     WHERE pn.nspname = '@extschema@'
+       AND pc.relname = partition_name;
+
+    IF FOUND THEN
+        RETURN partition_oid;
+    END IF;
+
+    BEGIN
+        EXECUTE format($format$
+            CREATE TABLE %1$I.%2$I (
+                PRIMARY KEY (jl_id),
+                CHECK ( job_started >= %3$L AND job_started < %4$L )
+            ) INHERITS (%1$I.job_log);
+            CREATE INDEX ON %1$I.%2$I (job_started);
+            CREATE INDEX ON %1$I.%2$I (job_finished);
+            CREATE INDEX ON %1$I.%2$I (job_sqlstate);
+            REVOKE ALL ON %1$I.%2$I FROM PUBLIC;
+            GRANT SELECT ON %1$I.%2$I TO job_monitor;
+                       $format$,
+                       '@extschema@',
+                       partition_name,
+                       day::timestamp at time zone 'utc',
+                       (day + 1)::timestamp at time zone 'utc');
+    EXCEPTION
+        WHEN duplicate_table THEN
+            -- Somebody else was faster
+            NULL;
+    END;
+
+    RETURN format('%I.%I', '@extschema@', partition_name)::regclass;
+END;
+$BODY$
+SECURITY DEFINER;
+
+COMMENT ON FUNCTION @extschema@.create_job_log_partition(date) IS
+$$Creates the partition of the job log holding the jobs started on the given day (UTC),
+unless it exists already. Returns the partition.$$;
+
+CREATE FUNCTION @extschema@.maintain_job_log_partitions(retention interval, premake integer default 2)
+RETURNS void
+LANGUAGE plpgsql
+AS
+$BODY$
+DECLARE
+    today     date := (clock_timestamp() at time zone 'utc')::date;
+    partition record;
+BEGIN
+    FOR i IN 0..coalesce(premake, 0)
+    LOOP
+        PERFORM @extschema@.create_job_log_partition(today + i);
+    END LOOP;
+
+    -- A retention of zero or NULL keeps the job log forever
+    IF retention IS NULL OR retention <= interval '0' THEN
+        RETURN;
+    END IF;
+
+    FOR partition IN
+        SELECT pc.relname
+          FROM pg_catalog.pg_inherits  pi
+          JOIN pg_catalog.pg_class     pc ON (pi.inhrelid = pc.oid)
+          JOIN pg_catalog.pg_namespace pn ON (pc.relnamespace = pn.oid)
+         WHERE pi.inhparent = '@extschema@.job_log'::regclass
+           AND pn.nspname = '@extschema@'
+           AND pc.relname ~ '^job_log_[0-9]{8}$'
+           -- the whole day lies beyond the retention period
+           AND (to_date(substr(pc.relname, 9), 'YYYYMMDD') + 1)::timestamp at time zone 'utc' <= clock_timestamp() - retention
+         ORDER BY pc.relname
+    LOOP
+        EXECUTE format('DROP TABLE %I.%I', '@extschema@', partition.relname);
+        RAISE LOG 'dropped expired job log partition %', partition.relname;
+    END LOOP;
+END;
+$BODY$
+SECURITY INVOKER;
+
+COMMENT ON FUNCTION @extschema@.maintain_job_log_partitions(interval, integer) IS
+$$Creates the job log partitions for today and the next premake days, and drops the partitions
+of the days which are older than retention. The launcher calls this regularly, using
+elephant_worker.log_retention.$$;
+
+CREATE FUNCTION @extschema@.route_job_log() RETURNS TRIGGER AS
+$BODY$
+BEGIN
+    EXECUTE format('INSERT INTO %s SELECT ($1).*',
+                   @extschema@.create_job_log_partition((NEW.job_started at time zone 'utc')::date))
+      USING NEW;
+    RETURN NULL;
+END;
+$BODY$
+LANGUAGE plpgsql
+SECURITY DEFINER;
+
+COMMENT ON FUNCTION @extschema@.route_job_log() IS
+$$Rows inserted into @extschema@.job_log itself are moved into the partition of their day.
+The launcher writes into the partitions directly.$$;
+
+CREATE TRIGGER route_job_log BEFORE INSERT ON @extschema@.job_log
+    FOR EACH ROW EXECUTE PROCEDURE @extschema@.route_job_log();
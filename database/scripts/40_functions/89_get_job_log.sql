@@ -1,10 +1,21 @@
 CREATE FUNCTION @extschema@.create_job_log(job_id integer)
 RETURNS @extschema@.member_job_log
 RETURNS NULL ON NULL INPUT
-LANGUAGE SQL
+LANGUAGE plpgsql
 AS
 $BODY$
-     INSERT INTO @extschema@.member_job_log (
+DECLARE
+    result @extschema@.member_job_log;
+BEGIN
+    PERFORM 1
+       FROM @extschema@.member_job mj
+      WHERE mj.job_id = create_job_log.job_id;
+
+    IF NOT FOUND THEN
+        RETURN NULL;
+    END IF;
+
+    INSERT INTO @extschema@.member_job_log (
             job_id,
             rolname,
             datname,
@@ -17,7 +28,15 @@ $BODY$
             job_command,
             clock_timestamp()
        FROM @extschema@.member_job mj
-      WHERE mj.job_id = create_job_log.job_id
-      RETURNING *
+      WHERE mj.job_id = create_job_log.job_id;
+
+    -- The row is routed into a partition of the job log, which means RETURNING yields nothing
+    SELECT *
+      INTO result
+      FROM @extschema@.member_job_log mjl
+     WHERE mjl.jl_id = currval(pg_catalog.pg_get_serial_sequence('@extschema@.job_log', 'jl_id'));
+
+    RETURN result;
+END;
 $BODY$
 SECURITY INVOKER;
@@ -0,0 +1,16 @@
+CREATE FUNCTION @extschema@.trigger_job(job_id integer)
+RETURNS void
+RETURNS NULL ON NULL INPUT
+LANGUAGE C
+AS 'MODULE_PATHNAME', 'trigger_job'
+VOLATILE
+SECURITY DEFINER;
+
+COMMENT ON FUNCTION @extschema@.trigger_job(integer) IS
+'Asks the launcher to run the job in a background worker right away, without waiting
+for its schedule; the job may have no schedule at all. The request is handed to the
+launcher when the transaction commits, so the job sees the changes of the transaction.
+A job which is waiting for a worker slot already is not queued again. Only enabled jobs
+of roles the session_user is a member of can be triggered. Example:
+
+    SELECT trigger_job(42);';
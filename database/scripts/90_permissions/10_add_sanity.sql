@@ -28,12 +28,12 @@ DECLARE
          WHERE deptype='e'
            AND extname='elephant_worker';
 
-    domain_cursor CURSOR FOR
+    type_cursor CURSOR FOR
         SELECT typname
           FROM pg_catalog.pg_depend    pd
           JOIN pg_catalog.pg_extension pe ON (pd.refobjid = pe.oid)
           JOIN pg_catalog.pg_type      pt ON (pd.objid    = pt.oid)
-         WHERE typtype = 'd'
+         WHERE typtype IN ('b', 'd')
            AND extname='elephant_worker';
 BEGIN
     FOR object IN relation_cursor
@@ -53,10 +53,10 @@ BEGIN
         EXECUTE format('GRANT EXECUTE ON FUNCTION %I.%I(%s) TO job_scheduler', '@extschema@', object.proname, object.identity_arguments);
     END LOOP;
 
-    FOR object IN domain_cursor
+    FOR object IN type_cursor
     LOOP
-        EXECUTE format('REVOKE ALL ON DOMAIN %I.%I FROM PUBLIC', '@extschema@', object.typname);
-        EXECUTE format('GRANT USAGE ON DOMAIN %I.%I TO job_scheduler', '@extschema@', object.typname);
+        EXECUTE format('REVOKE ALL ON TYPE %I.%I FROM PUBLIC', '@extschema@', object.typname);
+        EXECUTE format('GRANT USAGE ON TYPE %I.%I TO job_scheduler', '@extschema@', object.typname);
     END LOOP;
 END;
 $$;
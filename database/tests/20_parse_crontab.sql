@@ -0,0 +1,7 @@
+SELECT * FROM :extschema.parse_crontab('7-55/9 */6 * 1,6-8 *');
+SELECT * FROM :extschema.parse_crontab('0 0 13 * 5');
+SELECT * FROM :extschema.parse_crontab('0 0 * * 7');
+SELECT * FROM :extschema.parse_crontab('@hourly');
+SELECT * FROM :extschema.parse_crontab('{"2042-12-05 13:37 +00"}');
+SELECT :extschema.parse_cronfield('*/12,30-40/3', 0, 59);
+SELECT :extschema.parse_cronfield('x', 0, 59);
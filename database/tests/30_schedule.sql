@@ -8,3 +8,41 @@ INSERT INTO :extschema.my_job (job_command, datoid, schedule) VALUES
 ('SELECT 1', :datoid, '*/12,30-40/3 0 * 11 0'),
 ('SELECT 1', :datoid, '@hourly'),
 ('SELECT 1', :datoid, '1-59/7 1 * 1 1');
+SELECT '7-55/9 */6 * 1,6-8 *':::extschema.schedule, '@daily':::extschema.schedule, '1-31 * * * 1':::extschema.schedule;
+SELECT '{"2042-12-05 13:37:42 +00","2014-01-01 12:31 +02","2042-12-05 13:37 +00"}':::extschema.schedule;
+SELECT '0 0 * * 7':::extschema.schedule OPERATOR(:extschema.=) '0 0 * * 0':::extschema.schedule;
+SELECT '* * 1-31 * *':::extschema.schedule OPERATOR(:extschema.=) '* * * * *':::extschema.schedule,
+       '* * * * 0-6':::extschema.schedule OPERATOR(:extschema.=) ('* * * * 0-6':::extschema.schedule)::text:::extschema.schedule;
+SELECT :extschema.schedule_matches('*/15 12 * * *', '2014-06-01 12:45:30'),
+       :extschema.schedule_matches('*/15 12 * * *', '2014-06-01 12:46');
+SELECT 'x':::extschema.schedule;
+SELECT '0,30 * * * * *':::extschema.schedule, '0 */5 * * * *':::extschema.schedule,
+       '@every 90s':::extschema.schedule, '@every 1d2h':::extschema.schedule;
+SELECT '@every 10':::extschema.schedule;
+SELECT '@every 0s':::extschema.schedule;
+SELECT :extschema.schedule_next_run('*/20 * * * * *', '2014-06-01 12:00:20'),
+       :extschema.schedule_next_run('@every 15s', '2014-06-01 12:00:31'),
+       :extschema.schedule_matches('@every 1h', '2014-06-01 12:00:30'),
+       :extschema.schedule_matches('@every 1h', '2014-06-01 12:01');
+SELECT :extschema.schedule_next_run('{"2042-12-05 13:37 +00"}', '2042-01-01 00:00 +00'),
+       :extschema.schedule_next_run('{"2042-12-05 13:37 +00"}', '2042-12-05 13:37 +00'),
+       :extschema.schedule_next_run('0 12 * * *', '2014-06-01 12:00:30');
+SELECT :extschema.schedule_next_run('0 0 29 2 *', '2096-03-01 00:00');
+SELECT count(*) AS without_next_run FROM :extschema.my_job WHERE next_run_at IS NULL;
+SELECT * FROM :extschema.schedule_forecast_counts('2014-01-06 00:00', '2014-01-06 00:10');
+SELECT count(*) FROM :extschema.schedule_forecast('2014-01-01', '2014-02-01');
+SET search_path TO pg_catalog;
+SELECT schedule FROM :extschema.insert_job('SELECT ''outside the search_path''', current_catalog, schedule := '@weekly');
+SELECT (:extschema.update_job(job_id, schedule := '@monthly')).schedule
+  FROM :extschema.my_job WHERE job_command = 'SELECT ''outside the search_path''';
+RESET search_path;
+-- A one-shot job whose minute has come keeps its schedule when the launcher writes next_run_at
+ALTER TABLE :extschema.job DISABLE TRIGGER validate_job_definition;
+INSERT INTO :extschema.my_job (job_command, datoid, schedule)
+VALUES ('SELECT ''one-shot''', :datoid, date_trunc('minute', clock_timestamp())::text:::extschema.schedule)
+RETURNING job_id AS one_shot_id, schedule::text AS one_shot_schedule
+\gset
+ALTER TABLE :extschema.job ENABLE TRIGGER validate_job_definition;
+UPDATE :extschema.job SET next_run_at = NULL WHERE job_id = :one_shot_id;
+UPDATE :extschema.job SET success_count = success_count + 1 WHERE job_id = :one_shot_id;
+SELECT schedule::text = :'one_shot_schedule' AS schedule_unchanged FROM :extschema.job WHERE job_id = :one_shot_id;
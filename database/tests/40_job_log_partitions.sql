@@ -0,0 +1,5 @@
+SELECT :extschema.maintain_job_log_partitions('30 days');
+SELECT count(*) AS partitions FROM pg_catalog.pg_inherits WHERE inhparent = (:'extschema' || '.job_log')::regclass;
+SELECT :extschema.create_job_log_partition('2014-01-01');
+SELECT :extschema.maintain_job_log_partitions('30 days', 0);
+SELECT count(*) AS partitions FROM pg_catalog.pg_inherits WHERE inhparent = (:'extschema' || '.job_log')::regclass;
@@ -0,0 +1,4 @@
+SELECT :extschema.enqueue('SELECT 1') > 0 AS enqueued;
+SELECT :extschema.enqueue('SELECT 2', current_catalog, current_user, now() + interval '1 hour') > 0 AS enqueued;
+SELECT task_command, not_before > now() AS later FROM :extschema.task ORDER BY task_id;
+SELECT :extschema.enqueue('SELECT 3', 'no_such_database');
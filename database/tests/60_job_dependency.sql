@@ -0,0 +1,10 @@
+INSERT INTO :extschema.my_job (job_command, datoid) VALUES ('SELECT ''extract''', :datoid) RETURNING job_id AS extract_id
+\gset
+INSERT INTO :extschema.my_job (job_command, datoid) VALUES ('SELECT ''load''', :datoid) RETURNING job_id AS load_id
+\gset
+SELECT job_id = :load_id AS downstream, depends_on = :extract_id AS upstream FROM :extschema.add_job_dependency(:load_id, :extract_id);
+SELECT :extschema.add_job_dependency(:extract_id, :load_id);
+SELECT :extschema.add_job_dependency(:load_id, :load_id);
+SELECT count(*) AS dependencies FROM :extschema.member_job_dependency WHERE job_id = :load_id;
+SELECT job_id = :extract_id AS deleted FROM :extschema.delete_job(:extract_id);
+SELECT count(*) AS dependencies FROM :extschema.member_job_dependency WHERE job_id = :load_id;
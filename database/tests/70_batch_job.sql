@@ -0,0 +1,6 @@
+SELECT batch_size, batch_delay FROM :extschema.insert_job('SELECT generate_series(1, $1) LIMIT 0', current_catalog, batch_size := 1000, batch_delay := '1 second');
+SELECT batch_size, batch_delay FROM :extschema.insert_job('SELECT 1', current_catalog);
+SELECT :extschema.insert_job('SELECT 2', current_catalog, batch_size := 0);
+SELECT cost_limit, cost_delay FROM :extschema.insert_job('SELECT 3 LIMIT $1', current_catalog, batch_size := 100, cost_limit := 500, cost_delay := '20 ms');
+SELECT (:extschema.update_job(job_id, cost_delay := '0')).cost_delay FROM :extschema.my_job WHERE job_command = 'SELECT 3 LIMIT $1';
+SELECT :extschema.insert_job('SELECT 4', current_catalog, cost_limit := 0);
@@ -0,0 +1,3 @@
+SELECT deferrable FROM :extschema.insert_job('SELECT ''deferrable''', current_catalog, deferrable := true);
+SELECT deferrable FROM :extschema.insert_job('SELECT ''not deferrable''', current_catalog);
+SELECT (:extschema.update_job(job_id, deferrable := false)).deferrable FROM :extschema.my_job WHERE job_command = 'SELECT ''deferrable''';
@@ -0,0 +1,8 @@
+INSERT INTO :extschema.maintenance_window (window_name, opens, duration) VALUES ('nightly', '0 2 * * *', '3 hours');
+INSERT INTO :extschema.maintenance_window (window_name, opens, duration) VALUES ('empty', '0 3 * * *', '0');
+SELECT window_id IS NOT NULL FROM :extschema.insert_job('ANALYZE', current_catalog, schedule := '@daily',
+       window_id := (SELECT window_id FROM :extschema.maintenance_window WHERE window_name = 'nightly'));
+SELECT :extschema.insert_job('SELECT ''no window''', current_catalog, window_id := -1);
+SELECT (:extschema.update_job(job_id, window_id := (SELECT window_id FROM :extschema.maintenance_window WHERE window_name = 'nightly'))).window_id IS NOT NULL
+  FROM :extschema.my_job WHERE job_command = 'SELECT ''deferrable''';
+UPDATE :extschema.maintenance_window SET duration = '4 hours' WHERE window_name = 'nightly';